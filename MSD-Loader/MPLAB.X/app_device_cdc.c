@@ -27,16 +27,45 @@ limitations under the License.
 #include "usb_device_cdc.h"
 #include "app_device_cdc.h"
 #include "usb_config.h"
+#include "direct.h"
+#include "frame.h"
+#include "lvp.h"
 
 /** VARIABLES ******************************************************/
 
-static uint8_t USBOutBuffer[CDC_DATA_OUT_EP_SIZE]@0x3A0;           // bank7
-static uint8_t SerialBuffer[CDC_DATA_IN_EP_SIZE]@0x420;            // bank8
+static uint8_t  latency;        // ms to wait for more UART data (0 = no wait)
+static uint16_t latency_tick;   // start of the current latency period
+static uint8_t  rx_flush;       // bytes to send now (the ring may wrap)
+static bool     rx_mark;        // timestamp capture: send a marker chunk
+static uint32_t rx_mark_time;
+
+// CDC programming channel, selected by the vendor request SET_PROGRAM:
+// CDC_PROGRAM_HEX      the OUT data is a hex file parsed and programmed into
+//                      the target, each record is acknowledged with a '.', a
+//                      decoding failure with a '!'
+// CDC_PROGRAM_FRAME    each OUT packet is a request frame (frame.h), answered
+//                      with a reply frame
+// it lasts until SET_PROGRAM CDC_PROGRAM_BRIDGE or a bus reset, whatever the
+// line coding
+enum cdcmode { CDC_BRIDGE = CDC_PROGRAM_BRIDGE, CDC_PROG_HEX = CDC_PROGRAM_HEX, CDC_PROG_FRAME = CDC_PROGRAM_FRAME };
+
+static uint8_t  prog_mode;
+static uint8_t  prog_acks;      // records to acknowledge
+static bool     prog_error;
+static const char prog_dots[] = "................................";
+
+#if defined(CDC_RESET_LINE_STATE)
+// target reset driven by a line of SET_CONTROL_LINE_STATE (DTR or RTS)
+enum cdcreset { CDC_RESET_IDLE, CDC_RESET_REQUEST, CDC_RESET_ACTIVE, CDC_RESET_RELEASE };
+
+#define CDC_RESET_LINE_ACTIVE() \
+    (((control_signal_bitmap._byte & CDC_RESET_LINE_STATE) != 0) == CDC_RESET_ACTIVE_LEVEL)
+
+static uint8_t  reset_state;
+static bool     reset_line;     // the line is in the active state
+static uint16_t reset_tick;     // start of the reset pulse
+#endif
 
-uint8_t     NextUSBOut;
-uint8_t     LastSerialOut;  // Number of characters in the buffer
-uint8_t     SerialCp;       // current position within the buffer
-bool        SerialBuffer_Rdy = false;
 
 /*********************************************************************
 * Function: void APP_DeviceCDCEmulatorInitialize(void);
@@ -50,14 +79,135 @@ void APP_DeviceCDCEmulatorInitialize()
     line_coding.bParityType = 0;
     line_coding.dwDTERate = 9600;
 
-// 	 Initialize the arrays
-   uint8_t i;
-   for (i=0; i<sizeof(USBOutBuffer); i++){
-      USBOutBuffer[i] = 0;
-   }
+    latency = CDC_LATENCY_TIMER_DEFAULT;
+    rx_flush = 0;
+    rx_mark = false;
+    UART_stampStart(false);
+    prog_mode = CDC_BRIDGE;
+#if defined(CDC_RESET_LINE_STATE)
+    reset_line = CDC_RESET_LINE_ACTIVE();
+#endif
+}
+
+#if defined(CDC_RESET_LINE_STATE)
+/*********************************************************************
+* Function: static void APP_DeviceCDCResetTasks(void);
+* Overview: Resets the target as requested by the line state, for
+*   CDC_RESET_PULSE_MS or until the line is released. A programming in
+*   progress owns nMCLR, the reset waits for its end. Once asserted, the
+*   reset owns nMCLR in turn (LVP_inProgress() reports the pin driven, it
+*   is not tested again). The UART RX ring is flushed as the target is
+*   released, so that the host receives the boot output from its first
+*   byte.
+********************************************************************/
+static void APP_DeviceCDCResetTasks(void)
+{
+    uint16_t tick = (uint16_t)USBGet1msTickCount();
+
+    if (reset_state == CDC_RESET_IDLE) return;
+
+    if (reset_state == CDC_RESET_REQUEST)
+    {
+        if (LVP_inProgress()) return;       // wait for the end of the programming
+        ICSP_slaveReset();
+        reset_tick = tick;
+        reset_state = CDC_RESET_ACTIVE;
+    }
+    else if ((reset_state == CDC_RESET_RELEASE) ||
+             ((CDC_RESET_PULSE_MS != 0) && ((uint16_t)(tick - reset_tick) >= CDC_RESET_PULSE_MS)))
+    {
+        UART_rxRelease(UART_rxCount());
+        UART_rxEvent = false;
+        rx_flush = 0;
+        latency_tick = tick;
+        ICSP_slaveRun();
+        reset_state = CDC_RESET_IDLE;
+        if (UART_stampEnable)
+        {
+            rx_mark_time = UART_timeGet();  // boot time reference
+            rx_mark = true;
+        }
+    }
+}
+#endif
+
+/*********************************************************************
+* Function: static void APP_DeviceCDCProgramTasks(void);
+* Overview: Feeds the CDC OUT data to the hex parser and returns the
+*   acknowledgements (the host may keep several records in flight, a
+*   record is acknowledged once it has been programmed), or executes the
+*   request frames.
+********************************************************************/
+static void APP_DeviceCDCProgramTasks(void)
+{
+    uint8_t n;
+
+    UART_rxRelease(UART_rxCount()); // target output is discarded meanwhile
+
+    if (prog_mode == CDC_PROG_FRAME)
+    {
+        //one request at a time, its reply must fit in the IN endpoint
+        if (!USBHandleBusy(CDCDataOutHandle) && USBUSARTIsTxTrfReady())
+        {
+            n = FRAME_process(cdc_data_rx, USBHandleGetLength(CDCDataOutHandle));
+            if (n > 0)
+            {
+                putUSBUSART((uint8_t*)cdc_data_rx, n);
+                CDCTxService();     // copies the reply to the IN endpoint buffer
+            }
+            getsUSBUSART(NULL, 0);  // re-arm the endpoint
+        }
+        CDCTxService();
+        return;
+    }
+
+	if (!USBHandleBusy(CDCDataOutHandle))
+	{
+        if (!DIRECT_StreamWrite(cdc_data_rx, USBHandleGetLength(CDCDataOutHandle)))
+            prog_error = true;
+        n = DIRECT_StreamRecords();
+        prog_acks = (prog_acks > 0xff - n) ? 0xff : prog_acks + n;
+        getsUSBUSART(NULL, 0);  // re-arm the endpoint
+	}
+
+	if (USBUSARTIsTxTrfReady())
+	{
+        if (prog_acks > 0)
+        {
+            n = (prog_acks < sizeof(prog_dots) - 1) ? prog_acks : sizeof(prog_dots) - 1;
+            putrsUSBUSART(&prog_dots[sizeof(prog_dots) - 1 - n]);
+            prog_acks -= n;
+        }
+        else if (prog_error)
+        {
+            putrsUSBUSART("!");
+            prog_error = false;
+        }
+	}
+    CDCTxService();
+}
+
+/*********************************************************************
+* Function: static void APP_DeviceCDCChunk(uint8_t count, uint32_t stamp);
+* Overview: Timestamp capture, sends a chunk of the RX ring (count bytes
+*   from the tail) assembled in place in the IN endpoint buffer:
+*   length, time of the first byte (4 bytes, little endian), data.
+*   An empty chunk marks the release of the target reset.
+* PreCondition: USBUSARTIsTxTrfReady()
+********************************************************************/
+static void APP_DeviceCDCChunk(uint8_t count, uint32_t stamp)
+{
+    uint8_t i, tail = UART_rxTail;
 
-	NextUSBOut = 0;
-	LastSerialOut = 0;
+    cdc_data_tx[0] = count;
+    cdc_data_tx[1] = (uint8_t)stamp;
+    cdc_data_tx[2] = (uint8_t)(stamp >> 8);
+    cdc_data_tx[3] = (uint8_t)(stamp >> 16);
+    cdc_data_tx[4] = (uint8_t)(stamp >> 24);
+    for (i = 0; i < count; i++)
+        cdc_data_tx[CDC_CHUNK_HEADER + i] = UART_rxBuffer[(tail + i) & (UART_RX_SIZE - 1)];
+    putUSBUSART((uint8_t*)cdc_data_tx, count + CDC_CHUNK_HEADER);
+    CDCTxService();             // the copy to the IN endpoint buffer is a no-op
 }
 
 /*********************************************************************
@@ -70,74 +220,168 @@ void APP_DeviceCDCEmulatorTasks()
 
     if((USBDeviceState < CONFIGURED_STATE)||(USBSuspendControl==1)) return;
 
-	if (!SerialBuffer_Rdy)  // only check for new USB buffer if the old Serial buffer is
-	{						  // empty.  This will cause additional USB packets to be NAK'd
-		LastSerialOut = getsUSBUSART(SerialBuffer, 64); // until the buffer is free.
-		if(LastSerialOut > 0)
-		{
-			SerialBuffer_Rdy = true;    // signal buffer full
-			SerialCp = 0;               // reset the current position
-		}
-	}
+#if defined(CDC_RESET_LINE_STATE)
+    APP_DeviceCDCResetTasks();
+#endif
+
+    if (prog_mode != CDC_BRIDGE)
+    {
+        APP_DeviceCDCProgramTasks();
+        return;
+    }
 
-//    Check if one or more bytes are waiting in the physical UART transmit
-//    queue.  If so, send it out the UART TX pin.
-	if(SerialBuffer_Rdy && UART_TxRdy())
+    //The CDC OUT endpoint buffer and the UART TX ring form a double buffer:
+    //the next USB packet is accepted while the TXIF interrupt drains the
+    //previous one. A received packet stays in the endpoint buffer (further
+    //packets are NAK'd) until the ring has room for all of it.
+	if (!USBHandleBusy(CDCDataOutHandle))
 	{
-    	#if defined(USB_CDC_SUPPORT_HARDWARE_FLOW_CONTROL)
-        	// make sure the receiving UART device is ready to receive data before
-        	// actually sending it.
-        	if(UART_CTS == USB_CDC_CTS_ACTIVE_LEVEL)
-        	{
-        		UART_putc(SerialBuffer[SerialCp]);
-        		++SerialCp;
-        		if (SerialCp == LastSerialOut)
-        			SerialBuffer_Rdy = false;
-    	    }
-	    #else
-	        //Hardware flow control not being used.  Just send the data.
-    		UART_putch(SerialBuffer[SerialCp]);
-    		++SerialCp;
-    		if (SerialCp == LastSerialOut)
-    			SerialBuffer_Rdy = false;
-	    #endif
+        uint8_t len = USBHandleGetLength(CDCDataOutHandle);
+
+        if (len <= UART_txFree())
+        {
+            UART_txWrite(cdc_data_rx, len);
+            getsUSBUSART(NULL, 0);  // re-arm the endpoint
+        }
 	}
 
-    //Check if we received a character over the physical UART, and we need
-    //to buffer it up for eventual transmission to the USB host.
-	if (UART_RxRdy() && (NextUSBOut < (CDC_DATA_OUT_EP_SIZE - 1)))
+	#if defined(USB_CDC_SUPPORT_HARDWARE_FLOW_CONTROL) && defined(UART_CTS)
+    	//The TX interrupt stops while the receiving UART device deasserts CTS,
+    	//restart it once CTS is asserted again. Meanwhile the TX ring fills up
+    	//and the CDC OUT endpoint is no longer re-armed (USB back-pressure).
+    	if(UART_CTS == USB_CDC_CTS_ACTIVE_LEVEL)
+            UART_txStart();
+    #endif
+
+    //RTS is driven by the RX interrupt (deasserted at CDC_RTS_HIGH_WATERMARK)
+    //and by UART_rxRelease() (asserted at CDC_RTS_LOW_WATERMARK)
+
+    //Timestamp capture: a marker chunk (no data) at the target reset release
+    if(rx_mark && USBUSARTIsTxTrfReady())
     {
-		USBOutBuffer[NextUSBOut] = UART_getch();
-		++NextUSBOut;
-		USBOutBuffer[NextUSBOut] = 0;
-	}
+        APP_DeviceCDCChunk(0, rx_mark_time);
+        rx_mark = false;
+    }
 
-	#if defined(USB_CDC_SUPPORT_HARDWARE_FLOW_CONTROL)
-    	//Drive RTS pin, to let UART device attached know if it is allowed to
-    	//send more data or not.  If the receive buffer is almost full, we
-    	//deassert RTS.
-    	if(NextUSBOut <= (CDC_DATA_OUT_EP_SIZE - 5u))
-    	{
-            UART_RTS = USB_CDC_RTS_ACTIVE_LEVEL;
+    //Send the bytes received by the UART (RX interrupt ring) to the USB host
+    //when a full packet is waiting, the event character was received or the
+    //latency timer expired, to avoid a flood of short IN packets.
+    //The latency period starts when the ring gets data or a packet is sent.
+	if(!UART_RxRdy())
+	{
+        latency_tick = (uint16_t)USBGet1msTickCount();
+	}
+	else if(USBUSARTIsTxTrfReady())
+	{
+        if ((rx_flush == 0) &&
+            (UART_rxEvent ||
+             (UART_rxCount() >= (UART_stampEnable ? CDC_CHUNK_DATA_MAX : CDC_DATA_IN_EP_SIZE - 1)) ||
+             ((uint16_t)((uint16_t)USBGet1msTickCount() - latency_tick) >= latency)))
+        {
+            UART_rxEvent = false;
+            rx_flush = UART_rxCount();
         }
-        else
+
+        //timestamp capture: one chunk per packet, the data is copied
+        if (UART_stampEnable && (rx_flush > 0))
         {
-        	UART_RTS = (USB_CDC_RTS_ACTIVE_LEVEL ^ 1);
+            uint32_t stamp;
+            uint8_t  count = UART_rxChunk(&stamp, CDC_CHUNK_DATA_MAX);
+
+            APP_DeviceCDCChunk(count, stamp);
+            UART_rxRelease(count);
+            rx_flush = 0;
+            latency_tick = (uint16_t)USBGet1msTickCount();
         }
-    #endif
 
-    //Check if any bytes are waiting in the queue to send to the USB host.
-    //If any bytes are waiting, and the endpoint is available, prepare to
-    //send the USB packet to the host.
-	if((USBUSARTIsTxTrfReady()) && (NextUSBOut > 0))
-	{
-		putUSBUSART(&USBOutBuffer[0], NextUSBOut);
-		NextUSBOut = 0;
+        //send the contiguous part of the ring straight from it
+        if (rx_flush > 0)
+        {
+            uint8_t head = UART_rxHead;
+            uint8_t tail = UART_rxTail;
+            uint8_t count = ((head < tail) ? UART_RX_SIZE : head) - tail;
+
+            if (count > rx_flush)
+                count = rx_flush;
+            putUSBUSART(&UART_rxBuffer[tail], count);
+            CDCTxService();         // copies the data to the IN endpoint buffer
+            UART_rxRelease(count);  // before the ISR may reuse the space
+            rx_flush -= count;
+            latency_tick = (uint16_t)USBGet1msTickCount();
+        }
 	}
 
     CDCTxService();
 }
 
+/*********************************************************************
+* Function: void APP_DeviceCDCVendorRequest(void);
+*
+* Overview: Handles the latency timer, event character, timestamp and
+*   programming channel vendor requests
+********************************************************************/
+void APP_DeviceCDCVendorRequest(void)
+{
+    if(SetupPkt.RequestType != USB_SETUP_TYPE_VENDOR_BITFIELD) return;
+
+    switch(SetupPkt.bRequest)
+    {
+        case CDC_VENDOR_SET_EVENT_CHAR:
+            UART_eventEnable = false;
+            UART_eventChar = (uint8_t)SetupPkt.wValue;
+            UART_eventEnable = ((SetupPkt.wValue & 0x100) != 0);
+            USBEP0Transmit(USB_EP0_NO_DATA);
+            break;
+
+        case CDC_VENDOR_SET_LATENCY_TIMER:
+            latency = (uint8_t)SetupPkt.wValue;
+            USBEP0Transmit(USB_EP0_NO_DATA);
+            break;
+
+        case CDC_VENDOR_GET_LATENCY_TIMER:
+            USBEP0SendRAMPtr(&latency, 1, USB_EP0_INCLUDE_ZERO);
+            break;
+
+        case CDC_VENDOR_SET_TIMESTAMP:
+            UART_stampStart(SetupPkt.wValue != 0);
+            rx_flush = 0;       // the data waiting goes in the first chunk
+            rx_mark = false;
+            USBEP0Transmit(USB_EP0_NO_DATA);
+            break;
+
+#if defined(CDC_PROGRAM_CHANNEL)
+        case CDC_VENDOR_SET_PROGRAM:
+            if (SetupPkt.wValue > CDC_PROGRAM_FRAME) break; // unknown: STALL
+            prog_mode = (uint8_t)SetupPkt.wValue;
+            prog_acks = 0;
+            prog_error = false;
+            USBEP0Transmit(USB_EP0_NO_DATA);
+            break;
+#endif
+    }
+}
+
+/******************************************************************************
+ * Function:        void APP_SetControlLineStateHandler(void)
+ * PreCondition:    USB_CDC_SET_CONTROL_LINE_STATE_HANDLER is defined
+ * Overview:        Called on a SetControlLineState request, the transition of
+ *                  the CDC_RESET_LINE_STATE line to CDC_RESET_ACTIVE_LEVEL
+ *                  requests a target reset (executed by the CDC tasks).
+ *****************************************************************************/
+#if defined(USB_CDC_SET_CONTROL_LINE_STATE_HANDLER)
+void APP_SetControlLineStateHandler(void)
+{
+    bool line = CDC_RESET_LINE_ACTIVE();
+
+    if (line == reset_line) return;
+    reset_line = line;
+    if (line)
+        reset_state = CDC_RESET_REQUEST;
+    else if (CDC_RESET_PULSE_MS == 0)       // held in reset until now
+        reset_state = (reset_state == CDC_RESET_ACTIVE) ? CDC_RESET_RELEASE : CDC_RESET_IDLE;
+}
+#endif
+
 /******************************************************************************
  * Function:        void APP_mySetLineCodingHandler(void)
  * PreCondition:    USB_CDC_SET_LINE_CODING_HANDLER is defined
@@ -149,29 +393,28 @@ void APP_DeviceCDCEmulatorTasks()
 #if defined(USB_CDC_SET_LINE_CODING_HANDLER)
 void APP_SetLineCodingHandler(void)
 {
-    //If the request is not in a valid range
-    //if(cdc_notice.GetLineCoding.dwDTERate > 115200)
-    //{
-        //NOTE: There are two ways that an unsupported baud rate could be
-        //handled.  The first is just to ignore the request and don't change
-        //the values.  That is what is currently implemented in this function.
-        //The second possible method is to stall the STATUS stage of the request.
-        //STALLing the STATUS stage will cause an exception to be thrown in the
-        //requesting application.  Some programs, like HyperTerminal, handle the
-        //exception properly and give a pop-up box indicating that the request
-        //settings are not valid.  Any application that does not handle the
-        //exception correctly will likely crash when this requiest fails.  For
-        //the sake of example the code required to STALL the status stage of the
-        //request is provided below.  It has been left out so that this demo
-        //does not cause applications without the required exception handling
-        //to crash.
-        //---------------------------------------
-        //USBStallEndpoint(0,1);
-    //}
-    //else
-    //{
-    //Update the baudrate info in the CDC driver
-    CDCSetBaudRate(cdc_notice.GetLineCoding.dwDTERate);
-    UART_baudrateSet(line_coding.dwDTERate); // !!!
+    uint32_t dwBaud = cdc_notice.GetLineCoding.dwDTERate;
+
+    dwBaud = UART_baudrateSet(dwBaud);
+    if (dwBaud == 0)
+    {
+        //The rate is out of range or can't be generated within UART_BAUD_ERROR.
+        //There are two ways that an unsupported baud rate could be handled:
+        //ignore the request and keep the current values, or stall the STATUS
+        //stage of the request. STALLing the STATUS stage will cause an
+        //exception to be thrown in the requesting application. Some programs,
+        //like HyperTerminal, handle the exception properly and give a pop-up
+        //box indicating that the request settings are not valid, applications
+        //without the required exception handling may crash.
+        #if defined(USB_CDC_STALL_UNSUPPORTED_BAUD)
+            USBStallEndpoint(0,1);
+        #endif
+    }
+    else
+    {
+        //Update the baudrate info in the CDC driver with the actual rate,
+        //returned to the host by GET_LINE_CODING
+        CDCSetBaudRate(dwBaud);
+    }
 }
 #endif
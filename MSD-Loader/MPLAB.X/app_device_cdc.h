@@ -53,4 +53,46 @@ void APP_DeviceCDCEmulatorInitialize();
 ********************************************************************/
 void APP_DeviceCDCEmulatorTasks();
 
+/*********************************************************************
+* Function: void APP_DeviceCDCVendorRequest(void);
+*
+* Overview: Handles the vendor requests configuring the UART to USB
+*   aggregation (FTDI compatible request codes):
+*   SET_EVENT_CHAR      wValue = char | 0x100 to enable, 0 to disable
+*   SET_LATENCY_TIMER   wValue = latency in ms (0 = no wait)
+*   GET_LATENCY_TIMER   returns the latency (1 byte)
+*   the timestamp capture mode:
+*   SET_TIMESTAMP       wValue = 1 to enable (the time restarts from 0),
+*                       0 to disable
+*   and the programming channels (CDC_PROGRAM_CHANNEL):
+*   SET_PROGRAM         wValue = CDC_PROGRAM_HEX or CDC_PROGRAM_FRAME,
+*                       CDC_PROGRAM_BRIDGE to return to the serial bridge
+*
+* PreCondition: Called from the EVENT_EP0_REQUEST handler
+*
+* Input: None
+*
+* Output: None
+*
+********************************************************************/
+void APP_DeviceCDCVendorRequest(void);
+
+#define CDC_VENDOR_SET_EVENT_CHAR       0x06
+#define CDC_VENDOR_SET_LATENCY_TIMER    0x09
+#define CDC_VENDOR_GET_LATENCY_TIMER    0x0A
+#define CDC_VENDOR_SET_TIMESTAMP        0x40
+#define CDC_VENDOR_SET_PROGRAM          0x45
+
+// SET_PROGRAM channels, the line coding only ever configures the UART
+#define CDC_PROGRAM_BRIDGE  0       // OUT data sent to the target UART
+#define CDC_PROGRAM_HEX     1       // hex file, a '.' per record programmed
+#define CDC_PROGRAM_FRAME   2       // request frames (frame.h)
+
+// Timestamp capture mode: the UART data is sent in chunks, one per packet,
+//      length, time of the first byte (UART_TIME_HZ, 4 bytes little endian), data
+// the time is taken by the RX interrupt, an empty chunk marks the release of
+// the target reset (CDC_RESET_LINE_STATE)
+#define CDC_CHUNK_HEADER    5
+#define CDC_CHUNK_DATA_MAX  (CDC_DATA_IN_EP_SIZE - CDC_CHUNK_HEADER)
+
 #endif
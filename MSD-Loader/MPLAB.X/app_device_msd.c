@@ -26,6 +26,18 @@ limitations under the License.
 #include "direct.h"
 
 
+// Drives exposed by the LUNs (in order), each with its own fabricated volume
+const DRIVE_CONFIG drive_program = { DRIVE_PROGRAM, "XPRESS     "};
+#if (MAX_LUN >= 1)
+const DRIVE_CONFIG drive_verify  = { DRIVE_VERIFY,  "VERIFY     "};
+#endif
+#if (MAX_LUN >= 2)
+const DRIVE_CONFIG drive_eeprom  = { DRIVE_EEPROM,  "EEPROM     "};
+#endif
+#if (MAX_LUN > 2)
+#error "Up to 3 LUNs are supported (PROGRAM, VERIFY, EEPROM).  Please adjust MAX_LUN in usb_config.h."
+#endif
+
 //The LUN variable definition is critical to the MSD function driver.  This
 //  array is a structure of function pointers that are the functions that
 //  will take care of each of the physical media.  For each additional LUN
@@ -33,7 +45,8 @@ limitations under the License.
 //  so that the stack can know where to find the physical layer functions.
 //  In this example the media initialization function is named
 //  "MediaInitialize", the read capacity function is named "ReadCapacity",
-//  etc.
+//  etc.  All the LUNs share the DIRECT functions, the drive configuration
+//  is passed as the media parameters.
 LUN_FUNCTIONS LUN[MAX_LUN + 1] =
 {
     {
@@ -44,8 +57,32 @@ LUN_FUNCTIONS LUN[MAX_LUN + 1] =
         (uint8_t  (*)(void *, uint32_t, uint8_t*, uint8_t))&DIRECT_SectorRead,
         (uint8_t  (*)(void *))&DIRECT_WriteProtectStateGet,
         (uint8_t  (*)(void *, uint32_t, uint8_t*, uint8_t))&DIRECT_SectorWrite,
-        (void *)NULL
+        (void *)&drive_program
+    }
+#if (MAX_LUN >= 1)
+   ,{
+        (FILEIO_MEDIA_INFORMATION* (*)(void *))&DIRECT_MediaInitialize,
+        (uint32_t (*)(void *))&DIRECT_CapacityRead,
+        (uint16_t (*)(void *))&DIRECT_SectorSizeRead,
+        (bool  (*)(void *))&DIRECT_MediaDetect,
+        (uint8_t  (*)(void *, uint32_t, uint8_t*, uint8_t))&DIRECT_SectorRead,
+        (uint8_t  (*)(void *))&DIRECT_WriteProtectStateGet,
+        (uint8_t  (*)(void *, uint32_t, uint8_t*, uint8_t))&DIRECT_SectorWrite,
+        (void *)&drive_verify
+    }
+#endif
+#if (MAX_LUN >= 2)
+   ,{
+        (FILEIO_MEDIA_INFORMATION* (*)(void *))&DIRECT_MediaInitialize,
+        (uint32_t (*)(void *))&DIRECT_CapacityRead,
+        (uint16_t (*)(void *))&DIRECT_SectorSizeRead,
+        (bool  (*)(void *))&DIRECT_MediaDetect,
+        (uint8_t  (*)(void *, uint32_t, uint8_t*, uint8_t))&DIRECT_SectorRead,
+        (uint8_t  (*)(void *))&DIRECT_WriteProtectStateGet,
+        (uint8_t  (*)(void *, uint32_t, uint8_t*, uint8_t))&DIRECT_SectorWrite,
+        (void *)&drive_eeprom
     }
+#endif
 };
 
 /* Standard Response to INQUIRY command stored in ROM 	*/
@@ -22,7 +22,45 @@ limitations under the License.
 #include <stdint.h>
 
 #define UART_TxRdy()    TXSTAbits.TRMT
-#define UART_RxRdy()    PIR1bits.RCIF
+
+#define UART_BAUD_MAX   3000000 // highest rate accepted by UART_baudrateSet()
+#define UART_BAUD_ERROR 20      // highest rate error accepted (per mil)
+#define UART_RxRdy()    (UART_rxHead != UART_rxTail)
+
+// UART RX ring, filled by the RCIF interrupt (single producer) and emptied by
+// the main loop (single consumer): each index has a single writer, so neither
+// side needs to disable interrupts
+#define UART_RX_SIZE    64      // must be a power of 2
+#define UART_rxCount()  ((uint8_t)(UART_rxHead - UART_rxTail) & (UART_RX_SIZE - 1))
+
+extern uint8_t UART_rxBuffer[UART_RX_SIZE];
+extern volatile uint8_t UART_rxHead;        // written by the ISR only
+extern volatile uint8_t UART_rxTail;        // written by the main loop only
+extern volatile uint16_t UART_rxOverruns;   // EUSART FIFO overruns (OERR)
+extern volatile uint16_t UART_rxDrops;      // bytes lost to a full ring
+extern volatile bool UART_rxEvent;          // event character received
+extern uint8_t UART_eventChar;
+extern bool UART_eventEnable;
+
+// UART TX ring, filled by the main loop and emptied by the TXIF interrupt;
+// free running indices so that a full 64-byte CDC packet fits
+#define UART_TX_SIZE    64      // must be a power of 2
+#define UART_txFree()   (UART_TX_SIZE - (uint8_t)(UART_txHead - UART_txTail))
+#define UART_txEmpty()  (UART_txHead == UART_txTail)
+
+extern uint8_t UART_txBuffer[UART_TX_SIZE];
+extern volatile uint8_t UART_txHead;        // written by the main loop only
+extern volatile uint8_t UART_txTail;        // written by the ISR only
+
+// RX timestamps (capture mode): Timer1 counts Fosc/4 / 8, its overflows are
+// counted by the TMR1IF interrupt, the RCIF interrupt stamps the first byte
+// received since the main loop took the last chunk (UART_rxChunk())
+#define UART_TIME_HZ    (_XTAL_FREQ / 4 / 8)
+
+extern volatile uint16_t UART_timeHigh;     // Timer1 overflows, written by the ISR only
+extern volatile uint32_t UART_rxStamp;      // time of the first byte of the chunk
+extern volatile bool UART_rxStamped;
+extern bool UART_stampEnable;
 
 typedef enum
 {
@@ -37,8 +75,18 @@ bool BUTTON_isPressed(void);
 void LED_set(COLOR c);
 void UART_enable(void);
 void UART_disable(void);
-void UART_baudrateSet(uint32_t dwBaud);
+uint32_t UART_baudrateSet(uint32_t dwBaud);
 char UART_getch(void);
 void UART_putch(char);
+void UART_rxISR(void);
+void UART_rxRelease(uint8_t count);
+void UART_txISR(void);
+void UART_txWrite(const volatile uint8_t *data, uint8_t count);
+void UART_txStart(void);
+void UART_txStop(void);
+void UART_timeISR(void);
+uint32_t UART_timeGet(void);
+void UART_stampStart(bool enable);
+uint8_t UART_rxChunk(uint32_t *stamp, uint8_t max);
 
 #endif //BSP_H
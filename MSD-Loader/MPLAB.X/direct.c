@@ -23,6 +23,7 @@ limitations under the License.
 #include <direct.h>
 #include "files.h"
 #include "lvp.h"
+#include "usb.h"            // USBGet1msTickCount()
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -31,6 +32,8 @@ limitations under the License.
  * Global Variables
  *****************************************************************************/
 static FILEIO_MEDIA_INFORMATION mediaInformation;
+static DRIVE_MODE hex_mode;         // destination of the records being parsed
+static uint8_t hex_records;         // records parsed since DIRECT_StreamRecords()
 bool ParseHex(char c);
 
 /******************************************************************************
@@ -92,24 +95,46 @@ FILEIO_MEDIA_INFORMATION * DIRECT_MediaInitialize(void* config)
  *****************************************************************************/
 uint8_t DIRECT_SectorRead(void* config, uint32_t sector_addr, uint8_t* buffer, uint8_t seg)
 {
+    const DRIVE_CONFIG *drive = config;
+
     // Read a sector worth of data, and copy it to the specified RAM "buffer"
     if      ( 0 == sector_addr)     MasterBootRecordGet( buffer, seg);
-    else if ( 1 == sector_addr)     VolumeBootRecordGet( buffer, seg);
-    else if ( 2 == sector_addr)     {
-        FATRecordGet( buffer, seg);
+    else if ( 1 == sector_addr)     VolumeBootRecordGet( drive, buffer, seg);
+    else if ( DRV_ROOT_SECTOR > sector_addr) {
+        FATRecordGet( drive, sector_addr - DRV_FAT_SECTOR, buffer, seg);
     }
-    else if ( 3 == sector_addr)     {
-        RootRecordGet( buffer, seg);
+    else if ( DRV_ROOT_SECTOR == sector_addr) {
+        RootRecordGet( drive, buffer, seg);
     }
     else {
         memset(buffer, '\0', MSD_IN_EP_SIZE); // empty buffer
-        if ( 4 == sector_addr) {
+        if ( README_SECTOR == sector_addr) {
             // Service README.HTM
-            if ( seg < ( (readme_size() + 63) % 64) )
+            if ( seg < ( (readme_size() + 63) / 64) )
                 strncpy( (void*)buffer,
                          (void*)&readme[seg*64],
                          64);  // at most 64 bytes at a time
         }
+#ifdef DRV_STATS
+        else if ( (sector_addr >= STATS_SECTOR)
+                  && (sector_addr < STATS_SECTOR + (STATS_SIZE + FILEIO_CONFIG_MEDIA_SECTOR_SIZE - 1) / FILEIO_CONFIG_MEDIA_SECTOR_SIZE)) {
+            // Service STATS.TXT
+            STATS_get( (uint16_t)(sector_addr - STATS_SECTOR) * FILEIO_CONFIG_MEDIA_SECTOR_SIZE
+                       + seg * MSD_IN_EP_SIZE, buffer);
+        }
+#endif
+        else if ( DRIVE_VERIFY == drive->mode) {
+            // Service RESULT.TXT
+            if ( (RESULT_SECTOR == sector_addr) && (0 == seg))
+                VerifyResultGet( buffer);
+        }
+#ifdef DRV_TARGET_HEX
+        else if ( (DRIVE_PROGRAM == drive->mode) && (sector_addr >= TARGET_HEX_SECTOR)) {
+            // Service TARGET.HEX
+            TargetHexGet( ((sector_addr - TARGET_HEX_SECTOR) * FILEIO_CONFIG_MEDIA_SECTOR_SIZE)
+                          + (seg * MSD_IN_EP_SIZE), buffer);
+        }
+#endif
     }
 	return true;
 }//end SectorRead
@@ -123,22 +148,28 @@ uint8_t DIRECT_SectorRead(void* config, uint32_t sector_addr, uint8_t* buffer, u
  *****************************************************************************/
 uint8_t DIRECT_SectorWrite(void* config, uint32_t sector_addr, uint8_t* buffer, uint8_t seg)
 {
-    if ((sector_addr < 2) || (sector_addr >= DRV_TOTAL_DISK_SIZE))
+    if ((sector_addr < DRV_FAT_SECTOR) || (sector_addr >= DRV_TOTAL_DISK_SIZE))
     {
         return false;
     }
-    if ( 2 == sector_addr) {            // updating the FAT table - RAM
+    if ( DRV_ROOT_SECTOR > sector_addr) {   // updating the FAT table - RAM
         FATRecordSet( buffer, seg);     // update the RAM (fabricated) image
         return true;
     }
-    if ( 3 == sector_addr) {            // update of the root directory
+    if ( DRV_DATA_SECTOR > sector_addr) {   // update of the root directory
         RootRecordSet( buffer, seg);
         return true;
     }
 
+    hex_mode = ((const DRIVE_CONFIG*)config)->mode;
+    if (DRIVE_PROGRAM == hex_mode)
+        DIRECT_SessionClose();  // a read-back session would prevent the bulk erase
     // all remaining data sectors are parsed and programmed directly into the device
     uint8_t i=0;
+    STATS_ENTER();
     while ((i++ < 64) && ParseHex(*buffer++));
+    STATS_LEAVE(STAT_PARSE_HEX);
+    STATS_count( STAT_HEX_BYTES, i - 1);
 
     return true;
 } // SectorWrite
@@ -152,6 +183,303 @@ uint8_t DIRECT_WriteProtectStateGet(void* config)
     return false;
 }
 
+/*******************************************************************************
+ Target Session
+
+ LVP is entered without erasing the target to read it back (TARGET.HEX), to
+ verify it or to program the data EE, and is exited when the host goes idle
+ ******************************************************************************/
+static bool     lvp_session = false;// LVP entered without bulk erase
+static uint32_t lvp_tick;           // time of the last access (ms)
+
+#ifdef DRV_TARGET_HEX
+static uint32_t hex_cached = -1;    // address of the flash block in hex_block
+#endif
+
+/**
+ * Enter LVP (once) and restart the idle timeout
+ *
+ * @return  false if the target is being programmed or held in reset
+ */
+bool DIRECT_SessionOpen( void)
+{
+    if (!lvp_session) {
+        if (LVP_inProgress()) return false;
+        LVP_enter();
+        lvp_session = true;
+    }
+    lvp_tick = USBGet1msTickCount();
+    return true;
+}
+
+/**
+ * Exit LVP if a session is open
+ */
+void DIRECT_SessionClose( void)
+{
+    if (lvp_session) {
+        LVP_exit();
+        lvp_session = false;
+#ifdef DRV_TARGET_HEX
+        hex_cached = -1;
+#endif
+    }
+}
+
+/**
+ * Release the target once the host stops accessing it
+ */
+void DIRECT_Tasks( void)
+{
+    if (!lvp_session) return;
+    if (!LVP_inProgress()                   // target released (RESET button)
+        || ((USBGet1msTickCount() - lvp_tick) > DRV_SESSION_TIMEOUT))
+        DIRECT_SessionClose();
+}
+
+/*******************************************************************************
+ CDC Programming Channel
+
+ The hex file is streamed over the virtual serial port (see app_device_cdc.c)
+ into the same parser as the PROGRAM drive, without the FAT round-trip
+ ******************************************************************************/
+/**
+ * Parse a chunk of the hex file
+ *
+ * @param buffer    data received (CDC OUT packet)
+ * @param count     number of bytes
+ * @return          false = decoding failure, the rest of the chunk is dropped
+ */
+bool DIRECT_StreamWrite( volatile uint8_t *buffer, uint8_t count)
+{
+    bool ok = true;
+    STATS_ENTER();
+
+    hex_mode = DRIVE_PROGRAM;
+    DIRECT_SessionClose();      // a read-back session would prevent the bulk erase
+    STATS_count( STAT_HEX_BYTES, count);
+    while (ok && (count-- > 0))
+        ok = ParseHex(*buffer++);
+    STATS_LEAVE(STAT_PARSE_HEX);
+    return ok;
+}
+
+/**
+ * @return  number of records parsed (and programmed) since the last call
+ */
+uint8_t DIRECT_StreamRecords( void)
+{
+    uint8_t n = hex_records;
+    hex_records = 0;
+    return n;
+}
+
+/*******************************************************************************
+ Verification
+
+ Data records dropped on the VERIFY drive are compared with the target flash,
+ the outcome is reported in RESULT.TXT (fixed size, padded with spaces)
+ ******************************************************************************/
+enum verifystate { VERIFY_NONE, VERIFY_BUSY, VERIFY_PASS, VERIFY_FAIL};
+
+static enum verifystate verify_state = VERIFY_NONE;
+static uint32_t verify_address;     // first mismatching record (-1 = none)
+
+static void VerifyRecord( uint32_t address, uint8_t *data, uint8_t data_count)
+{
+    if (verify_state != VERIFY_BUSY) {      // first record of a new file
+        verify_state = VERIFY_BUSY;
+        verify_address = -1;
+    }
+    if (address >= LVP_flashSize()) return; // config words and EE not compared
+    if (verify_address != -1) return;       // report the first mismatch only
+    if (!DIRECT_SessionOpen()
+        || !LVP_verify( address, data, (data_count + 1) & 0xfe)) {
+        verify_address = address;
+        STATS_error( STAT_ERR_VERIFY, address);
+    }
+}
+
+static void VerifyEnd( void)
+{
+    DIRECT_SessionClose();
+    if (verify_state == VERIFY_BUSY)
+        verify_state = (verify_address == -1) ? VERIFY_PASS : VERIFY_FAIL;
+}
+
+void VerifyResultGet( uint8_t *buffer)
+{
+    static const char * const text[] = { "NONE", "BUSY", "PASS", "FAIL 0x"};
+    static const char digit[] = "0123456789ABCDEF";
+    uint8_t i;
+
+    memset( buffer, ' ', VERIFY_RESULT_SIZE - 2);
+    strcpy( (void*)buffer, text[verify_state]);
+    if (verify_state == VERIFY_FAIL)
+        for( i = 0; i < 6; i++)
+            buffer[12 - i] = digit[ (verify_address >> (i * 4)) & 0xf];
+    else
+        buffer[4] = ' ';                    // remove the terminator
+    buffer[VERIFY_RESULT_SIZE - 2] = '\r';
+    buffer[VERIFY_RESULT_SIZE - 1] = '\n';
+}
+
+/*******************************************************************************
+ Data EE Programming
+
+ Only the records addressed to the data EE are programmed by the EEPROM drive,
+ location by location, leaving the program memory untouched
+ ******************************************************************************/
+static void EERecord( uint32_t address, uint8_t *data, uint8_t data_count)
+{
+    uint32_t ee = LVP_eeAddress();
+
+    if ((ee == 0) || (address < ee)) return;    // no data EE or outside it
+    if (DIRECT_SessionOpen())
+        LVP_eeWrite( address, data, data_count);
+}
+
+#ifdef DRV_TARGET_HEX
+/*******************************************************************************
+ TARGET.HEX On-Demand Generation
+
+ The target flash is read back (LVP) only when the host reads the file, and is
+ formatted on the fly as INTEL Hex, one 64-byte segment at a time
+ All records have a fixed length so that a file offset maps directly to a
+ page, a record and a column within it:
+    every 64k page = 1 extended address record + 4096 data records (16 bytes)
+    followed by a single EOF record
+ The flash is read a 64-byte block at a time (a PIC16 row, 4 data records)
+ and the last block is kept until the session ends, as consecutive segments
+ share records. A sector (11 records) re-read by the host goes back to the
+ target: a cache of that size would not fit in the RAM of the PIC16F1454
+ ******************************************************************************/
+#define HEX_ELA_LENGTH      17      // ":02000004PPPPCC\r\n"
+#define HEX_DATA_LENGTH     45      // ":10AAAA00" + 16 data bytes + "CC\r\n"
+#define HEX_EOF_LENGTH      13      // ":00000001FF\r\n"
+#define HEX_PAGE_SIZE       0x10000 // range of an extended linear address
+
+static const char hex_digit[] = "0123456789ABCDEF";
+
+#define HEX_BLOCK_SIZE      64      // flash bytes read at once
+
+static uint8_t  hex_record[21];     // count, address(2), type, data(16), checksum
+static uint8_t  hex_block[HEX_BLOCK_SIZE];
+
+static uint16_t TargetHexLines( void)
+{   // number of data records per page
+    uint32_t size = LVP_flashSize();
+    return (size < HEX_PAGE_SIZE) ? (uint16_t)(size >> 4) : (HEX_PAGE_SIZE >> 4);
+}
+
+static uint8_t TargetHexPages( void)
+{
+    uint32_t size = LVP_flashSize();
+    return (size < HEX_PAGE_SIZE) ? 1 : (uint8_t)(size >> 16);
+}
+
+uint32_t TargetHexSize( void)
+{
+    return TargetHexPages() * (HEX_ELA_LENGTH + (uint32_t)TargetHexLines() * HEX_DATA_LENGTH)
+           + HEX_EOF_LENGTH;
+}
+
+/**
+ * Assemble a (binary) record in hex_record
+ *
+ * @param page  64k page, the EOF record follows the last page
+ * @param line  0 = extended address record, 1.. = data records
+ * @return      record length in characters
+ */
+static uint8_t TargetHexRecord( uint8_t page, uint16_t line)
+{
+    uint32_t address;
+    uint8_t  count, i;
+
+    hex_record[1] = 0;
+    hex_record[2] = 0;
+    if (page == TargetHexPages()) {         // EOF record
+        count = 0;
+        hex_record[3] = 1;
+    }
+    else if (line == 0) {                   // extended linear address record
+        count = 2;
+        hex_record[3] = 4;
+        hex_record[4] = 0;
+        hex_record[5] = page;
+    }
+    else {                                  // data record
+        count = 16;
+        address = ((uint32_t)page << 16) + ((uint32_t)(line - 1) << 4);
+        hex_record[1] = address >> 8;
+        hex_record[2] = address;
+        hex_record[3] = 0;
+        if ((address & ~(uint32_t)(HEX_BLOCK_SIZE - 1)) != hex_cached) {
+            hex_cached = address & ~(uint32_t)(HEX_BLOCK_SIZE - 1);
+            LVP_read( hex_cached, hex_block, HEX_BLOCK_SIZE);
+        }
+        memcpy( &hex_record[4], &hex_block[ address & (HEX_BLOCK_SIZE - 1)], count);
+    }
+    hex_record[0] = count;
+    hex_record[4 + count] = 0;
+    for( i = 0; i < 4 + count; i++)
+        hex_record[4 + count] -= hex_record[i];
+    return 1 + 2 * (count + 5) + 2;         // ':' + hex digits + "\r\n"
+}
+
+/**
+ * Fill a 64-byte segment of TARGET.HEX
+ *
+ * @param offset    position in the file
+ * @param buffer    segment buffer (cleared)
+ */
+void TargetHexGet( uint32_t offset, uint8_t *buffer)
+{
+    uint16_t lines = TargetHexLines();
+    uint32_t page_size = HEX_ELA_LENGTH + (uint32_t)lines * HEX_DATA_LENGTH;
+    uint16_t line;
+    uint8_t  page, col, len, c, i;
+
+    if (offset >= TargetHexSize()) return;  // past the end of file
+    if (!DIRECT_SessionOpen()) return;      // programming or reset in progress
+
+    // locate the record and column
+    page = offset / page_size;
+    offset -= page * page_size;
+    if (offset < HEX_ELA_LENGTH) {
+        line = 0;
+        col = offset;
+    }
+    else {
+        offset -= HEX_ELA_LENGTH;
+        line = 1 + offset / HEX_DATA_LENGTH;
+        col = offset % HEX_DATA_LENGTH;
+    }
+    len = TargetHexRecord( page, line);
+
+    for( i = 0; i < MSD_IN_EP_SIZE; i++) {
+        if (col == len) {                   // advance to the next record
+            if (page == TargetHexPages()) break;
+            col = 0;
+            if (++line > lines) {
+                line = 0;
+                page++;
+            }
+            len = TargetHexRecord( page, line);
+        }
+        if (col == 0)               c = ':';
+        else if (col == len - 2)    c = '\r';
+        else if (col == len - 1)    c = '\n';
+        else {
+            c = hex_record[ (col - 1) >> 1];
+            c = hex_digit[ (col & 1) ? (c >> 4) : (c & 0xf)];
+        }
+        buffer[i] = c;
+        col++;
+    }
+}
+#endif
+
 /*******************************************************************************
  Direct Hex File Parsing and Programming State Machine
 
@@ -161,6 +489,7 @@ uint8_t DIRECT_WriteProtectStateGet(void* config)
  Words are assembled in Rows (currently supporting fixed size of 32-words)
  Rows are aligned (normalized) and written directly to the target using LVP ICSP
  Special treatment is reserved for words written to 'configuration' addresses
+ Records dropped on the VERIFY and EEPROM drives are routed to their handlers
  ******************************************************************************/
 bool isDigit( char * c){
     if (*c < '0') return false;
@@ -200,14 +529,18 @@ bool ParseHex(char c)
         case SOL:
             if (c == '\r') break;
             if (c == '\n') break;
-            if (c != ':') return false;
+            if (c != ':') {
+                if (c != '\0')             // not the padding of the last sector
+                    STATS_error( STAT_ERR_SYNTAX, ext_address + address);
+                return false;
+            }
             state = BYTE_COUNT;
             bc = 0;
             address = 0;
             checksum = 0;
             break;
         case BYTE_COUNT:
-            if ( isDigit( &c) == false) { state = SOL; return false; }
+            if ( isDigit( &c) == false) { state = SOL; STATS_error( STAT_ERR_SYNTAX, ext_address + address); return false; }
             bc++;
             if (bc == 1)
                 data_count = c;
@@ -215,12 +548,12 @@ bool ParseHex(char c)
                 data_count = (data_count << 4) + c;
                 checksum += data_count;
                 bc = 0;
-                if (data_count > 16) { state = SOL; return false; }
+                if (data_count > 16) { state = SOL; STATS_error( STAT_ERR_LENGTH, ext_address); return false; }
                 state = ADDRESS;
             }
             break;
         case ADDRESS:
-            if ( isDigit( &c) == false) { state = SOL; return false;}
+            if ( isDigit( &c) == false) { state = SOL; STATS_error( STAT_ERR_SYNTAX, ext_address + address); return false;}
             bc++;
             if (bc == 1)
                 address = c;
@@ -234,10 +567,10 @@ bool ParseHex(char c)
             }
             break;
         case RECORD_TYPE:
-            if ( isDigit( &c) == false) { state = SOL; return false;}
+            if ( isDigit( &c) == false) { state = SOL; STATS_error( STAT_ERR_SYNTAX, ext_address + address); return false;}
             bc++;
             if (bc == 1)
-                if (c != 0) { state = SOL; return false; }
+                if (c != 0) { state = SOL; STATS_error( STAT_ERR_TYPE, ext_address + address); return false; }
             if (bc == 2)  {
                 record_type = c;
                 checksum += c;
@@ -249,11 +582,12 @@ bool ParseHex(char c)
                 if (record_type == 1) { state = CHKSUM; break; }  // EOF record
                 if (record_type == 4) break; // extended address record
                 state = SOL;
+                STATS_error( STAT_ERR_TYPE, ext_address + address);
                 return false;
             }
             break;
         case DATA:
-            if ( isDigit( &c) == false) { state = SOL; return false;}
+            if ( isDigit( &c) == false) { state = SOL; STATS_error( STAT_ERR_SYNTAX, ext_address + address); return false;}
             bc++;
             if (bc == 1)
                 data[data_index] = (c<<4);
@@ -268,7 +602,7 @@ bool ParseHex(char c)
             }
             break;
         case CHKSUM:
-            if ( isDigit( &c) == false) { state = SOL; return false;}
+            if ( isDigit( &c) == false) { state = SOL; STATS_error( STAT_ERR_SYNTAX, ext_address + address); return false;}
             bc++;
             if (bc == 1)
                 checksum += (c<<4);
@@ -277,16 +611,29 @@ bool ParseHex(char c)
                 checksum += c;
                 if (checksum != 0) {
                     state = SOL;
+                    STATS_error( STAT_ERR_CHECKSUM, ext_address + address);
                     return false;
                 }
                 // chksum is good
                 state = SOL;
-                if (record_type == 0)
-                    LVP_packRow( ext_address + address, data, data_count);
+                if (hex_records < 0xff) hex_records++;
+                if (record_type == 0) {
+                    if (hex_mode == DRIVE_VERIFY)
+                        VerifyRecord( ext_address + address, data, data_count);
+                    else if (hex_mode == DRIVE_EEPROM)
+                        EERecord( ext_address + address, data, data_count);
+                    else
+                        LVP_packRow( ext_address + address, data, data_count);
+                }
                 else if (record_type == 4)
                     ext_address = ((uint32_t)(data[0]) << 24) + ((uint32_t)(data[1]) << 16);
                 else if (record_type == 1) {
-                    LVP_programLastRow();
+                    if (hex_mode == DRIVE_VERIFY)
+                        VerifyEnd();
+                    else if (hex_mode == DRIVE_EEPROM)
+                        DIRECT_SessionClose();
+                    else
+                        LVP_programLastRow();
                     ext_address = 0;
                 }
                 else return false;
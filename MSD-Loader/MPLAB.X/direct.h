@@ -15,6 +15,9 @@ limitations under the License.
 
  *******************************************************************************/
 
+#ifndef DIRECT_H
+#define DIRECT_H
+
 #include "fileio_config.h"
 #include <fileio.h>
 
@@ -28,19 +31,59 @@ uint8_t DIRECT_WriteProtectStateGet(void* config);
 
 void DIRECT_Initialize(void);
 
+// Each LUN is a distinct drive, its configuration is passed as the media
+// parameters (void* config) of the LUN functions (see app_device_msd.c)
+typedef enum {
+    DRIVE_PROGRAM,      // bulk erase and program the hex file (TARGET.HEX)
+    DRIVE_VERIFY,       // compare the hex file with the target flash (RESULT.TXT)
+    DRIVE_EEPROM        // program only the data EE records, no erase
+} DRIVE_MODE;
+
+typedef struct {
+    DRIVE_MODE  mode;
+    char        label[11];  // volume label, padded with spaces
+} DRIVE_CONFIG;
+
+bool DIRECT_SessionOpen(void);
+void DIRECT_SessionClose(void);
+void DIRECT_Tasks(void);
+
+// CDC programming channel: hex file streamed over the virtual serial port
+bool DIRECT_StreamWrite(volatile uint8_t* buffer, uint8_t count);
+uint8_t DIRECT_StreamRecords(void);
+
+#define VERIFY_RESULT_SIZE  16  // fixed size of RESULT.TXT
+void VerifyResultGet(uint8_t* buffer);
+
+#ifdef DRV_TARGET_HEX
+uint32_t TargetHexSize(void);
+void TargetHexGet(uint32_t offset, uint8_t* buffer);
+#endif
+
 #if !defined(DRV_MAX_NUM_FILES_IN_ROOT)
 #define DRV_MAX_NUM_FILES_IN_ROOT 16
 #endif
 
-// Note: If only 1 FAT sector is used, assuming 12-bit (1.5 uint8_t) FAT entry size
-// (ex: FAT12 filesystem), then the total FAT entries that can fit in a single 512
-// uint8_t FAT sector is (512 uint8_ts) / (1.5 uint8_ts/entry) = 341 entries.
-// This allows the FAT table to reference up to 341*512 * SectorsPerCluster (bytes)
-// If SectorPerCluster == 8 (4kB Cluster) ==> 1.4MB  of space.
+// Note: The FAT is fabricated on the fly, so its size costs no RAM.
+// The number of FAT sectors follows from the number of clusters in the volume:
+// 12-bit (1.5 uint8_t) entries for FAT12, 16-bit (2 uint8_t) entries for FAT16.
+// The host decides the FAT type from the cluster count alone (< 4085 => FAT12).
+#define DRV_NUM_CLUSTERS (DRV_CONFIG_DRIVE_CAPACITY / DRV_SECTORS_PER_CLUSTER)
+#ifdef DRV_FAT16
+#define DRV_FAT_EOC 0xFFFF                  // end of cluster chain marker
+#define DRV_FAT_BYTES ((DRV_NUM_CLUSTERS + 2) * 2)
+#else
+#define DRV_FAT_EOC 0xFFF
+#define DRV_FAT_BYTES (((DRV_NUM_CLUSTERS + 2) * 3 + 1) / 2)
+#endif
 #define DRV_NUM_RESERVED_SECTORS 1
 #define DRV_NUM_VBR_SECTORS 1
-#define DRV_NUM_FAT_SECTORS 1
+#define DRV_NUM_FAT_SECTORS ((DRV_FAT_BYTES + FILEIO_CONFIG_MEDIA_SECTOR_SIZE - 1) / FILEIO_CONFIG_MEDIA_SECTOR_SIZE)
 #define DRV_NUM_ROOT_SECTORS ((DRV_MAX_NUM_FILES_IN_ROOT+15)/16) //+15 because the compiler truncates
+// (device) sector map: MBR, VBR, FAT, ROOT, data (cluster #2 onwards)
+#define DRV_FAT_SECTOR  (DRV_NUM_RESERVED_SECTORS + DRV_NUM_VBR_SECTORS)
+#define DRV_ROOT_SECTOR (DRV_FAT_SECTOR + DRV_NUM_FAT_SECTORS)
+#define DRV_DATA_SECTOR (DRV_ROOT_SECTOR + DRV_NUM_ROOT_SECTORS)
 #define DRV_OVERHEAD_SECTORS (\
             DRV_NUM_RESERVED_SECTORS + \
             DRV_NUM_VBR_SECTORS + \
@@ -67,3 +110,19 @@ void DIRECT_Initialize(void);
 #error "Number of root file entries must be a multiple of 16.  Please adjust the definition in the FSconfig.h file."
 #endif
 
+#if (DRV_SECTORS_PER_CLUSTER != 1) && (DRV_SECTORS_PER_CLUSTER != 2) && \
+    (DRV_SECTORS_PER_CLUSTER != 4) && (DRV_SECTORS_PER_CLUSTER != 8) && \
+    (DRV_SECTORS_PER_CLUSTER != 16) && (DRV_SECTORS_PER_CLUSTER != 32) && \
+    (DRV_SECTORS_PER_CLUSTER != 64)
+#error "Sectors per cluster must be a power of 2 (1..64).  Please adjust the definition in the fileio_config.h file."
+#endif
+
+#if defined(DRV_FAT16) && (DRV_NUM_CLUSTERS < 4085)
+#error "FAT16 requires at least 4085 clusters.  Increase DRV_CONFIG_DRIVE_CAPACITY or reduce DRV_SECTORS_PER_CLUSTER."
+#endif
+
+#if !defined(DRV_FAT16) && (DRV_NUM_CLUSTERS > 4084)
+#error "FAT12 supports at most 4084 clusters.  Enable DRV_FAT16 or increase DRV_SECTORS_PER_CLUSTER."
+#endif
+
+#endif  /* DIRECT_H */
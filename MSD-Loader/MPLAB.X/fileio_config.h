@@ -53,12 +53,25 @@ limitations under the License.
 //---------------------------------------------------------------------------------------
 // Note1: Windows 7 appears to require a minimum capacity of at least 13 sectors.
 // Note2: Drive (re)formatting is NOT applicable
+#ifndef DRV_CONFIG_DRIVE_CAPACITY   // can be overridden per configuration (define-macros)
 #define DRV_CONFIG_DRIVE_CAPACITY 4096          // * 512 byte = useable drive volume
+#endif
 
 //--------------------------------------------------------------------------
 // Number of Sectors per Cluster
 //--------------------------------------------------------------------------
+// Note: larger clusters mean fewer FAT updates interleaved with the data of a
+// file copy (use tools/msdbench.sh to compare geometries)
+#ifndef DRV_SECTORS_PER_CLUSTER   // can be overridden per configuration (define-macros)
 #define DRV_SECTORS_PER_CLUSTER     8           // * 512 byte = cluster size (4kB)
+#endif
+
+//--------------------------------------------------------------------------
+// FAT type
+//--------------------------------------------------------------------------
+// Default is FAT12 (up to 4084 clusters), FAT16 requires at least 4085
+// clusters, e.g. DRV_CONFIG_DRIVE_CAPACITY 8192 with DRV_SECTORS_PER_CLUSTER 1
+//#define DRV_FAT16
 
 //--------------------------------------------------------------------------
 // Maximum files supported
@@ -71,4 +84,33 @@ limitations under the License.
 // files, especially if the files are using long filenames.
 #define DRV_MAX_NUM_FILES_IN_ROOT 16
 
+//--------------------------------------------------------------------------
+// Read-only TARGET.HEX (target flash contents generated on demand)
+//--------------------------------------------------------------------------
+// Note: the configuration words and the data EE are not included in the image
+// Note: the device ID is not read, the flash size is that of the largest part
+// the lvp-xx.c module supports (e.g. PIC16F1719, PIC18F27K42); for a smaller
+// part set DRV_FLASH_SIZE, it also bounds VERIFY, FRAME_INFO and GET_INFO
+#define DRV_TARGET_HEX                          // comment out to remove
+//#define DRV_FLASH_SIZE              0x4000      // bytes, e.g. PIC16F1709
+
+//--------------------------------------------------------------------------
+// Target session (TARGET.HEX read back, VERIFY and EEPROM drives)
+//--------------------------------------------------------------------------
+#define DRV_SESSION_TIMEOUT         2000        // ms idle before LVP is exited
+
+//--------------------------------------------------------------------------
+// Read-only STATS.TXT (mount phases time stamps, see stats.c)
+//--------------------------------------------------------------------------
+// Note: occupies the last cluster of the volume
+#define DRV_STATS                               // comment out to remove
+
+// Opt-in, for bench builds: on a PIC16F1454 (1 KB of RAM) the stage times
+// take about 200 bytes and the telemetry answer buffer up to 60 bytes more
+// Hot path stage times in STATS.TXT (keeps Timer1 running, see stats.h)
+//#define DRV_PROFILE                           // uncomment to add
+
+// Telemetry vendor requests on EP0 (tools/statmon, see stats.h)
+//#define DRV_TELEMETRY                         // uncomment to add
+
 #endif
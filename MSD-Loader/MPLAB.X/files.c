@@ -25,10 +25,22 @@ limitations under the License.
 //------------------------------------------------------------------------------
 //Master boot record (MBR) at LBA = 0
 //------------------------------------------------------------------------------
+#ifdef DRV_FAT16
+#if (DRV_TOTAL_DISK_SIZE - 1 < 65536)
+#define DRV_PARTITION_TYPE  0x04    // FAT16 up to 32MB
+#else
+#define DRV_PARTITION_TYPE  0x06    // FAT16
+#endif
+#define DRV_FAT_NAME        "FAT16   "
+#else
+#define DRV_PARTITION_TYPE  0x01    // FAT12
+#define DRV_FAT_NAME        "FAT12   "
+#endif
+
 const uint8_t MBR_seg7[] = {
 /* 0x1c0 */ 0x01,                  // Head
 /* 0x1c1 */ 0x00,                  // Sector address of first sector in partition
-/* 0x1c2 */ 0x01,                  // Partition type - 0x01 = FAT12 up to 2MB -0xE = FAT16
+/* 0x1c2 */ DRV_PARTITION_TYPE,    // Partition type - 0x01 = FAT12 up to 2MB -0xE = FAT16
 /* 0x1c3 */ 0x07,                  // Cylinder
 /* 0x1c4 */ 0xFF,                  // Head
 /* 0x1c5 */ 0xE6,                  // Sector address of last sector in partition
@@ -88,8 +100,8 @@ const uint8_t VBR_seg0[] = {
     /* 0x012 */ 0x00,		// Max number of root directory entries - 16 files allowed
     /* 0x013 */ 0x00, 0x00,  // total sectors (0x0000 means: use the 4 byte field at offset 0x20 instead)
     /* 0x015 */ 0xF8,                               //Media Descriptor
-    /* 0x016 */ DRV_NUM_FAT_SECTORS,
-    /* 0x017 */ 0x00,                               // Sectors per FAT
+    /* 0x016 */ (uint8_t) DRV_NUM_FAT_SECTORS,
+    /* 0x017 */ (uint8_t)(DRV_NUM_FAT_SECTORS >> 8), // Sectors per FAT
     /* 0x018 */ 0x3F,
     /* 0x019 */ 0x00,                               // Sectors per track
     /* 0x01A */ 0xFF,
@@ -108,15 +120,15 @@ const uint8_t VBR_seg0[] = {
     /* 0x02a */ 0xC4
 };
 
-void VolumeBootRecordGet( uint8_t * buffer, uint8_t seg)
+void VolumeBootRecordGet( const DRIVE_CONFIG * drive, uint8_t * buffer, uint8_t seg)
 {  // fabricate an MBR structure in the RAM buffer
     memset( buffer, 0, MSD_OUT_EP_SIZE);              // clear buffer
     if ( 0 == seg ) {       // segment from 000 to 0x03f
         memcpy((void*)buffer, (void*)VBR_seg0, sizeof(VBR_seg0));
         // Volume Label (11 bytes)
-        memcpy( (void*)&buffer[ 0x02b], (void*)"XPRESS     ", 11);
+        memcpy( (void*)&buffer[ 0x02b], (const void*)drive->label, 11);
         // FAT system ( 8 bytes)
-        memcpy( (void*)&buffer[ 0x036], (void*)"FAT12   ", 8);
+        memcpy( (void*)&buffer[ 0x036], (void*)DRV_FAT_NAME, 8);
     }
     else if ( seg < 7) {    // segments 1-6 from 0x040 to 0x1c0 are empty
     }
@@ -128,10 +140,11 @@ void VolumeBootRecordGet( uint8_t * buffer, uint8_t seg)
 }
 
 //------------------------------------------------------------------------------
-// First FAT sector at LBA = 2
-// Note: This table consists of a series of 12-bit entries, and are fully packed
-// (no pad bits).  This means every other byte is a "shared" byte, that is split
-// down the middle and is part of two adjacent 12-bit entries.
+// FAT sectors from LBA = 2
+// Note: For FAT12 this table consists of a series of 12-bit entries, and are
+// fully packed (no pad bits).  This means every other byte is a "shared" byte,
+// that is split down the middle and is part of two adjacent 12-bit entries.
+// For FAT16 each entry is a 16-bit word.
 // The entries are in little endian format.
 
 void FATRecordInit( void)
@@ -139,16 +152,66 @@ void FATRecordInit( void)
     /* The FAT record will be created dynamically */
 }
 
-void FATRecordGet( uint8_t * buffer, uint8_t seg)
+#define CLUSTER_SIZE    ((uint32_t)DRV_SECTORS_PER_CLUSTER * FILEIO_CONFIG_MEDIA_SECTOR_SIZE)
+
+static uint16_t FATEntryGet( uint16_t cluster, uint16_t last)
+{
+    if (cluster == 0)                   return DRV_FAT_EOC & ~7; // Copy of the media descriptor
+    if (cluster < TARGET_HEX_CLUSTER)   return DRV_FAT_EOC;  // 1 - reserved, 2 - readme.htm
+    if (cluster < last)                 return cluster + 1;  // target.hex/result.txt chain
+    if (cluster == last)                return DRV_FAT_EOC;
+#ifdef DRV_STATS
+    if (cluster == STATS_CLUSTER)       return DRV_FAT_EOC;  // stats.txt
+#endif
+    return 0;                                                // free
+}
+
+// true if an entry from (the pair starting at) cluster onwards may be in use
+#ifdef DRV_STATS
+#define FATInUse( cluster, last)    ((cluster <= last) || (cluster + 1 >= STATS_CLUSTER))
+#else
+#define FATInUse( cluster, last)    (cluster <= last)
+#endif
+
+void FATRecordGet( const DRIVE_CONFIG * drive, uint16_t sector, uint8_t * buffer, uint8_t seg)
 {
+    uint32_t n = ((uint32_t)sector * FILEIO_CONFIG_MEDIA_SECTOR_SIZE) + (seg * MSD_IN_EP_SIZE);
+    uint16_t last = TARGET_HEX_CLUSTER - 1;     // last cluster in use
+    uint16_t cluster, e0;
+    uint8_t  i;
+
     memset( (void*)buffer, 0, MSD_IN_EP_SIZE);
-    if (seg == 0) {
-        buffer[0] = 0xF8;       // Copy of the media descriptor 0xFF8
-        buffer[1] = 0xFF;
-        buffer[2] = 0xFF;
-        buffer[3] = 0xFF;       // 2 - first/last cluster in short file chain
-        buffer[4] = 0x0F;      // readme.htm
+    if (DRIVE_VERIFY == drive->mode)
+        last = RESULT_CLUSTER;                  // a single cluster
+#ifdef DRV_TARGET_HEX
+    else if (DRIVE_PROGRAM == drive->mode)
+        last += (TargetHexSize() + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+#endif
+#ifdef DRV_FAT16
+    cluster = n >> 1;
+    for( i = 0; (i < MSD_IN_EP_SIZE) && FATInUse( cluster, last); i += 2) {
+        e0 = FATEntryGet( cluster++, last);
+        buffer[i] = e0;
+        buffer[i + 1] = e0 >> 8;
+    }
+#else
+    // pairs of 12-bit entries are packed in 3 bytes
+    uint16_t e1;
+    uint8_t  r = n % 3;
+
+    cluster = (n / 3) << 1;
+    for( i = 0; (i < MSD_IN_EP_SIZE) && FATInUse( cluster, last); i++) {
+        e0 = FATEntryGet( cluster, last);
+        e1 = FATEntryGet( cluster + 1, last);
+        if (r == 0)         buffer[i] = e0;
+        else if (r == 1)    buffer[i] = (e0 >> 8) | (e1 << 4);
+        else                buffer[i] = e1 >> 4;
+        if (++r == 3) {
+            r = 0;
+            cluster += 2;
+        }
     }
+#endif
 }
 
 void FATRecordSet( uint8_t * buffer, uint8_t seg)
@@ -215,19 +278,117 @@ const uint8_t entry0[ ROOT_ENTRY_SIZE] = {
     sizeof(readme), 0x00, 0x00, 0x00,         // README string size (<256)
 };
 
+#ifdef DRV_TARGET_HEX
+ const  uint8_t entry2[ ROOT_ENTRY_SIZE] = {
+    'T','A','R','G','E','T',' ',' ',    // File name (exactly 8 characters)
+    'H','E','X',                        // File extension (exactly 3 characters)
+    0x21,           // specify this entry as a regular, read-only file
+    0x00,           // Reserved
+    0x00,           // Creation time, fine res 10 ms units (0-199)
+    TIMEL(MAJOR, MINOR, 0),     // Creation time, hour/min/sec
+    TIMEH(MAJOR, MINOR, 0),     // Creation time, hour/min/sec
+    DATEL(YEAR, MONTH, DAY),    // Creation date, YMD
+    DATEH(YEAR, MONTH, DAY),    // Creation date, YMD
+
+    DATEL(YEAR, MONTH, DAY),    // Last Access date, YMD
+    DATEH(YEAR, MONTH, DAY),    // Last Access date, YMD
+    0x00, 0x00,     // Extended Attributes
+
+    TIMEL(MAJOR, MINOR, 0),     // Last Modified time h/m/s
+    TIMEH(MAJOR, MINOR, 0),     // Last Modified time h/m/s
+    DATEL(YEAR, MONTH, DAY),    // Last Modified date, YMD
+    DATEH(YEAR, MONTH, DAY),    // Last Modified date, YMD
+
+    TARGET_HEX_CLUSTER, 0x00,   // First FAT cluster (follows readme)
+    0x00, 0x00, 0x00, 0x00,     // File size (patched at run time)
+};
+#endif
+
+ const  uint8_t entry3[ ROOT_ENTRY_SIZE] = {
+    'R','E','S','U','L','T',' ',' ',    // File name (exactly 8 characters)
+    'T','X','T',                        // File extension (exactly 3 characters)
+    0x21,           // specify this entry as a regular, read-only file
+    0x00,           // Reserved
+    0x00,           // Creation time, fine res 10 ms units (0-199)
+    TIMEL(MAJOR, MINOR, 0),     // Creation time, hour/min/sec
+    TIMEH(MAJOR, MINOR, 0),     // Creation time, hour/min/sec
+    DATEL(YEAR, MONTH, DAY),    // Creation date, YMD
+    DATEH(YEAR, MONTH, DAY),    // Creation date, YMD
+
+    DATEL(YEAR, MONTH, DAY),    // Last Access date, YMD
+    DATEH(YEAR, MONTH, DAY),    // Last Access date, YMD
+    0x00, 0x00,     // Extended Attributes
+
+    TIMEL(MAJOR, MINOR, 0),     // Last Modified time h/m/s
+    TIMEH(MAJOR, MINOR, 0),     // Last Modified time h/m/s
+    DATEL(YEAR, MONTH, DAY),    // Last Modified date, YMD
+    DATEH(YEAR, MONTH, DAY),    // Last Modified date, YMD
+
+    RESULT_CLUSTER, 0x00,       // First FAT cluster (follows readme)
+    VERIFY_RESULT_SIZE, 0x00, 0x00, 0x00,   // fixed size, padded with spaces
+};
+
+#ifdef DRV_STATS
+ const  uint8_t entry4[ ROOT_ENTRY_SIZE] = {
+    'S','T','A','T','S',' ',' ',' ',    // File name (exactly 8 characters)
+    'T','X','T',                        // File extension (exactly 3 characters)
+    0x21,           // specify this entry as a regular, read-only file
+    0x00,           // Reserved
+    0x00,           // Creation time, fine res 10 ms units (0-199)
+    TIMEL(MAJOR, MINOR, 0),     // Creation time, hour/min/sec
+    TIMEH(MAJOR, MINOR, 0),     // Creation time, hour/min/sec
+    DATEL(YEAR, MONTH, DAY),    // Creation date, YMD
+    DATEH(YEAR, MONTH, DAY),    // Creation date, YMD
+
+    DATEL(YEAR, MONTH, DAY),    // Last Access date, YMD
+    DATEH(YEAR, MONTH, DAY),    // Last Access date, YMD
+    0x00, 0x00,     // Extended Attributes
+
+    TIMEL(MAJOR, MINOR, 0),     // Last Modified time h/m/s
+    TIMEH(MAJOR, MINOR, 0),     // Last Modified time h/m/s
+    DATEL(YEAR, MONTH, DAY),    // Last Modified date, YMD
+    DATEH(YEAR, MONTH, DAY),    // Last Modified date, YMD
+
+    (uint8_t)STATS_CLUSTER, (uint8_t)(STATS_CLUSTER >> 8),  // First FAT cluster (last of the volume)
+    (uint8_t)STATS_SIZE, (uint8_t)(STATS_SIZE >> 8), 0x00, 0x00,    // fixed size
+};
+#endif
+
 void RootRecordInit( void)
 {
     /* The root record will be created dynamically */
 }
 
-void RootRecordGet( uint8_t * buffer, uint8_t seg)
+void RootRecordGet( const DRIVE_CONFIG * drive, uint8_t * buffer, uint8_t seg)
 {
     memset( (void*)buffer, 0, MSD_IN_EP_SIZE);
    if (seg == 0) {
         memcpy( (void*)&buffer[0], (const void*)entry0, ROOT_ENTRY_SIZE );
+        memcpy( (void*)&buffer[0], (const void*)drive->label, 11);
         // add the README.HTM file
         memcpy( (void*)&buffer[ ROOT_ENTRY_SIZE], (const void*)entry1, ROOT_ENTRY_SIZE );
     }
+   else if (seg == 1) {
+        uint8_t i = 0;  // entries must be contiguous
+        if (DRIVE_VERIFY == drive->mode) {
+            // add the RESULT.TXT file
+            memcpy( (void*)&buffer[0], (const void*)entry3, ROOT_ENTRY_SIZE );
+            i = ROOT_ENTRY_SIZE;
+        }
+#ifdef DRV_TARGET_HEX
+        else if (DRIVE_PROGRAM == drive->mode) {
+            // add the TARGET.HEX file, its size depends on the target flash
+            memcpy( (void*)&buffer[0], (const void*)entry2, ROOT_ENTRY_SIZE );
+            uint32_t size = TargetHexSize();
+            memcpy( (void*)&buffer[ ENTRY_FILE_SIZE_OFFSET], (void*)&size, 4);
+            i = ROOT_ENTRY_SIZE;
+        }
+#endif
+#ifdef DRV_STATS
+        // add the STATS.TXT file
+        memcpy( (void*)&buffer[i], (const void*)entry4, ROOT_ENTRY_SIZE );
+#endif
+    }
 }
 
 void RootRecordSet( uint8_t *buffer, uint8_t seg)
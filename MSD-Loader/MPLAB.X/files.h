@@ -17,6 +17,7 @@ limitations under the License.
 
 #include "system.h"
 #include "direct.h"
+#include "stats.h"
 
 #ifndef FILES_H
 #define	FILES_H
@@ -25,6 +26,14 @@ limitations under the License.
 #define ENTRY_FILE_SIZE_OFFSET      28  // offset to entry.file_size field
 #define ENTRY_CLUSTER               26  // offset of entry.cluster
 
+#define README_SECTOR               DRV_DATA_SECTOR   // cluster #2
+#define TARGET_HEX_CLUSTER          3   // first cluster of TARGET.HEX
+#define TARGET_HEX_SECTOR           (README_SECTOR + DRV_SECTORS_PER_CLUSTER)
+#define RESULT_CLUSTER              TARGET_HEX_CLUSTER  // RESULT.TXT (VERIFY drive)
+#define RESULT_SECTOR               TARGET_HEX_SECTOR
+#define STATS_CLUSTER               (DRV_NUM_CLUSTERS + 1)  // last cluster of the volume
+#define STATS_SECTOR                (DRV_DATA_SECTOR + (uint32_t)(STATS_CLUSTER - 2) * DRV_SECTORS_PER_CLUSTER)
+
 #define DATEH(y, m, d)    (((y-1980) << 1) + (m >> 3))  // y:1980..2099, m:1..12
 #define DATEL(y, m, d)    ((m << 5) + d)                // d: 1..31
 #define TIMEH(h, m, s)    ((h << 3) + (m >> 3))         // h:0..23, m:0..59
@@ -42,15 +51,18 @@ void MasterBootRecordGet(uint8_t* buffer, uint8_t seg);
 
 /**
  *
+ * @param drive     drive (LUN) configuration
  * @param buffer
  */
-void VolumeBootRecordGet(uint8_t*buffer, uint8_t seg);
+void VolumeBootRecordGet(const DRIVE_CONFIG* drive, uint8_t*buffer, uint8_t seg);
 
 /**
  *
+ * @param drive     drive (LUN) configuration
+ * @param sector    FAT sector (0..DRV_NUM_FAT_SECTORS-1)
  * @param buffer
  */
-void FATRecordGet(uint8_t* buffer, uint8_t seg);
+void FATRecordGet(const DRIVE_CONFIG* drive, uint16_t sector, uint8_t* buffer, uint8_t seg);
 
 /**
  *
@@ -60,9 +72,10 @@ void FATRecordSet(uint8_t* buffer, uint8_t seg);
 
 /**
  *
+ * @param drive     drive (LUN) configuration
  * @param buffer
  */
-void RootRecordGet(uint8_t* buffer, uint8_t seg);
+void RootRecordGet(const DRIVE_CONFIG* drive, uint8_t* buffer, uint8_t seg);
 
 /**
  *
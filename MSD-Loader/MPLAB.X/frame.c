@@ -0,0 +1,227 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ Framed Programming Protocol
+
+ Binary requests received over the CDC programming channel, one frame per CDC
+ OUT packet, are checked (CRC16, sequence) and executed with the same LVP
+ primitives as the hex parser. The reply is assembled in place in the same
+ buffer, no RAM is needed for the frames.
+ The host keeps several frames in flight (sliding window): after a lost or
+ corrupted frame the following ones are rejected (a single FRAME_NAK carries
+ the expected sequence number) until the host resends from there (go-back-N)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#include <stdbool.h>
+#include "frame.h"
+#include "lvp.h"
+#include "direct.h"         // DIRECT_SessionOpen/Close()
+
+static uint8_t frame_expected;      // next sequence number
+static bool    frame_nak;           // NAK sent, wait for the expected frame
+
+/**
+ * CRC16 CCITT (polynomial 0x1021), one byte at a time
+ */
+uint16_t FRAME_crc( uint16_t crc, uint8_t b)
+{
+    uint8_t i;
+
+    crc ^= (uint16_t)b << 8;
+    for( i = 0; i < 8; i++)
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    return crc;
+}
+
+static uint32_t FrameGet32( volatile uint8_t *p)
+{
+    return p[0] | ((uint16_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void FramePut32( volatile uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+/**
+ * Complete a reply: header and CRC
+ *
+ * @return  frame length
+ */
+static uint8_t FrameReply( volatile uint8_t *frame, uint8_t type, uint8_t length)
+{
+    uint16_t crc = 0xffff;
+    uint8_t  i;
+
+    frame[0] = length;
+    frame[1] = type;
+    length += FRAME_HEADER;
+    for( i = 0; i < length; i++)
+        crc = FRAME_crc( crc, frame[i]);
+    frame[length] = crc;
+    frame[length + 1] = crc >> 8;
+    return length + FRAME_CRC;
+}
+
+/**
+ * Reject a request (the sequence number of the reply is the request's)
+ */
+static uint8_t FrameNak( volatile uint8_t *frame, uint8_t error)
+{
+    frame[FRAME_HEADER] = error;
+    frame[FRAME_HEADER + 1] = frame_expected;
+    return FrameReply( frame, FRAME_NAK, 2);
+}
+
+/**
+ * Reject a corrupted or out of sequence frame, once until the expected
+ * frame is received (the sequence number of the reply is the expected one)
+ */
+static uint8_t FrameDiscard( volatile uint8_t *frame, uint8_t error)
+{
+    if (frame_nak) return 0;
+    frame_nak = true;
+    frame[2] = frame_expected;
+    return FrameNak( frame, error);
+}
+
+/**
+ * CRC16 of a range of the target memory, read back 16 bytes at a time
+ * (the payload area of the frame is used as buffer)
+ */
+static uint16_t FrameVerify( volatile uint8_t *buffer, uint32_t address, uint16_t length)
+{
+    uint16_t crc = 0xffff;
+    uint8_t  n, i;
+
+    while (length > 0) {
+        n = (length < 16) ? length : 16;
+        LVP_read( address, (uint8_t*)buffer, (n + 1) & 0xfe);
+        for( i = 0; i < n; i++)
+            crc = FRAME_crc( crc, buffer[i]);
+        address += n;
+        length -= n;
+    }
+    return crc;
+}
+
+/**
+ * Execute a request frame and replace it with the reply
+ *
+ * @param frame     CDC OUT packet, FRAME_SIZE bytes available for the reply
+ * @param count     packet length
+ * @return          reply length, 0 = no reply
+ */
+uint8_t FRAME_process( volatile uint8_t *frame, uint8_t count)
+{
+    volatile uint8_t *payload = &frame[FRAME_HEADER];
+    uint16_t crc = 0xffff;
+    uint32_t address, verify_length;
+    uint8_t  length, type, i;
+
+    // frame integrity
+    length = frame[0];
+    if ((count < FRAME_HEADER + FRAME_CRC) || (length != count - FRAME_HEADER - FRAME_CRC))
+        return FrameDiscard( frame, FRAME_ERR_CRC);
+    for( i = 0; i < length + FRAME_HEADER; i++)
+        crc = FRAME_crc( crc, frame[i]);
+    if ((frame[i] != (uint8_t)crc) || (frame[i + 1] != (uint8_t)(crc >> 8)))
+        return FrameDiscard( frame, FRAME_ERR_CRC);
+
+    // sequence
+    type = frame[1];
+    if (type == FRAME_INFO)
+        frame_expected = frame[2];  // start of a session
+    else if (frame[2] != frame_expected)
+        return FrameDiscard( frame, FRAME_ERR_SEQUENCE);
+    frame_nak = false;
+    frame_expected++;
+
+    switch( type) {
+        case FRAME_INFO:
+            if (length != 0) return FrameNak( frame, FRAME_ERR_COMMAND);
+            payload[0] = FRAME_VERSION;
+            payload[1] = FRAME_DATA_MAX;
+            payload[2] = FRAME_WINDOW;
+            FramePut32( &payload[3], LVP_flashSize());
+            FramePut32( &payload[7], LVP_eeAddress());
+            length = 11;
+            break;
+
+        case FRAME_ERASE:
+            if (length != 0) return FrameNak( frame, FRAME_ERR_COMMAND);
+            DIRECT_SessionClose();  // a read-back session would prevent the erase
+            LVP_erase();
+            break;
+
+        case FRAME_WRITE:
+            if ((length <= 4) || (length > 4 + FRAME_DATA_MAX))
+                return FrameNak( frame, FRAME_ERR_COMMAND);
+            DIRECT_SessionClose();
+            LVP_packRow( FrameGet32( payload), (uint8_t*)&payload[4], length - 4);
+            length = 0;
+            break;
+
+        case FRAME_READ:
+            if (length != 5) return FrameNak( frame, FRAME_ERR_COMMAND);
+            length = payload[4];
+            if ((length > FRAME_DATA_MAX) || (length & 1))
+                return FrameNak( frame, FRAME_ERR_COMMAND);
+            if (!DIRECT_SessionOpen())
+                return FrameNak( frame, FRAME_ERR_BUSY);
+            LVP_read( FrameGet32( payload), (uint8_t*)payload, length);
+            break;
+
+        case FRAME_END:
+            if (length != 0) return FrameNak( frame, FRAME_ERR_COMMAND);
+            DIRECT_SessionClose();
+            LVP_programLastRow();
+            length = 0;
+            break;
+
+        case FRAME_VERIFY:
+            if (length != 8) return FrameNak( frame, FRAME_ERR_COMMAND);
+            verify_length = FrameGet32( &payload[4]);   // bounded, USBDeviceTasks waits for the read back
+            if ((verify_length == 0) || (verify_length > FRAME_VERIFY_MAX))
+                return FrameNak( frame, FRAME_ERR_COMMAND);
+            if (!DIRECT_SessionOpen())
+                return FrameNak( frame, FRAME_ERR_BUSY);
+            address = FrameGet32( payload);
+            crc = FrameVerify( payload, address, verify_length);
+            payload[0] = crc;
+            payload[1] = crc >> 8;
+            length = 2;
+            break;
+
+        case FRAME_RESET:
+            if (length != 0) return FrameNak( frame, FRAME_ERR_COMMAND);
+            DIRECT_SessionClose();
+            if (LVP_inProgress())
+                LVP_exit();         // abandon a programming in progress
+            ICSP_slaveReset();
+            __delay_ms(10);
+            ICSP_slaveRun();
+            length = 0;
+            break;
+
+        default:
+            return FrameNak( frame, FRAME_ERR_COMMAND);
+    }
+    return FrameReply( frame, type | FRAME_ACK, length);
+}
@@ -0,0 +1,60 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+ *******************************************************************************/
+#include <stdint.h>
+
+#ifndef FRAME_H
+#define	FRAME_H
+
+// Framed programming protocol (CDC programming channel, CDC_PROGRAM_FRAME)
+// Each frame travels in a single CDC packet:
+//      length, type, sequence, payload[length], CRC16 (little endian)
+// the CRC16 (CCITT, 0xFFFF preset) covers the header and the payload
+#define FRAME_HEADER        3
+#define FRAME_CRC           2
+#define FRAME_SIZE          64      // CDC packet
+#define FRAME_PAYLOAD_MAX   (FRAME_SIZE - FRAME_HEADER - FRAME_CRC)
+#define FRAME_DATA_MAX      48      // data bytes per WRITE/READ frame (even)
+#define FRAME_VERIFY_MAX    256     // bytes per VERIFY request, the host splits longer ranges
+#define FRAME_WINDOW        4       // frames the host should keep in flight
+#define FRAME_VERSION       1
+
+// requests, answered with the same type | FRAME_ACK or with FRAME_NAK
+enum frametype {
+    FRAME_INFO = 1,     // -> version, data max, window, flash size(4), EE address(4)
+                        //    also restarts the sequence numbering
+    FRAME_ERASE,        // bulk erase, LVP is left entered for the writes
+    FRAME_WRITE,        // address(4), data: packed in rows and programmed
+    FRAME_READ,         // address(4), count(1) -> data
+    FRAME_END,          // program the last row and exit LVP
+    FRAME_VERIFY,       // address(4), length(4) -> CRC16 of the target memory
+                        //    1 to FRAME_VERIFY_MAX bytes, read within one main loop pass
+    FRAME_RESET,        // reset the target and let it run
+    FRAME_NAK = 0x7f,   // error(1), expected sequence(1)
+    FRAME_ACK = 0x80
+};
+
+enum frameerror {
+    FRAME_ERR_CRC = 1,  // corrupted frame
+    FRAME_ERR_SEQUENCE, // frame out of sequence (after a loss), resend from expected
+    FRAME_ERR_COMMAND,  // unknown request or invalid payload
+    FRAME_ERR_BUSY      // target programming in progress (FRAME_END first) or held in reset
+};
+
+uint16_t FRAME_crc(uint16_t crc, uint8_t b);
+uint8_t FRAME_process(volatile uint8_t *frame, uint8_t count);
+
+#endif	/* FRAME_H */
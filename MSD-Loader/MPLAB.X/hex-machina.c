@@ -1,14 +1,13 @@
 /*
  * File: hex-machina.c
  * Author: Lucio Di Jasio
- * Description: A simple state machine to parse an intel hex file as a stream and program directly to the PIC16F1 flash memory.
+ * Description: Parse an intel hex file as a stream (tools/ihex.c) and program directly to the PIC16F1 flash memory.
  */ 
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
-
-enum hexstate { SOL, BYTE_COUNT, ADDRESS, RECORD_TYPE, DATA, CHKSUM};
+#include "ihex.h"
 
 #define ROW_SIZE    128     // for pic18FxxQ10
 #define INDEX_MASK  (ROW_SIZE-1)<<1
@@ -24,13 +23,6 @@ void initLVP( void){
     lvp = false;
 }
 
-bool isDigit( char * c){
-    if (*c < '0') return false;
-    *c -= '0'; if (*c > 9) *c-=7;
-    if (*c > 0xf)  return false;
-    return true;
-}
-
 void lvpWrite( void){
     // first check for first entry in lvp 
     if (!lvp) {
@@ -104,118 +96,29 @@ void ProgramLastRow( void) {
     puts("ExitLVP");
 }
 
-bool ParseHex(char c)
-{
-    static enum hexstate state = SOL;
-    static uint8_t  bc;
-    static uint8_t  data_count;
-    static uint32_t address;
-    static uint32_t ext_address = 0;
-    static uint8_t  checksum;
-    static uint8_t  record_type;
-    static uint8_t  data_byte, data_index, data[16];
-    // static int line = 0;
-    // putchar(c);
-    switch( state){
-        case SOL:
-            if (c == '\r') break;
-            if (c == '\n') break;
-            if (c != ':') return false; 
-            state = BYTE_COUNT;
-            bc = 0;
-            address = 0;
-            checksum = 0;
-            // printf("Line: %d \n", line++);
-            break;
-        case BYTE_COUNT:
-            if ( isDigit( &c) == false) { state = SOL; return false; }
-            bc++;
-            if (bc == 1) 
-                data_count = c;
-            if (bc == 2 )  {  
-                data_count = (data_count << 4) + c;
-                checksum += data_count;
-                bc = 0; 
-                if (data_count > 16) { state = SOL; return false; }
-                state = ADDRESS;
-            }
-            break;            
-        case ADDRESS:
-            if ( isDigit( &c) == false) { state = SOL; return false;}
-            bc++;
-            if (bc == 1) 
-                address = c;
-            else  {  
-                address = (address << 4) + (uint32_t)c;
-                if (bc == 4) {
-                    checksum += (address>>8) + address;
-                    bc = 0; 
-                    state = RECORD_TYPE;
-                }
-            }
-            break;                        
-        case RECORD_TYPE:
-            if ( isDigit( &c) == false) { state = SOL; return false;}
-            bc++;
-            if (bc == 1) 
-                if (c != 0) { state = SOL; return false; }
-            if (bc == 2)  {  
-                record_type = c;
-                checksum += c;
-                bc = 0; 
-                state = DATA;  // default
-                data_index = 0;
-                memset(data, 0xff, 16);
-                if (record_type == 0) break; // data record
-                if (record_type == 1) { state = CHKSUM; break; }  // EOF record
-                if (record_type == 4) break; // extended address record
-                state = SOL; 
-                return false;
-            }
-            break;            
-        case DATA:
-            if ( isDigit( &c) == false) { state = SOL; return false;}
-            bc++;
-            if (bc == 1) 
-                data[data_index] = (c<<4);
-            if (bc == 2)  {  
-                bc = 0;
-                data[data_index] += c;
-                checksum +=  data[data_index];
-                data_index++;
-                if (data_index == data_count) { 
-                    state = CHKSUM; 
-                }
-            }
-            break;            
-        case CHKSUM:
-            if ( isDigit( &c) == false) { state = SOL; return false;}
-            bc++;
-            if (bc == 1) 
-                checksum += (c<<4);
-            if (bc == 2)  {  
-                bc = 0;
-                checksum += c;
-                if (checksum != 0) { printf("checksum: %02x\n", checksum); state = SOL; return false; }
-                // chksum is good 
-                state = SOL; 
-                if (record_type == 0) ProgramRow( ext_address + address, data, data_count);
-                else if (record_type == 1) ProgramLastRow();
-                else if (record_type == 4) ext_address = ((uint32_t)(data[0]) << 24) + ((uint32_t)(data[1]) << 16);
-                else return false;
-            }
-            break;            
-        default:
-            break;
+// called by the parser (tools/ihex.c) for each record, once checked
+bool ProgramRecord( void *ctx, const struct ihexrecord *r) {
+    uint8_t data[16];
+    uint8_t i, n;
+    if (r->type == 0) {     // data record, in pieces of up to 16 bytes (at most one row boundary each)
+        for( i=0; i < r->count; i += n) {
+            n = (r->count - i > 16) ? 16 : r->count - i;
+            memset(data, 0xff, 16);
+            memcpy(data, r->data + i, n);
+            ProgramRow( r->address + i, data, n);
+        }
     }
-    return true;
+    else if (r->type == 1) ProgramLastRow();
+    return true;            // extended addresses are applied by the parser, start addresses ignored
 }
 
 int main( int argc, char** argv){
-    char c;
+    struct ihexparser parser;
     puts(" Parsing HEX input!");
     initLVP();
-    while ( ParseHex( getchar()));
+    IHEX_init( &parser, ProgramRecord, NULL);
+    if (!IHEX_parseFile( &parser, "-"))
+        printf("line %u: %s\n", parser.error_line, IHEX_errorText( parser.error));
     int i = INDEX_MASK;
     printf("index mask: %02x \n", i);
     i = ROW_MASK;
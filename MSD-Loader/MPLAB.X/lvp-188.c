@@ -21,12 +21,18 @@ limitations under the License.
 *******************************************************************************/
 #include "lvp.h"
 #include "bsp.h"
+#include "stats.h"          // STATS_ENTER(), STATS_LEAVE(), STATS_count()
 #include <string.h>
 #include <stdlib.h>
 
 // device specific parameters (DS40001753B)
 #define ROW_SIZE     32      // width of a flash row in words
 #define CFG_ADDRESS 0x8000   // address of config words area
+#ifdef DRV_FLASH_SIZE
+#define FLASH_SIZE  DRV_FLASH_SIZE   // smaller part of the family, see fileio_config.h
+#else
+#define FLASH_SIZE  0x10000  // program memory size in bytes (PIC16F18877, 32K words)
+#endif
 #define EE_ADDRESS  0xF000   // address of data EE area
 #define CFG_FIRST   0x8007   // address of first config word
 #define DEV_ID      0x8006
@@ -142,18 +148,18 @@ uint16_t ICSP_getData( void)
 
 uint16_t ICSP_read(void)
 {
-    ICSP_sendCmd(CMD_READ_DATA);
-    uint16_t data = ICSP_getData();
-    ICSP_sendCmd(CMD_INC_ADDR);
-    return data;
+    ICSP_sendCmd(CMD_READ_DATA_IA);
+    return ICSP_getData();
 }
 
 void ICSP_bulkErase(void)
 {
+    STATS_ENTER();
     ICSP_sendCmd(CMD_LOAD_ADDR);  // enter config area to erase config words too
     ICSP_sendData(CFG_ADDRESS);
     ICSP_sendCmd(CMD_BULK_ERASE);
     __delay_ms(BULK_TIME);
+    STATS_LEAVE(STAT_BULK_ERASE);
 }
 
 void ICSP_skip(uint16_t count)
@@ -171,6 +177,7 @@ void ICSP_addressLoad(uint24_t address)
 
 void ICSP_rowWrite(uint16_t *buffer, uint8_t count)
 {
+    STATS_ENTER();
     while(count-- > 1){             // load n-1 latches
         ICSP_sendCmd(CMD_LATCH_DATA_IA);
         ICSP_sendData(*buffer++);
@@ -180,6 +187,8 @@ void ICSP_rowWrite(uint16_t *buffer, uint8_t count)
     ICSP_sendCmd(CMD_BEGIN_PROG);
     __delay_ms(WRITE_TIME);
     ICSP_sendCmd(CMD_INC_ADDR);     // increment address only after prog. command!
+    STATS_count(STAT_HEX_ROWS, 1);
+    STATS_LEAVE(STAT_ROW_WRITE);
 }
 
 void ICSP_cfgWrite(uint16_t *buffer, uint8_t count)
@@ -241,11 +250,13 @@ void LVP_commitRow( void) {
     // latch and program a row, skip if blank
     uint8_t i;
     uint16_t chk = 0xffff;
+    STATS_ENTER();
     for( i=0; i< ROW_SIZE; i++) chk &= row[i];  // blank check
     if (chk != 0xffff) {
         LVP_write();
         memset((void*)row, 0xff, sizeof(row));    // fill buffer with blanks
     }
+    STATS_LEAVE(STAT_COMMIT_ROW);
 }
 
 /**
@@ -258,6 +269,7 @@ void LVP_packRow( uint32_t address, uint8_t *data, uint8_t data_count) {
     // copy only the bytes from the current data packet up to the boundary of a row
     uint8_t  index = (address & 0x3e) >> 1;
     uint32_t new_row = (address & 0xfffffffc0) >> 1;
+    STATS_ENTER();
     if (new_row != row_address) {
         LVP_commitRow();
         row_address = new_row;
@@ -286,9 +298,82 @@ void LVP_packRow( uint32_t address, uint8_t *data, uint8_t data_count) {
             }
         }
     }
+    STATS_LEAVE(STAT_PACK_ROW);
 }
 
 void LVP_programLastRow( void) {
     LVP_commitRow();
     LVP_exit();
 }
+
+/**
+ * Bulk erase the target, LVP is left entered for the rows that follow
+ */
+void LVP_erase( void) {
+    if (!LVP_inProgress()) LVP_enter();
+    ICSP_bulkErase();
+}
+
+uint32_t LVP_flashSize( void) {
+    return FLASH_SIZE;
+}
+
+/**
+ * Read back program memory from the target (LVP must be already active)
+ * @param address       starting (byte) address
+ * @param data          buffer
+ * @param data_count    number of bytes (even)
+ */
+void LVP_read( uint32_t address, uint8_t *data, uint8_t data_count) {
+    ICSP_addressLoad( address >> 1);      // word address
+    while (data_count > 1) {
+        uint16_t word = ICSP_read();
+        if (word == 0x3fff) word = 0xffff;  // blank 14-bit word reads as erased
+        *data++ = word;
+        *data++ = word >> 8;
+        data_count -= 2;
+    }
+}
+
+/**
+ * Compare program memory with a buffer (LVP must be already active)
+ * @param address       starting (byte) address
+ * @param data          buffer
+ * @param data_count    number of bytes (even)
+ * @return              true if all (14-bit) words match
+ */
+bool LVP_verify( uint32_t address, uint8_t *data, uint8_t data_count) {
+    ICSP_addressLoad( address >> 1);      // word address
+    while (data_count > 1) {
+        uint16_t word = *data++;
+        word += ((uint16_t)*data++ << 8);
+        if ((ICSP_read() ^ word) & 0x3fff)
+            return false;
+        data_count -= 2;
+    }
+    return true;
+}
+
+uint32_t LVP_eeAddress( void) {
+    return (uint32_t)EE_ADDRESS << 1;   // (byte) address as found in the hex file
+}
+
+/**
+ * Program data EE locations one at a time, without erasing the rest of the
+ * device (LVP must be already active)
+ * @param address       starting (byte) address, one EE byte per word
+ * @param data          buffer
+ * @param data_count    number of bytes (even)
+ */
+void LVP_eeWrite( uint32_t address, uint8_t *data, uint8_t data_count) {
+    ICSP_addressLoad( address >> 1);      // word address
+    while (data_count > 1) {
+        ICSP_sendCmd(CMD_LATCH_DATA);
+        ICSP_sendData(*data);
+        ICSP_sendCmd(CMD_BEGIN_PROG);
+        __delay_ms(CFG_TIME);
+        ICSP_sendCmd(CMD_INC_ADDR);
+        data += 2;
+        data_count -= 2;
+    }
+}
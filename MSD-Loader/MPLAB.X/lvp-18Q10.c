@@ -21,6 +21,7 @@ limitations under the License.
 *******************************************************************************/
 #include "lvp.h"
 #include "bsp.h"
+#include "stats.h"          // STATS_ENTER(), STATS_LEAVE(), STATS_count()
 #include <string.h>
 #include <stdlib.h>
 
@@ -31,6 +32,11 @@ limitations under the License.
 
 #define UID_ADDRESS 0x200000 // address of UID words area
 #define CFG_ADDRESS 0x300000 // address of config words area
+#ifdef DRV_FLASH_SIZE
+#define FLASH_SIZE  DRV_FLASH_SIZE   // smaller part of the family, see fileio_config.h
+#else
+#define FLASH_SIZE  0x20000  // program memory size in bytes (PIC18F47Q10)
+#endif
 #define EE_ADDRESS  0x310000 // address of data EEPROM
 #define REV_ID      0x3FFFFC // silicon revision ID
 #define DEV_ID      0x3FFFFE // product ID
@@ -38,6 +44,7 @@ limitations under the License.
 
 #define WRITE_TIME  50       // mem write time us!
 #define CFG_TIME    50       // cfg write time us!
+#define EE_TIME     11       // data EE write time ms
 #define BULK_TIME   75       // bulk erase time ms
 
 /****************************************************************************/
@@ -150,10 +157,12 @@ uint16_t ICSP_read(void)
 
 void ICSP_bulkErase(void)
 {
+    STATS_ENTER();
     ICSP_sendCmd(CMD_LOAD_ADDR);  // enter config area to erase config words too
     ICSP_sendData(CFG_ADDRESS);
     ICSP_sendCmd(CMD_BULK_ERASE);
     __delay_ms(BULK_TIME);
+    STATS_LEAVE(STAT_BULK_ERASE);
 }
 
 void ICSP_skip(uint16_t count)
@@ -171,12 +180,15 @@ void ICSP_addressLoad(uint24_t address)
 
 void ICSP_rowWrite(uint16_t *buffer, uint8_t count)
 {
+    STATS_ENTER();
     while(count-- > 0){
         ICSP_sendCmd(CMD_PROG_DATA);
         ICSP_sendData(*buffer++);
         __delay_us(WRITE_TIME);         // NOTE: micro-seconds for the 340K process
         ICSP_sendCmd(CMD_INC_ADDR);
     }
+    STATS_count(STAT_HEX_ROWS, 1);
+    STATS_LEAVE(STAT_ROW_WRITE);
 }
 
 void ICSP_cfgWrite(uint16_t *buffer, uint8_t count)
@@ -234,11 +246,13 @@ void LVP_commitRow( void) {
     // latch and program a row, skip if blank
     uint8_t i;
     uint16_t chk = 0xffff;
+    STATS_ENTER();
     for( i=0; i< ROW_SIZE; i++) chk &= row[i];  // blank check
     if (chk != 0xffff) {
         LVP_write();
         memset((void*)row, 0xff, sizeof(row));    // fill buffer with blanks
     }
+    STATS_LEAVE(STAT_COMMIT_ROW);
 }
 
 /**
@@ -251,6 +265,7 @@ void LVP_packRow( uint32_t address, uint8_t *data, uint8_t data_count) {
     // copy only the bytes from the current data packet up to the boundary of a row
     uint8_t  index = (address & INDEX_MASK) >> 1;
     uint32_t new_row = (address & ROW_MASK) >> 1;
+    STATS_ENTER();
     if (new_row != row_address) {
         LVP_commitRow();
         row_address = new_row;
@@ -279,6 +294,7 @@ void LVP_packRow( uint32_t address, uint8_t *data, uint8_t data_count) {
             }
         }
     }
+    STATS_LEAVE(STAT_PACK_ROW);
 }
 
 void LVP_programLastRow( void) {
@@ -286,3 +302,70 @@ void LVP_programLastRow( void) {
     LVP_exit();
 }
 
+/**
+ * Bulk erase the target, LVP is left entered for the rows that follow
+ */
+void LVP_erase( void) {
+    if (!LVP_inProgress()) LVP_enter();
+    ICSP_bulkErase();
+}
+
+uint32_t LVP_flashSize( void) {
+    return FLASH_SIZE;
+}
+
+/**
+ * Read back program memory from the target (LVP must be already active)
+ * @param address       starting (byte) address
+ * @param data          buffer
+ * @param data_count    number of bytes (even)
+ */
+void LVP_read( uint32_t address, uint8_t *data, uint8_t data_count) {
+    ICSP_addressLoad( address);
+    while (data_count > 1) {
+        uint16_t word = ICSP_read();
+        *data++ = word;
+        *data++ = word >> 8;
+        data_count -= 2;
+    }
+}
+
+/**
+ * Compare program memory with a buffer (LVP must be already active)
+ * @param address       starting (byte) address
+ * @param data          buffer
+ * @param data_count    number of bytes (even)
+ * @return              true if all words match
+ */
+bool LVP_verify( uint32_t address, uint8_t *data, uint8_t data_count) {
+    ICSP_addressLoad( address);
+    while (data_count > 1) {
+        uint16_t word = *data++;
+        word += ((uint16_t)*data++ << 8);
+        if (ICSP_read() != word)
+            return false;
+        data_count -= 2;
+    }
+    return true;
+}
+
+uint32_t LVP_eeAddress( void) {
+    return EE_ADDRESS;
+}
+
+/**
+ * Program data EE locations one byte at a time, without erasing the rest of
+ * the device (LVP must be already active)
+ * @param address       starting (byte) address
+ * @param data          buffer
+ * @param data_count    number of bytes
+ */
+void LVP_eeWrite( uint32_t address, uint8_t *data, uint8_t data_count) {
+    ICSP_addressLoad( address);
+    while (data_count-- > 0) {
+        ICSP_sendCmd(CMD_PROG_DATA);
+        ICSP_sendData(*data++);
+        __delay_ms(EE_TIME);
+        ICSP_sendCmd(CMD_INC_ADDR);
+    }
+}
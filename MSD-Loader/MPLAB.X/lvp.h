@@ -29,6 +29,12 @@ void LVP_exit(void);
 bool LVP_inProgress(void);
 void LVP_packRow(uint32_t address, uint8_t *data, uint8_t data_count);
 void LVP_programLastRow(void);
+void LVP_erase(void);
+uint32_t LVP_flashSize(void);
+void LVP_read(uint32_t address, uint8_t *data, uint8_t data_count);
+bool LVP_verify(uint32_t address, uint8_t *data, uint8_t data_count);
+uint32_t LVP_eeAddress(void);
+void LVP_eeWrite(uint32_t address, uint8_t *data, uint8_t data_count);
 
 #endif	/* LVP_H */
 
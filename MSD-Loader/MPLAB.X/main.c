@@ -27,6 +27,7 @@ limitations under the License.
 #include "app_device_cdc.h"
 #include "direct.h"
 #include "lvp.h"
+#include "stats.h"
 
 // timer counting down on USB SOF (1ms)
 uint16_t Xtimer = 0;
@@ -36,14 +37,17 @@ void main(void)
     bool wasPressed = false;    // no button pressed
     bool old_TxRdy = true;      // no ongoing TX
     bool old_RxRdy = false;     // char waiting in RX
+    uint8_t i;                  // LUN index
 
     SYSTEM_init();
 
     while(1)
     {
+        STATS_task(STAT_TASK_USB);  // a new pass (DRV_PROFILE)
         #if defined(USB_POLLING)
             USBDeviceTasks();
         #endif
+        STATS_task(STAT_TASK_MAIN);
 
         /* If the USB device isn't configured yet, we can't really do anything
          * else since we don't have a host to talk to.  So jump back to the
@@ -79,13 +83,15 @@ void main(void)
         // Normal operating mode (device connected)
         // implement RESET button
         if ( BUTTON_isPressed()) {
-            LUNSoftDetach(0);           // mark the media as temporarily unavailable
+            for( i = 0; i <= MAX_LUN; i++)
+                LUNSoftDetach(i);       // mark the media as temporarily unavailable
             ICSP_slaveReset();
             LED_set(RED);
             wasPressed = true;
         }
         else { // button released
-            LUNSoftAttach(0);           // mark the media as available
+            for( i = 0; i <= MAX_LUN; i++)
+                LUNSoftAttach(i);       // mark the media as available
             if (wasPressed){
                 ICSP_slaveRun();
                 wasPressed = false;
@@ -116,7 +122,11 @@ void main(void)
        }
 
         //Application specific tasks
+        STATS_task(STAT_TASK_MSD);
         APP_DeviceMSDTasks();
+        STATS_task(STAT_TASK_DIRECT);
+        DIRECT_Tasks();
+        STATS_task(STAT_TASK_CDC);
         APP_DeviceCDCEmulatorTasks();
 
     }//end while
@@ -178,6 +188,8 @@ bool USER_USB_CALLBACK_EVENT_HANDLER(USB_EVENT event, void *pdata, uint16_t size
              * needs to check to see if the request was for it. */
             USBCheckMSDRequest();
             USBCheckCDCRequest();
+            APP_DeviceCDCVendorRequest();
+            STATS_vendorRequest();
 
             break;
 
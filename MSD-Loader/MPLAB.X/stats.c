@@ -0,0 +1,421 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ Mount Time, Hot Path and Main Loop Statistics (STATS.TXT)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+
+#include "system.h"         // MAJOR, MINOR, YEAR, MONTH, DAY
+#include "stats.h"
+#include "usb.h"            // USBGet1msTickCount(), USBEP0SendRAMPtr()
+#include "bsp.h"            // UART_rxOverruns, UART_rxDrops
+#include "lvp.h"            // LVP_flashSize(), LVP_eeAddress()
+
+#ifdef DRV_STATS
+
+#if (STATS_SIZE > DRV_SECTORS_PER_CLUSTER * FILEIO_CONFIG_MEDIA_SECTOR_SIZE)
+#error "STATS.TXT must fit in a single cluster"
+#endif
+
+#define STAT_NONE       0xffffffff      // phase not reached
+
+extern volatile CTRL_TRF_SETUP SetupPkt;    // usb_device.c
+
+static uint16_t stats[ STAT_PHASES];    // time stamps (ms), 0xffff = not reached
+static uint32_t stats_count[ STAT_COUNTERS - STAT_HEX_BYTES];
+static uint8_t  last_error;             // enum staterror
+static uint32_t last_address;
+
+#if defined(DRV_TELEMETRY) && defined(DRV_PROFILE)
+static uint8_t  report[ STATS_STAGES_SIZE]; // vendor request answer
+#elif defined(DRV_TELEMETRY)
+static uint8_t  report[ STATS_COUNTERS_SIZE];
+#endif
+
+static const char stats_name[ STAT_COUNTERS][16] = {
+    "bus resets      ",
+    "SET_ADDRESS     ",
+    "SET_CONFIG      ",
+    "INQUIRY         ",
+    "READ_CAPACITY   ",
+    "TEST_UNIT_READY ",
+    "READ(10) LBA 0  ",
+    "UART overruns   ",
+    "UART drops      ",
+    "hex bytes       ",
+    "rows written    ",
+    "hex errors      ",
+    "checksum errors "
+};
+
+#ifdef DRV_PROFILE
+static uint16_t stage_count[ STAT_STAGES];
+static uint32_t stage_total[ STAT_STAGES];  // Timer1 ticks
+static uint32_t stage_max[ STAT_STAGES];
+
+// stage lines: stage name (10) + column name (6)
+static const char stage_name[ STAT_STAGES][10] = {
+    "MSDWrite  ",
+    "ParseHex  ",
+    "packRow   ",
+    "commitRow ",
+    "rowWrite  ",
+    "bulkErase "
+};
+
+static const char stage_column[3][6] = { "count ", "ms    ", "max us" };
+
+static uint16_t loop_histogram[ STAT_BUCKETS];
+static uint32_t loop_longest;           // Timer1 ticks, longest pass
+static uint32_t loop_task_ticks;        // longest task in that pass
+static uint8_t  loop_task;
+static uint32_t pass_start, task_start; // Timer1 time
+static uint32_t pass_task_ticks;        // longest task of the current pass
+static uint8_t  pass_task, task_now;
+
+static const char loop_name[ STAT_BUCKETS][16] = {
+    "loop <    43 us ",
+    "loop <    85 us ",
+    "loop <   171 us ",
+    "loop <   341 us ",
+    "loop <   683 us ",
+    "loop <  1365 us ",
+    "loop <  2731 us ",
+    "loop <  5461 us ",
+    "loop < 10923 us ",
+    "loop < 21845 us ",
+    "loop < 43691 us ",
+    "loop >=43691 us "
+};
+
+// longest pass lines: "longest pass us " and "- task " + task name + " us"
+static const char task_name[ STAT_TASKS][6] = {
+    "USB   ",
+    "main  ",
+    "MSD   ",
+    "DIRECT",
+    "CDC   "
+};
+
+static uint32_t Micros( uint32_t ticks)
+{
+    return ticks / (UART_TIME_HZ / 1000) * 1000
+           + ticks % (UART_TIME_HZ / 1000) * 1000 / (UART_TIME_HZ / 1000);
+}
+
+/**
+ * Account for a stage, see STATS_ENTER() and STATS_LEAVE()
+ *
+ * @param stage     STAT_MSD_WRITE..STAT_BULK_ERASE
+ * @param start     Timer1 time the stage was entered
+ */
+void STATS_stage( uint8_t stage, uint32_t start)
+{
+    uint32_t ticks = UART_timeGet() - start;
+
+    if (stage_count[stage] < 0xffff)
+        stage_count[stage]++;
+    if (stage_total[stage] + ticks >= stage_total[stage])
+        stage_total[stage] += ticks;
+    else
+        stage_total[stage] = 0xffffffff;  // saturated
+    if (ticks > stage_max[stage])
+        stage_max[stage] = ticks;
+}
+
+/**
+ * Mark the start of a main loop task, STAT_TASK_USB also ends the pass:
+ * its time goes in the histogram and the longest pass is kept with its
+ * longest task, the one to blame for the USB and UART service gap
+ * Note: the passes with Timer1 stopped or restarted are not counted
+ *
+ * @param task      STAT_TASK_USB..STAT_TASK_CDC
+ */
+void STATS_task( uint8_t task)
+{
+    uint32_t now = UART_timeGet();
+    uint32_t ticks = now - task_start;
+    uint8_t  b;
+
+    if ((now > task_start) && (ticks > pass_task_ticks)) {
+        pass_task_ticks = ticks;
+        pass_task = task_now;
+    }
+    task_start = now;
+    task_now = task;
+    if (task != STAT_TASK_USB)
+        return;
+
+    if (now > pass_start) {
+        ticks = now - pass_start;
+        for( b = 0; (b < STAT_BUCKETS - 1) && ((ticks >> 6) >> b); b++)
+            ;
+        if (++loop_histogram[b] == 0xffff)
+            for( b = 0; b < STAT_BUCKETS; b++)
+                loop_histogram[b] >>= 1;
+        if (ticks > loop_longest) {
+            loop_longest = ticks;
+            loop_task_ticks = pass_task_ticks;
+            loop_task = pass_task;
+        }
+    }
+    pass_start = now;
+    pass_task_ticks = 0;
+}
+
+/**
+ * @param line      stage or loop line, from STAT_COUNTERS
+ * @return          count, total (ms) or longest (us) time
+ */
+static uint32_t StageValue( uint8_t line)
+{
+    uint8_t stage = (line - STAT_COUNTERS) / 3;
+
+    if (stage >= STAT_STAGES) {
+        line -= STAT_COUNTERS + 3 * STAT_STAGES;
+        if (line < STAT_BUCKETS)
+            return loop_histogram[line];
+        if (loop_longest == 0)
+            return STAT_NONE;
+        return Micros((line == STAT_BUCKETS) ? loop_longest : loop_task_ticks);
+    }
+    switch ((line - STAT_COUNTERS) % 3) {
+        case 0:  return stage_count[stage];
+        case 1:  return stage_total[stage] / (UART_TIME_HZ / 1000);
+        default: return Micros(stage_max[stage]);
+    }
+}
+
+static char StatName( uint8_t line, uint8_t col)
+{
+    if (line < STAT_COUNTERS)
+        return stats_name[line][col];
+    if (line < STAT_COUNTERS + 3 * STAT_STAGES) {
+        if (col < 10)
+            return stage_name[(line - STAT_COUNTERS) / 3][col];
+        return stage_column[(line - STAT_COUNTERS) % 3][col - 10];
+    }
+    line -= STAT_COUNTERS + 3 * STAT_STAGES;
+    if (line < STAT_BUCKETS)
+        return loop_name[line][col];
+    if (line == STAT_BUCKETS)
+        return "longest pass us "[col];
+    if ((col < 7) || (col >= 13))
+        return "- task       us "[col];
+    return task_name[loop_task][col - 7];
+}
+#else
+#define StatName( line, col)    stats_name[line][col]
+#endif
+
+/**
+ * Record the first occurrence of a phase since the last bus reset
+ * Note: the USB stack restarts its 1ms tick count at every bus reset
+ *
+ * @param phase     STAT_RESET restarts all the time stamps
+ */
+void STATS_mark( uint8_t phase)
+{
+    uint8_t i;
+
+    if (phase == STAT_RESET) {
+        for( i = STAT_RESET + 1; i < STAT_PHASES; i++)
+            stats[i] = 0xffff;
+        stats[STAT_RESET]++;
+    }
+    else if (stats[phase] == 0xffff)
+        stats[phase] = USBGet1msTickCount();
+}
+
+/**
+ * Add to a counter, saturating
+ *
+ * @param counter   STAT_HEX_BYTES..STAT_HEX_CHECKSUMS
+ */
+void STATS_count( uint8_t counter, uint16_t n)
+{
+    uint32_t *count = &stats_count[counter - STAT_HEX_BYTES];
+
+    if (*count + n >= *count)
+        *count += n;
+    else
+        *count = 0xffffffff;
+}
+
+/**
+ * Count a rejected record (VERIFY mismatches are not counted) and keep it
+ * as the last error
+ *
+ * @param error     enum staterror
+ * @param address   target address of the record
+ */
+void STATS_error( uint8_t error, uint32_t address)
+{
+    if (error == STAT_ERR_CHECKSUM)
+        STATS_count( STAT_HEX_CHECKSUMS, 1);
+    else if (error != STAT_ERR_VERIFY)
+        STATS_count( STAT_HEX_ERRORS, 1);
+    last_error = error;
+    last_address = address;
+}
+
+/**
+ * Read a line value, the counters are updated by the UART RX interrupt
+ * so read them until two consecutive reads agree
+ */
+static uint32_t StatValue( uint8_t line)
+{
+    volatile uint16_t *counter;
+    uint16_t value;
+
+    if (line < STAT_PHASES)
+        return (stats[line] == 0xffff) ? STAT_NONE : stats[line];
+#ifdef DRV_PROFILE
+    if (line >= STAT_COUNTERS)
+        return StageValue(line);
+#endif
+    if (line >= STAT_HEX_BYTES)
+        return stats_count[line - STAT_HEX_BYTES];
+    counter = (line == STAT_UART_OVERRUNS) ? &UART_rxOverruns : &UART_rxDrops;
+    do {
+        value = *counter;
+    } while (value != *counter);
+    return value;
+}
+
+/**
+ * Fill a 64-byte segment of STATS.TXT, one "name value\r\n" line per
+ * phase/counter/stage column, the values above 999999 are capped
+ *
+ * @param offset    position in the file
+ * @param buffer    segment buffer (cleared)
+ */
+void STATS_get( uint16_t offset, uint8_t *buffer)
+{
+    uint32_t value;
+    uint8_t  line, col, i, c;
+
+    for( i = 0; (i < MSD_IN_EP_SIZE) && (offset < STATS_SIZE); i++, offset++) {
+        line = offset / STATS_LINE;
+        col = offset % STATS_LINE;
+        value = StatValue(line);
+        if ((value != STAT_NONE) && (value > 999999))
+            value = 999999;
+        if (col < 16)                   c = StatName(line, col);
+        else if (col == STATS_LINE - 2) c = '\r';
+        else if (col == STATS_LINE - 1) c = '\n';
+        else if (value == STAT_NONE)    c = (col == STATS_LINE - 3) ? '-' : ' ';
+        else {  // right aligned decimal
+            for( c = col; c < STATS_LINE - 3; c++)
+                value /= 10;
+            c = ((value == 0) && (col < STATS_LINE - 3)) ? ' ' : '0' + (value % 10);
+        }
+        buffer[i] = c;
+    }
+}
+
+#ifdef DRV_TELEMETRY
+// append a little endian value to a vendor request answer
+static uint8_t *Put( uint8_t *p, uint32_t value, uint8_t size)
+{
+    while (size-- > 0) {
+        *p++ = (uint8_t)value;
+        value >>= 8;
+    }
+    return p;
+}
+
+/**
+ * EVENT_EP0_REQUEST: the telemetry vendor requests (see stats.h), the
+ * others are left to the class handlers
+ */
+void STATS_vendorRequest( void)
+{
+    uint8_t *p = report;
+    uint8_t i;
+
+    if (SetupPkt.RequestType != USB_SETUP_TYPE_VENDOR_BITFIELD) return;
+
+    switch (SetupPkt.bRequest) {
+        case STATS_VENDOR_GET_INFO:
+            p = Put( p, MAJOR, 1);
+            p = Put( p, MINOR, 1);
+            p = Put( p, YEAR, 2);
+            p = Put( p, MONTH, 1);
+            p = Put( p, DAY, 1);
+            i = 0;
+#ifdef DRV_PROFILE
+            i |= STATS_FEATURE_PROFILE;
+#endif
+#ifdef DRV_TARGET_HEX
+            i |= STATS_FEATURE_TARGET_HEX;
+#endif
+#ifdef UART_SHARED
+            i |= STATS_FEATURE_UART_SHARED;
+#endif
+#ifdef USB_CDC_SUPPORT_HARDWARE_FLOW_CONTROL
+            i |= STATS_FEATURE_FLOW_CONTROL;
+#endif
+            p = Put( p, i, 1);
+            p = Put( p, LVP_flashSize(), 4);
+            p = Put( p, LVP_eeAddress(), 4);
+            p = Put( p, UART_TIME_HZ, 4);
+            p = Put( p, STAT_STAGES, 1);
+            p = Put( p, STAT_BUCKETS, 1);
+            p = Put( p, STAT_TASKS, 1);
+            break;
+
+        case STATS_VENDOR_GET_COUNTERS:
+            for( i = STAT_HEX_BYTES; i <= STAT_HEX_CHECKSUMS; i++)
+                p = Put( p, StatValue(i), 4);
+            p = Put( p, StatValue(STAT_UART_OVERRUNS), 2);
+            p = Put( p, StatValue(STAT_UART_DROPS), 2);
+            p = Put( p, stats[STAT_RESET], 2);
+            p = Put( p, last_error, 1);
+            p = Put( p, last_address, 4);
+            break;
+
+#ifdef DRV_PROFILE
+        case STATS_VENDOR_GET_STAGES:
+            for( i = 0; i < STAT_STAGES; i++) {
+                p = Put( p, stage_count[i], 2);
+                p = Put( p, stage_total[i], 4);
+                p = Put( p, stage_max[i], 4);
+            }
+            break;
+
+        case STATS_VENDOR_GET_LOOP:
+            for( i = 0; i < STAT_BUCKETS; i++)
+                p = Put( p, loop_histogram[i], 2);
+            p = Put( p, loop_longest, 4);
+            p = Put( p, loop_task_ticks, 4);
+            p = Put( p, loop_task, 1);
+            if (SetupPkt.wValue == 1) {
+                for( i = 0; i < STAT_BUCKETS; i++)
+                    loop_histogram[i] = 0;
+                loop_longest = loop_task_ticks = 0;
+                loop_task = STAT_TASK_USB;
+            }
+            break;
+#endif
+
+        default:
+            return;
+    }
+    USBEP0SendRAMPtr( report, p - report, USB_EP0_INCLUDE_ZERO);
+}
+#endif
+
+#endif
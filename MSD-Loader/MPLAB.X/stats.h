@@ -0,0 +1,175 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+ *******************************************************************************/
+#include <stdint.h>
+#include "fileio_config.h"
+
+#ifndef STATS_H
+#define	STATS_H
+
+// mount phases, time stamped (ms) from the last USB bus reset
+enum statphase {
+    STAT_RESET,                 // counts the bus resets instead
+    STAT_SET_ADDRESS,
+    STAT_SET_CONFIGURATION,
+    STAT_INQUIRY,
+    STAT_READ_CAPACITY,
+    STAT_TEST_UNIT_READY,
+    STAT_READ_LBA0,             // first READ(10) of the host LBA 0 (VBR)
+    STAT_PHASES
+};
+
+// diagnostic counters, reported after the mount phases
+enum statcount {
+    STAT_UART_OVERRUNS = STAT_PHASES,   // UART_rxOverruns
+    STAT_UART_DROPS,                    // UART_rxDrops
+    STAT_HEX_BYTES,                     // hex file bytes parsed (MSD and CDC)
+    STAT_HEX_ROWS,                      // rows written, ICSP_rowWrite()
+    STAT_HEX_ERRORS,                    // records rejected, checksum apart
+    STAT_HEX_CHECKSUMS,                 // records with a checksum error
+    STAT_COUNTERS
+};
+
+// last error, see STATS_error()
+enum staterror {
+    STAT_ERR_NONE,
+    STAT_ERR_SYNTAX,            // not a ':' or a hex digit
+    STAT_ERR_LENGTH,            // more than 16 data bytes
+    STAT_ERR_TYPE,              // record type not supported
+    STAT_ERR_CHECKSUM,
+    STAT_ERR_VERIFY             // VERIFY drive mismatch
+};
+
+// hot path stages (DRV_PROFILE), reported after the counters: count, total
+// (ms) and longest (us) time, nested stages included, since power on
+enum statstage {
+    STAT_MSD_WRITE,             // MSDWriteHandler(), one OUT packet
+    STAT_PARSE_HEX,             // ParseHex(), one segment or CDC packet
+    STAT_PACK_ROW,              // LVP_packRow()
+    STAT_COMMIT_ROW,            // LVP_commitRow()
+    STAT_ROW_WRITE,             // ICSP_rowWrite()
+    STAT_BULK_ERASE,            // ICSP_bulkErase()
+    STAT_STAGES
+};
+
+// main loop tasks (DRV_PROFILE), see STATS_task()
+enum stattask {
+    STAT_TASK_USB,              // USBDeviceTasks(), starts a loop pass
+    STAT_TASK_MAIN,             // button, nMCLR and LED handling
+    STAT_TASK_MSD,              // APP_DeviceMSDTasks()
+    STAT_TASK_DIRECT,           // DIRECT_Tasks()
+    STAT_TASK_CDC,              // APP_DeviceCDCEmulatorTasks()
+    STAT_TASKS
+};
+
+// loop pass histogram: bucket n counts the passes shorter than 64 << n
+// Timer1 ticks (42.7us << n), the last one the longer passes; all the
+// buckets are halved when one reaches 0xffff
+#define STAT_BUCKETS    12
+
+// followed by the longest pass and, in that pass, the longest task
+#define STAT_LOOP_LINES (STAT_BUCKETS + 2)
+
+#if defined(DRV_STATS) && defined(DRV_PROFILE)
+#define STAT_LINES      (STAT_COUNTERS + 3 * STAT_STAGES + STAT_LOOP_LINES)
+#else
+#define STAT_LINES      STAT_COUNTERS
+#endif
+
+#define STATS_LINE      24u     // name (16) + value (6) + "\r\n"
+#define STATS_SIZE      (STAT_LINES * STATS_LINE)   // STATS.TXT size
+
+#ifdef DRV_STATS
+void STATS_mark(uint8_t phase);
+void STATS_get(uint16_t offset, uint8_t *buffer);
+void STATS_count(uint8_t counter, uint16_t n);
+void STATS_error(uint8_t error, uint32_t address);
+#else
+#define STATS_mark(phase)
+#define STATS_count(counter, n)
+#define STATS_error(error, address)
+#endif
+
+#if defined(DRV_STATS) && defined(DRV_TELEMETRY)
+void STATS_vendorRequest(void);
+#else
+#define STATS_vendorRequest()
+#endif
+
+/*
+ * Telemetry (DRV_TELEMETRY), vendor requests (device to host, wValue = 0
+ * unless noted) answered on EP0 from any state of the MSD and CDC
+ * interfaces, little endian, the times in Timer1 ticks (UART_TIME_HZ):
+ *
+ * STATS_VENDOR_GET_INFO, firmware build and configuration
+ *   uint8_t    MAJOR, MINOR
+ *   uint16_t   YEAR
+ *   uint8_t    MONTH, DAY
+ *   uint8_t    features (STATS_FEATURE_..)
+ *   uint32_t   target flash size (bytes), LVP_flashSize()
+ *   uint32_t   target data EE address in the hex file (0 = none)
+ *   uint32_t   UART_TIME_HZ
+ *   uint8_t    STAT_STAGES, STAT_BUCKETS, STAT_TASKS
+ *
+ * STATS_VENDOR_GET_COUNTERS, counters since power on
+ *   uint32_t   hex bytes, rows written, hex errors, checksum errors
+ *   uint16_t   UART overruns, UART drops, bus resets
+ *   uint8_t    last error (enum staterror)
+ *   uint32_t   its address (extended linear address included)
+ *
+ * STATS_VENDOR_GET_STAGES (DRV_PROFILE), for each enum statstage
+ *   uint16_t   count
+ *   uint32_t   total, longest
+ *
+ * STATS_VENDOR_GET_LOOP (DRV_PROFILE), wValue = 1 to clear once read
+ *   uint16_t   histogram[STAT_BUCKETS]
+ *   uint32_t   longest pass
+ *   uint32_t   longest task in that pass
+ *   uint8_t    that task (enum stattask)
+ */
+#define STATS_VENDOR_GET_LOOP       0x41
+#define STATS_VENDOR_GET_INFO       0x42
+#define STATS_VENDOR_GET_COUNTERS   0x43
+#define STATS_VENDOR_GET_STAGES     0x44
+
+#define STATS_INFO_SIZE         22
+#define STATS_COUNTERS_SIZE     27
+#define STATS_STAGES_SIZE       (10 * STAT_STAGES)
+#define STATS_LOOP_SIZE         (2 * STAT_BUCKETS + 4 + 4 + 1)
+
+#define STATS_FEATURE_PROFILE       0x01    // DRV_PROFILE
+#define STATS_FEATURE_TARGET_HEX    0x02    // DRV_TARGET_HEX
+#define STATS_FEATURE_UART_SHARED   0x04    // UART_SHARED
+#define STATS_FEATURE_FLOW_CONTROL  0x08    // USB_CDC_SUPPORT_HARDWARE_FLOW_CONTROL
+
+/*
+ * Stage timing, on Timer1 (UART_timeGet(), kept running): STATS_ENTER()
+ * is placed after the local declarations of the stage, STATS_LEAVE() on
+ * its way out. Both compile out without DRV_PROFILE.
+ */
+#if defined(DRV_STATS) && defined(DRV_PROFILE)
+#include "bsp.h"                // UART_timeGet()
+#define STATS_ENTER()           uint32_t stats_start = UART_timeGet()
+#define STATS_LEAVE(stage)      STATS_stage(stage, stats_start)
+void STATS_stage(uint8_t stage, uint32_t start);
+void STATS_task(uint8_t task);
+#else
+#define STATS_ENTER()
+#define STATS_LEAVE(stage)
+#define STATS_task(task)
+#endif
+
+#endif	/* STATS_H */
@@ -28,8 +28,12 @@
 #define MSD_CBW_ADDR_TAG                    @0x0A0
 #define MSD_CSW_ADDR_TAG                    @0x120
 #define MSD_BUFFER_ADDRESS_TAG              @0x1A0
+#define MSD_BUFFER2_ADDRESS_TAG             @0x130     // 2nd IN ping-pong buffer
 #define CDC_OUT_DATA_BUFFER_ADDRESS_TAG     @0x220
 #define CDC_IN_DATA_BUFFER_ADDRESS_TAG      @0x2A0
+#define CDC_NOTICE_ADDRESS_TAG              @0x0C0     // bank1 after the CBW, SERIAL_STATE notification
+#define UART_RX_BUFFER_ADDRESS_TAG          @0x3A0     // bank7, UART RX ring
+#define UART_TX_BUFFER_ADDRESS_TAG          @0x420     // bank8, UART TX ring
 
 
 #endif //FIXED_MEMORY_ADDRESS
\ No newline at end of file
@@ -77,4 +77,10 @@ void interrupt SYS_InterruptHigh(void)
     #if defined(USB_INTERRUPT)
         USBDeviceTasks();
     #endif
+    if (PIE1bits.RCIE && PIR1bits.RCIF)
+        UART_rxISR();
+    if (PIE1bits.TXIE && PIR1bits.TXIF)
+        UART_txISR();
+    if (PIE1bits.TMR1IE && PIR1bits.TMR1IF)
+        UART_timeISR();
 }
@@ -162,9 +162,12 @@ limitations under the License.
 #define MSD_INTF_ID             0x00
 #define MSD_IN_EP_SIZE          64u
 #define MSD_OUT_EP_SIZE         64u
+#ifndef MAX_LUN                      //can be overridden per configuration (define-macros)
 #define MAX_LUN                 0u   //Includes 0 (ex: 0 = 1 LUN, 1 = 2 LUN, etc.)
+#endif                               //LUN 0 = PROGRAM, 1 = VERIFY, 2 = EEPROM drive (app_device_msd.c)
 #define MSD_DATA_IN_EP          1u
 #define MSD_DATA_OUT_EP         1u
+#define MSD_MAX_TRANSFER_LENGTH 128u //Sectors per READ/WRITE(10), reported in the Block Limits VPD page (0 = no limit)
 /* CDC */
 #define CDC_COMM_INTF_ID        0x01
 #define CDC_COMM_EP              2
@@ -176,7 +179,24 @@ limitations under the License.
 #define CDC_DATA_IN_EP_SIZE     64u
 
 #define USB_CDC_SET_LINE_CODING_HANDLER APP_SetLineCodingHandler
-//#define USB_CDC_SUPPORT_HARDWARE_FLOW_CONTROL
+#define USB_CDC_STALL_UNSUPPORTED_BAUD  //STALL SET_LINE_CODING for a rate the UART can't generate (else ignore it)
+#define CDC_LATENCY_TIMER_DEFAULT 4u    //ms to aggregate UART data before sending a short IN packet (0 = no wait)
+#define CDC_PROGRAM_CHANNEL             //vendor request CDC_VENDOR_SET_PROGRAM selects the programming channels (comment out to remove)
+//#define USB_CDC_SUPPORT_HARDWARE_FLOW_CONTROL  //RTS/CTS on the pins defined in pinout.h
+#define USB_CDC_RTS_ACTIVE_LEVEL    0   //RTS/CTS are active low
+#define USB_CDC_CTS_ACTIVE_LEVEL    0
+#define CDC_RTS_HIGH_WATERMARK      48u //UART RX ring level deasserting RTS (leaves 15 bytes for the target to stop)
+#define CDC_RTS_LOW_WATERMARK       16u //UART RX ring level asserting RTS again
+#define USB_CDC_SUPPORT_DSR_REPORTING   //SERIAL_STATE notifications, DSR reports the bridge state:
+#define USB_CDC_DSR_ACTIVE_LEVEL    1   //deasserted while the UART is suspended (LVP on shared pins)
+#define UART_DTS                    RCSTAbits.SPEN
+#define mInitDTSPin()
+//#define CDC_RESET_LINE_STATE    0x01 //SET_CONTROL_LINE_STATE line driving the target reset: 0x01 DTR, 0x02 RTS
+#define CDC_RESET_ACTIVE_LEVEL      1   //line state resetting the target (1 = asserted, Arduino style)
+#define CDC_RESET_PULSE_MS          10u //reset pulse width in ms (0 = the target is held in reset while the line is active)
+#if defined(CDC_RESET_LINE_STATE)
+#define USB_CDC_SET_CONTROL_LINE_STATE_HANDLER APP_SetControlLineStateHandler
+#endif
 
 //#define USB_CDC_SUPPORT_ABSTRACT_CONTROL_MANAGEMENT_CAPABILITIES_D2 //Send_Break command
 #define USB_CDC_SUPPORT_ABSTRACT_CONTROL_MANAGEMENT_CAPABILITIES_D1 //Set_Line_Coding, Set_Control_Line_State, Get_Line_Coding, and Serial_State commands
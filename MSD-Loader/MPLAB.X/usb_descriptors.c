@@ -61,7 +61,7 @@ const uint8_t configDescriptor1[]={
     98, 0,                  // Total length of data for this cfg
     3,                      // Number of interfaces in this cfg
     1,                      // Index value of this configuration
-    2,                      // Configuration string index
+    0,                      // Configuration string index (none, saves a string request)
     _DEFAULT | _SELF,       // Attributes, see usb_device.h
     50,                     // Max power consumption (2X mA)
 
@@ -197,7 +197,7 @@ sizeof(sd001),USB_DESCRIPTOR_STRING,
 }};
 
 //Product string descriptor
-const struct{uint8_t bLength;uint8_t bDscType;uint16_t string[28];}sd002={
+const struct{uint8_t bLength;uint8_t bDscType;uint16_t string[26];}sd002={
 sizeof(sd002),USB_DESCRIPTOR_STRING,
 {'M','i','c','r','o','c','h','i','p',' ','C','o','m','p','o','s','i','t','e',' ','D','e','v','i','c','e'
 }};
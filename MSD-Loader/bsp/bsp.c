@@ -20,6 +20,44 @@ limitations under the License.
 #include <bsp.h>
 #include <xc.h>
 #include "pinout.h"
+#include "fixed_address_memory.h"
+#include "usb_config.h"             // hardware flow control options
+#include "fileio_config.h"          // DRV_STATS, DRV_PROFILE
+
+// Timer1 also times the hot path stages (stats.c): it keeps running, its
+// overflows counted, with the timestamps off
+#if defined(DRV_STATS) && defined(DRV_PROFILE)
+#define UART_TIME_FREE  true
+#else
+#define UART_TIME_FREE  false
+#endif
+
+#if defined(USB_CDC_SUPPORT_HARDWARE_FLOW_CONTROL)
+    #if !defined(UART_RTS) && !defined(UART_CTS)
+        #error "No RTS/CTS pins defined for this board (pinout.h)"
+    #endif
+    #if (CDC_RTS_HIGH_WATERMARK >= UART_RX_SIZE) || (CDC_RTS_LOW_WATERMARK >= CDC_RTS_HIGH_WATERMARK)
+        #error "Invalid RTS watermarks"
+    #endif
+#endif
+
+uint8_t UART_rxBuffer[UART_RX_SIZE] UART_RX_BUFFER_ADDRESS_TAG;
+volatile uint8_t UART_rxHead = 0;
+volatile uint8_t UART_rxTail = 0;
+volatile uint16_t UART_rxOverruns = 0;
+volatile uint16_t UART_rxDrops = 0;
+volatile bool UART_rxEvent = false;
+uint8_t UART_eventChar;
+bool UART_eventEnable = false;
+
+uint8_t UART_txBuffer[UART_TX_SIZE] UART_TX_BUFFER_ADDRESS_TAG;
+volatile uint8_t UART_txHead = 0;
+volatile uint8_t UART_txTail = 0;
+
+volatile uint16_t UART_timeHigh = 0;
+volatile uint32_t UART_rxStamp;
+volatile bool UART_rxStamped = false;
+bool UART_stampEnable = false;
 
 #ifdef UART_SHARED
     #warning "This configuration shares the UART with the ICSP pins"
@@ -38,10 +76,14 @@ void BSP_init(void)
     // init UART
     RCSTA = 0x90;       	// SP enable, continuous RX enable
     TXSTA = 0x24;       	// TX enable BRGH=1
-    SPBRG = 0xE2;
-    SPBRGH = 0x04;      	// 48MHz -> 9600 baud
     BAUDCON = 0x08;     	// BRG16 = 1
+    UART_baudrateSet(9600);
     char c = RCREG;         // read
+
+    // receive on interrupt
+    PIE1bits.RCIE = 1;
+    INTCONbits.PEIE = 1;
+    INTCONbits.GIE = 1;
 }
 
 bool BUTTON_isPressed(void)
@@ -72,20 +114,52 @@ void LED_set(COLOR c)
     }
 }
 
-void UART_baudrateSet(uint32_t dwBaud)
+/**
+ * Select the baud rate generator mode and divider closest to a rate
+ * The 16-bit modes are used, Fosc/4 (BRGH=1) first and Fosc/16 (BRGH=0) for
+ * the rates below its range, the 8-bit modes only offer a subset of their
+ * dividers.
+ *
+ * @param dwBaud    requested rate
+ * @return          actual rate, 0 if out of range or the error exceeds
+ *                  UART_BAUD_ERROR (the generator is left unchanged)
+ */
+uint32_t UART_baudrateSet(uint32_t dwBaud)
 {
-    uint32_t dwDivider = ((_XTAL_FREQ/4) / dwBaud) - 1;
+    uint32_t dwClock, dwDivider, dwActual, dwError;
+
+    if ((dwBaud == 0) || (dwBaud > UART_BAUD_MAX))
+        return 0;
+    dwClock = _XTAL_FREQ/4;                             // BRGH=1
+    dwDivider = (dwClock + dwBaud/2) / dwBaud;          // rounded
+    if (dwDivider > 0x10000) {
+        dwClock = _XTAL_FREQ/16;                        // BRGH=0
+        dwDivider = (dwClock + dwBaud/2) / dwBaud;
+        if (dwDivider > 0x10000)
+            return 0;
+    }
+    dwActual = dwClock / dwDivider;
+    dwError = (dwActual > dwBaud) ? dwActual - dwBaud : dwBaud - dwActual;
+    if (dwError * 1000 > dwBaud * UART_BAUD_ERROR)
+        return 0;
+
+    dwDivider--;
+    TXSTAbits.BRGH = (dwClock == _XTAL_FREQ/4);
+    BAUDCONbits.BRG16 = 1;
     SPBRG = (uint8_t) dwDivider;
     SPBRGH = (uint8_t)((uint16_t) (dwDivider >> 8));
+    return dwActual;
 }
 
 void UART_enable(void)
 {
     RCSTAbits.SPEN = 1;         // enable UART, control I/Os
+    UART_txStart();             // resume pending transmission
 }
 
 void UART_disable(void)
 {
+    UART_txStop();              // hold the TX ring contents
     RCSTAbits.SPEN = 0;         // disable UART, control I/Os
 }
 
@@ -93,17 +167,195 @@ char UART_getch(void)
 {
 	char  c;
 
+    c = UART_rxBuffer[UART_rxTail];
+    UART_rxRelease(1);
+	return c;
+}
+
+/**
+ * Consume bytes from the RX ring (after reading them in place)
+ */
+void UART_rxRelease(uint8_t count)
+{
+    UART_rxTail = (UART_rxTail + count) & (UART_RX_SIZE - 1);
+#if defined(USB_CDC_SUPPORT_HARDWARE_FLOW_CONTROL) && defined(UART_RTS)
+    if (UART_rxCount() <= CDC_RTS_LOW_WATERMARK)
+        UART_RTS = USB_CDC_RTS_ACTIVE_LEVEL;
+#endif
+}
+
+/**
+ * Read the 32-bit time (Timer1 and its overflow count), with the Timer1
+ * interrupt masked: from the ISR, or with TMR1IE cleared
+ */
+static uint32_t UART_timeRead(void)
+{
+    uint16_t high = UART_timeHigh;
+    uint8_t  h, l;
+
+    do {
+        h = TMR1H;
+        l = TMR1L;
+    } while (h != TMR1H);
+    if (PIR1bits.TMR1IF && !(h & 0x80))
+        high++;                 // overflow not counted yet
+    return ((uint32_t)high << 16) | ((uint16_t)h << 8) | l;
+}
+
+/**
+ * TMR1IF interrupt: extend Timer1 to 32 bits
+ */
+void UART_timeISR(void)
+{
+    PIR1bits.TMR1IF = 0;
+    UART_timeHigh++;
+}
+
+/**
+ * Read the time from the main loop
+ */
+uint32_t UART_timeGet(void)
+{
+    uint32_t t;
+
+    PIE1bits.TMR1IE = 0;
+    t = UART_timeRead();
+    PIE1bits.TMR1IE = UART_stampEnable || UART_TIME_FREE;
+    return t;
+}
+
+/**
+ * Start (from 0) or stop the RX timestamps, the bytes already in the ring
+ * get the start time
+ */
+void UART_stampStart(bool enable)
+{
+    PIE1bits.RCIE = 0;
+    T1CON = 0;
+    PIE1bits.TMR1IE = 0;
+    TMR1H = 0;
+    TMR1L = 0;
+    PIR1bits.TMR1IF = 0;
+    UART_timeHigh = 0;
+    UART_rxStamp = 0;
+    UART_rxStamped = UART_RxRdy();
+    UART_stampEnable = enable;
+    if (enable || UART_TIME_FREE) {
+        T1CON = 0x31;           // Fosc/4, 1:8 prescaler, on
+        PIE1bits.TMR1IE = 1;
+    }
+    PIE1bits.RCIE = 1;
+}
+
+/**
+ * Take the bytes waiting in the RX ring (up to max) as a chunk, with the
+ * time of its first byte. The bytes received afterwards start a new chunk,
+ * the remainder of a chunk larger than max keeps its time.
+ *
+ * @return  chunk length, the data is read in place then released
+ */
+uint8_t UART_rxChunk(uint32_t *stamp, uint8_t max)
+{
+    uint8_t count;
+
+    PIE1bits.RCIE = 0;
+    *stamp = UART_rxStamp;
+    count = UART_rxCount();
+    if (count > max)
+        count = max;
+    else
+        UART_rxStamped = false;
+    PIE1bits.RCIE = 1;
+    return count;
+}
+
+/**
+ * RCIF interrupt: move the EUSART FIFO contents to the RX ring
+ */
+void UART_rxISR(void)
+{
+    uint8_t next, c;
+
+    while (PIR1bits.RCIF) {
+        c = RCREG;
+        next = (UART_rxHead + 1) & (UART_RX_SIZE - 1);
+        if (next == UART_rxTail) {  // ring full
+            UART_rxDrops++;
+        }
+        else {
+            UART_rxBuffer[UART_rxHead] = c;
+            UART_rxHead = next;
+            if (UART_stampEnable && !UART_rxStamped) {
+                UART_rxStamp = UART_timeRead();
+                UART_rxStamped = true;
+            }
+            if (UART_eventEnable && (c == UART_eventChar))
+                UART_rxEvent = true;
+        }
+    }
+#if defined(USB_CDC_SUPPORT_HARDWARE_FLOW_CONTROL) && defined(UART_RTS)
+    if (UART_rxCount() >= CDC_RTS_HIGH_WATERMARK)
+        UART_RTS = (USB_CDC_RTS_ACTIVE_LEVEL ^ 1);
+#endif
 	if (RCSTAbits.OERR)  // in case of overrun error
-	{                    // we should never see an overrun error, but if we do,
+	{
 		RCSTAbits.CREN = 0;  // reset the port
-		c = RCREG;
 		RCSTAbits.CREN = 1;  // and keep going.
+        UART_rxOverruns++;
 	}
-	else
-    {
-		c = RCREG;
+}
+
+/**
+ * Append data to the TX ring (the caller checks UART_txFree() first)
+ * and start the transmission
+ */
+void UART_txWrite(const volatile uint8_t *data, uint8_t count)
+{
+    uint8_t head = UART_txHead;
+
+    while (count-- > 0) {
+        UART_txBuffer[head & (UART_TX_SIZE - 1)] = *data++;
+        head++;
     }
-	return c;
+    UART_txHead = head;
+    UART_txStart();
+}
+
+/**
+ * Enable the TXIF interrupt if there is data to send and the port is on
+ * (single bit set, no need to mask the interrupts)
+ */
+void UART_txStart(void)
+{
+    if (!UART_txEmpty() && RCSTAbits.SPEN)
+        PIE1bits.TXIE = 1;
+}
+
+void UART_txStop(void)
+{
+    PIE1bits.TXIE = 0;
+}
+
+/**
+ * TXIF interrupt: refill TXREG from the TX ring, stop when it is empty
+ * (or when the target deasserts CTS, the main loop restarts it)
+ */
+void UART_txISR(void)
+{
+    uint8_t tail = UART_txTail;
+
+#if defined(USB_CDC_SUPPORT_HARDWARE_FLOW_CONTROL) && defined(UART_CTS)
+    if (UART_CTS != USB_CDC_CTS_ACTIVE_LEVEL) {
+        PIE1bits.TXIE = 0;
+        return;
+    }
+#endif
+    if (tail == UART_txHead) {
+        PIE1bits.TXIE = 0;
+        return;
+    }
+    TXREG = UART_txBuffer[tail & (UART_TX_SIZE - 1)];
+    UART_txTail = tail + 1;
 }
 
 void UART_putch(char c)
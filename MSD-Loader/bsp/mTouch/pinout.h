@@ -45,14 +45,14 @@
 #define UART_Tx             PORTCbits.RC4
 #define UART_Rx             PORTCbits.RC5
 
-// Use following only for Hardware Flow Control
+// Hardware Flow Control (USB_CDC_SUPPORT_HARDWARE_FLOW_CONTROL in usb_config.h)
+// RA3 is MCLR, no pin left for CTS
 //#define UART_DTS          PORTAbits.RA3
 //#define UART_DTR          LATCbits.LATC3
-//#define UART_RTS          LATBbits.LATB4
-//#define UART_CTS          PORTBbits.RB6
+#define UART_RTS            LATCbits.LATC0
 
-//#define mInitRTSPin() {TRISBbits.TRISB4 = 0;}   //Configure RTS as a digital output.
-//#define mInitCTSPin() {TRISBbits.TRISB6 = 1;}   //Configure CTS as a digital input.  (Make sure pin is digital if ANxx functions is present on the pin)
+#define mInitRTSPin() {UART_RTS = USB_CDC_RTS_ACTIVE_LEVEL; ANSELCbits.ANSC0 = 0; TRISCbits.TRISC0 = 0;}   //Configure RTS as a digital output.
+#define mInitCTSPin() {}
 //#define mInitDTSPin() {}//{TRISAbits.TRISA3 = 1;}   //Configure DTS as a digital input.  (Make sure pin is digital if ANxx functions is present on the pin)
 //#define mInitDTRPin() {TRISCbits.TRISC3 = 0;}   //Configure DTR as a digital output.
 
@@ -941,6 +941,9 @@ typedef struct
 //DOM-IGNORE-BEGIN
 /** E X T E R N S ************************************************************/
 extern uint8_t cdc_rx_len;
+extern volatile unsigned char cdc_data_rx[CDC_DATA_OUT_EP_SIZE];
+extern volatile unsigned char cdc_data_tx[CDC_DATA_IN_EP_SIZE];
+extern USB_HANDLE CDCDataOutHandle;
 extern USB_HANDLE lastTransmission;
 
 extern uint8_t cdc_trf_state;
@@ -950,6 +953,7 @@ extern uint8_t cdc_mem_type;
 
 extern CDC_NOTICE cdc_notice;
 extern LINE_CODING line_coding;
+extern CONTROL_SIGNAL_BITMAP control_signal_bitmap;
 
 extern volatile CTRL_TRF_SETUP SetupPkt;
 extern const uint8_t configDescriptor1[];
@@ -94,11 +94,12 @@ please contact mla_licensing@microchip.com
     #define MSD_VERIFY                         	0x2f
     #define MSD_STOP_START                     	0x1b
     
+    /* Vital product data pages (INQUIRY with EVPD set) */
+    #define MSD_VPD_SUPPORTED_PAGES             0x00
+    #define MSD_VPD_BLOCK_LIMITS                0xB0
+    
     #define MSD_READ10_WAIT                     0x00
-    #define MSD_READ10_BLOCK                    0x01
-    #define MSD_READ10_SECTOR                   0x02
-    #define MSD_READ10_TX_SECTOR                0x03
-    #define MSD_READ10_TX_PACKET                0x04
+    #define MSD_READ10_TX_PACKET                0x04    //streams every sector of the command
     #define MSD_READ10_FETCH_DATA               0x05
     #define MSD_READ10_XMITING_DATA             0x06
     #define MSD_READ10_AWAITING_COMPLETION      0x07
@@ -175,6 +176,9 @@ please contact mla_licensing@microchip.com
 #define ASC_INVALID_COMMAND_OPCODE 0x20
 #define ASCQ_INVALID_COMMAND_OPCODE 0x00
 
+#define ASC_INVALID_FIELD_IN_CDB 0x24
+#define ASCQ_INVALID_FIELD_IN_CDB 0x00
+
 // from SPC-3 Table 185
 // with sense key Illegal Request for test unit ready
 #define ASC_LOGICAL_UNIT_NOT_SUPPORTED 0x25
@@ -52,6 +52,7 @@ please contact mla_licensing@microchip.com
 #include "usb_ch9.h"
 #include "usb_device.h"
 #include "usb_device_local.h"
+#include "stats.h"          // STATS_mark()
 
 #if defined(USB_USE_MSD)
     #include "usb_device_msd.h"
@@ -664,6 +665,7 @@ void USBDeviceTasks(void)
         USBUnmaskInterrupts();
 
         USBDeviceState = DEFAULT_STATE;
+        STATS_mark(STAT_RESET);             //Tick count restarted by USBDeviceInit()
 
         #ifdef USB_SUPPORT_OTG
              //Disable HNP
@@ -2684,6 +2686,7 @@ static void USBCheckStdRequest(void)
     switch(SetupPkt.bRequest)
     {
         case USB_REQUEST_SET_ADDRESS:
+            STATS_mark(STAT_SET_ADDRESS);
             inPipes[0].info.bits.busy = 1;            // This will generate a zero length packet
             USBDeviceState = ADR_PENDING_STATE;       // Update state only
             /* See USBCtrlTrfInHandler() for the next step */
@@ -2692,6 +2695,7 @@ static void USBCheckStdRequest(void)
             USBStdGetDscHandler();
             break;
         case USB_REQUEST_SET_CONFIGURATION:
+            STATS_mark(STAT_SET_CONFIGURATION);
             USBStdSetCfgHandler();
             break;
         case USB_REQUEST_GET_CONFIGURATION:
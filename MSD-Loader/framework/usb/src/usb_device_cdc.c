@@ -56,6 +56,9 @@ please contact mla_licensing@microchip.com
     #define CDC_OUT_DATA_BUFFER_ADDRESS_TAG
     #define CDC_CONTROL_BUFFER_ADDRESS_TAG
 #endif
+#ifndef CDC_NOTICE_ADDRESS_TAG
+    #define CDC_NOTICE_ADDRESS_TAG
+#endif
 
 #if !defined(CDC_IN_DATA_BUFFER_ADDRESS_TAG) || !defined(CDC_OUT_DATA_BUFFER_ADDRESS_TAG) 
     #error "One of the fixed memory address definitions is not defined.  Please define the required address tags for the required buffers."
@@ -77,7 +80,7 @@ LINE_CODING line_coding;    // Buffer to store line coding information
 CDC_NOTICE cdc_notice;
 
 #if defined(USB_CDC_SUPPORT_DSR_REPORTING)
-    SERIAL_STATE_NOTIFICATION SerialStatePacket;
+    SERIAL_STATE_NOTIFICATION SerialStatePacket CDC_NOTICE_ADDRESS_TAG;
 #endif
 
 uint8_t cdc_rx_len;            // total rx length
@@ -113,6 +116,10 @@ uint8_t dummy_encapsulated_cmd_response[dummy_length];
 CTRL_TRF_RETURN USB_CDC_SET_LINE_CODING_HANDLER(CTRL_TRF_PARAMS);
 #endif
 
+#if defined(USB_CDC_SET_CONTROL_LINE_STATE_HANDLER)
+void USB_CDC_SET_CONTROL_LINE_STATE_HANDLER(void);
+#endif
+
 /** P R I V A T E  P R O T O T Y P E S ***************************************/
 void USBCDCSetLineCoding(void);
 
@@ -228,6 +235,9 @@ void USBCheckCDCRequest(void)
                     UART_DTR = (USB_CDC_DTR_ACTIVE_LEVEL ^ 1);
                 }        
             #endif
+            #if defined(USB_CDC_SET_CONTROL_LINE_STATE_HANDLER)
+                USB_CDC_SET_CONTROL_LINE_STATE_HANDLER();
+            #endif
             inPipes[0].info.bits.busy = 1;
             break;
         #endif
@@ -25,6 +25,7 @@ please contact mla_licensing@microchip.com
 #include "system_config.h"
 
 #include <usb_device_msd.h>
+#include "stats.h"          // STATS_mark()
 
 #ifdef USB_USE_MSD
 
@@ -62,6 +63,9 @@ extern LUN_FUNCTIONS LUN[MAX_LUN + 1];
     #define MSD_CBW_ADDR_TAG
     #define MSD_CSW_ADDR_TAG
 #endif
+#if !defined(MSD_BUFFER2_ADDRESS_TAG)
+    #define MSD_BUFFER2_ADDRESS_TAG
+#endif
 volatile USB_MSD_CBW msd_cbw MSD_CBW_ADDR_TAG;  //Must be located in USB module accessible RAM
 volatile USB_MSD_CSW msd_csw MSD_CSW_ADDR_TAG;  //Must be located in USB module accessible RAM
 
@@ -70,6 +74,9 @@ volatile USB_MSD_CSW msd_csw MSD_CSW_ADDR_TAG;  //Must be located in USB module
 #else
     volatile char msd_buffer[512];
 #endif
+//Second IN buffer, so that READ(10) can keep both ping-pong BDs of the bulk IN
+//endpoint busy: segment k+1 is generated while segment k is on the wire.
+volatile char msd_buffer2[MSD_IN_EP_SIZE] MSD_BUFFER2_ADDRESS_TAG;
 
 //State machine variables
 uint8_t MSD_State;			// Takes values MSD_WAIT, MSD_DATA_IN or MSD_DATA_OUT
@@ -462,6 +469,28 @@ uint8_t MSDTasks(void)
                         //Copy the received command to the lower level command
                         //state machine, so it knows what to do.
                         MSDCommandState = gblCBW.CBWCB[0];
+
+                        #if defined(DRV_STATS)
+                        //Time stamp the commands a host issues while mounting
+                        switch(MSDCommandState)
+                        {
+                            case MSD_INQUIRY:
+                                STATS_mark(STAT_INQUIRY);
+                                break;
+                            case MSD_READ_CAPACITY:
+                                STATS_mark(STAT_READ_CAPACITY);
+                                break;
+                            case MSD_TEST_UNIT_READY:
+                                STATS_mark(STAT_TEST_UNIT_READY);
+                                break;
+                            case MSD_READ_10:
+                                if((gblCBW.CBWCB[2] | gblCBW.CBWCB[3] | gblCBW.CBWCB[4] | gblCBW.CBWCB[5]) == 0)
+                                {
+                                    STATS_mark(STAT_READ_LBA0);
+                                }
+                                break;
+                        }
+                        #endif
                     }
                     else
                     {
@@ -772,6 +801,43 @@ void MSDProcessCommandMediaPresent(void)
                 break;
             }
 
+            #if defined(MSD_MAX_TRANSFER_LENGTH)
+            //The host wants a vital product data page (EVPD bit set) instead
+            //of the standard inquiry data.
+            if(gblCBW.CBWCB[1] & 0x01)
+            {
+                memset((void *)&msd_buffer[0], 0x00, MSD_IN_EP_SIZE);
+                msd_buffer[1] = gblCBW.CBWCB[2];            //Page code
+                if(gblCBW.CBWCB[2] == MSD_VPD_SUPPORTED_PAGES)
+                {
+                    msd_buffer[3] = 2;                      //Page length
+                    msd_buffer[4] = MSD_VPD_SUPPORTED_PAGES;
+                    msd_buffer[5] = MSD_VPD_BLOCK_LIMITS;
+                }
+                else if(gblCBW.CBWCB[2] == MSD_VPD_BLOCK_LIMITS)
+                {
+                    //Maximum and optimal transfer length (in blocks, big endian)
+                    //guide how the host splits large reads/writes into commands.
+                    msd_buffer[3] = MSD_IN_EP_SIZE - 4;     //Page length (0x3C)
+                    msd_buffer[10] = (uint8_t)(MSD_MAX_TRANSFER_LENGTH >> 8);
+                    msd_buffer[11] = (uint8_t)MSD_MAX_TRANSFER_LENGTH;
+                    msd_buffer[14] = (uint8_t)(MSD_MAX_TRANSFER_LENGTH >> 8);
+                    msd_buffer[15] = (uint8_t)MSD_MAX_TRANSFER_LENGTH;
+                }
+                else
+                {
+                    //Unsupported page, ILLEGAL REQUEST/INVALID FIELD IN CDB
+                    MSDErrorHandler(MSD_ERROR_UNSUPPORTED_COMMAND);
+                    gblSenseData[LUN_INDEX].ASC=ASC_INVALID_FIELD_IN_CDB;
+                    gblSenseData[LUN_INDEX].ASCQ=ASCQ_INVALID_FIELD_IN_CDB;
+                    break;
+                }
+                MSDComputeDeviceInAndResidue(msd_buffer[3] + 4);
+                MSDCommandState = MSD_COMMAND_RESPONSE;
+                break;
+            }
+            #endif
+
           	//Compute and load proper csw residue and device in number of byte.
             MSDComputeDeviceInAndResidue(sizeof(InquiryResponse));
 
@@ -850,10 +916,8 @@ void MSDProcessCommandMediaPresent(void)
     	    break;
 
         case MSD_PREVENT_ALLOW_MEDIUM_REMOVAL:
-            gblSenseData[LUN_INDEX].SenseKey=S_ILLEGAL_REQUEST;
-            gblSenseData[LUN_INDEX].ASC=ASC_INVALID_COMMAND_OPCODE;
-            gblSenseData[LUN_INDEX].ASCQ=ASCQ_INVALID_COMMAND_OPCODE;
-            msd_csw.bCSWStatus = MSD_CSW_COMMAND_FAILED;
+            //There is no medium lock, but failing the command costs the host
+            //a REQUEST_SENSE round trip on every mount/open, so just accept it.
             msd_csw.dCSWDataResidue = 0x00;
             MSDCommandState = MSD_COMMAND_WAIT;
             break;
@@ -1028,7 +1092,12 @@ static void MSDComputeDeviceInAndResidue(uint16_t DiExpected)
  		uint8_t MSDReadHandler(void)
  	Description:
  		This function processes a read command received through 
- 		the MSD class driver
+ 		the MSD class driver.
+ 		Data is generated directly in 64-byte segments by LUNSectorRead()
+ 		and streamed using both IN ping-pong buffer descriptors: while one
+ 		segment is on the wire the next one is prepared in the alternate
+ 		buffer.  Multi-sector requests are served without returning to
+ 		the block/sector states for each LBA.
  	Return Values:
  		uint8_t - the current state of the MSDReadHandler state
  		machine.  The valid values are defined in MSD.h under the 
@@ -1037,6 +1106,7 @@ static void MSDComputeDeviceInAndResidue(uint16_t DiExpected)
 uint8_t MSDReadHandler(void)
 {
     static uint8_t segment;
+    uint8_t i;
     
     switch(MSDReadState)
     {
@@ -1058,81 +1128,73 @@ uint8_t MSDReadHandler(void)
                 break;
             }    
 
-            MSDReadState = MSD_READ10_BLOCK;
-            //Fall through to MSD_READ_BLOCK
-            
-        case MSD_READ10_BLOCK:
             if(TransferLength.Val == 0)
             {
-                MSDReadState = MSD_READ10_WAIT;
-                break;
-            }
-            
-            TransferLength.Val--;					// we have read 1 LBA
-            MSDReadState = MSD_READ10_SECTOR;
-            //Fall through to MSD_READ10_SECTOR
-            
-        case MSD_READ10_SECTOR:
-            //if the old data isn't completely sent yet
-            if(USBHandleBusy(USBMSDInHandle) != 0)
-            {
-                break;
-            }
-            
-            LBA.Val++;
-            msd_csw.dCSWDataResidue=BLOCKLEN_512;//in order to send the 512 bytes of data read
-            segment = 0;    // !!!
-            ptrNextData=(uint8_t *)&msd_buffer[0];
-            
-            MSDReadState = MSD_READ10_TX_SECTOR;
-            //Fall through to MSD_READ10_TX_SECTOR
-            
-        case MSD_READ10_TX_SECTOR:
-            if(msd_csw.dCSWDataResidue == 0)
-            {
-                MSDReadState = MSD_READ10_BLOCK;
-                break;
+                break;      // nothing to send, MSD_READ10_WAIT
             }
-            
+
+            LBA.Val++;      // notice the LBA.Val+1 (see MSDWriteHandler) !!!
+            segment = 0;
+            ptrNextData = (uint8_t *)&msd_buffer2[0];   // first packet goes out of msd_buffer
+
             MSDReadState = MSD_READ10_TX_PACKET;
             //Fall through to MSD_READ10_TX_PACKET
             
         case MSD_READ10_TX_PACKET:
-            /* Write next chunk of data to EP Buffer and send */
-            
-            //Make sure the endpoint is available before using it.
-            if(USBHandleBusy(USBMSDInHandle))
-            {
-                break;
-            }
-            
-            // get directly a packet of data from target !!!
-            if(LUNSectorRead(LBA.Val, (uint8_t*)&msd_buffer[0], segment++) != true)
+            //Keep both ping-pong buffers of the IN endpoint loaded.  At most one
+            //packet per buffer is generated per call, so that USBDeviceTasks()
+            //keeps being serviced during long transfers.
+            for(i = 0; i < 2; i++)
             {
-                //Read failed, no retries!!!
-                // we can't send the CSW immediately, since the host
-                // still expects to receive sector read data on the IN endpoint
-                // first.  Therefore, we still send dummy bytes, before
-                // we send the CSW with the failed status in it.
-                msd_csw.bCSWStatus=0x02;		// Indicate phase error 0x02
-                                                  // (option #1 from BOT section 6.6.2)
-                //Set error status sense keys, so the host can check them later
-                gblSenseData[LUN_INDEX].SenseKey=S_MEDIUM_ERROR;
-                gblSenseData[LUN_INDEX].ASC=ASC_NO_ADDITIONAL_SENSE_INFORMATION;
-                gblSenseData[LUN_INDEX].ASCQ=ASCQ_NO_ADDITIONAL_SENSE_INFORMATION;
-                USBStallEndpoint(MSD_DATA_IN_EP, IN_TO_HOST);
-                MSDReadState = MSD_READ10_WAIT;
-                break;
-            }//else we successfully read a packet worth of data from our media
-            
-            //Prepare the USB module to send an IN transaction worth of data to the host.
-            USBMSDInHandle = USBTxOnePacket(MSD_DATA_IN_EP,ptrNextData,MSD_IN_EP_SIZE);
-            
-            MSDReadState = MSD_READ10_TX_SECTOR;
+                //Is the next buffer descriptor available?
+                if(USBHandleBusy(USBGetNextHandle(MSD_DATA_IN_EP, IN_TO_HOST)))
+                {
+                    break;
+                }
+
+                //Alternate between the two RAM buffers, the other one may still
+                //be owned by the SIE.
+                if(ptrNextData == (uint8_t *)&msd_buffer[0])
+                    ptrNextData = (uint8_t *)&msd_buffer2[0];
+                else
+                    ptrNextData = (uint8_t *)&msd_buffer[0];
+
+                // get directly a packet of data from target !!!
+                if(LUNSectorRead(LBA.Val, ptrNextData, segment) != true)
+                {
+                    //Read failed, no retries!!!
+                    // we can't send the CSW immediately, since the host
+                    // still expects to receive sector read data on the IN endpoint
+                    // first.  Therefore, we still send dummy bytes, before
+                    // we send the CSW with the failed status in it.
+                    msd_csw.bCSWStatus=0x02;		// Indicate phase error 0x02
+                                                      // (option #1 from BOT section 6.6.2)
+                    //Set error status sense keys, so the host can check them later
+                    gblSenseData[LUN_INDEX].SenseKey=S_MEDIUM_ERROR;
+                    gblSenseData[LUN_INDEX].ASC=ASC_NO_ADDITIONAL_SENSE_INFORMATION;
+                    gblSenseData[LUN_INDEX].ASCQ=ASCQ_NO_ADDITIONAL_SENSE_INFORMATION;
+                    USBStallEndpoint(MSD_DATA_IN_EP, IN_TO_HOST);
+                    MSDReadState = MSD_READ10_WAIT;
+                    break;
+                }//else we successfully read a packet worth of data from our media
 
-            gblCBW.dCBWDataTransferLength-=	MSD_IN_EP_SIZE;
-            msd_csw.dCSWDataResidue-=MSD_IN_EP_SIZE;
-//            ptrNextData+=MSD_IN_EP_SIZE;  // keep the pointer fix!!!
+                //Prepare the USB module to send an IN transaction worth of data to the host.
+                USBMSDInHandle = USBTxOnePacket(MSD_DATA_IN_EP,ptrNextData,MSD_IN_EP_SIZE);
+                gblCBW.dCBWDataTransferLength-=	MSD_IN_EP_SIZE;
+
+                //Advance to the next segment, and to the next sector at the end
+                //of the current one, without leaving this state.
+                if(++segment == (FILEIO_CONFIG_MEDIA_SECTOR_SIZE / MSD_IN_EP_SIZE))
+                {
+                    segment = 0;
+                    LBA.Val++;
+                    if(--TransferLength.Val == 0)
+                    {
+                        MSDReadState = MSD_READ10_WAIT;     // all sectors queued
+                        break;
+                    }
+                }
+            }
             break;
         
         default:
@@ -1266,7 +1328,9 @@ uint8_t MSDWriteHandler(void)
         }
         //Fall through to MSD_WRITE10_RX_PACKET
         case MSD_WRITE10_RX_PACKET:
+        {
             if(USBHandleBusy(USBMSDOutHandle) == true) break;
+            STATS_ENTER();
             // immediately write the data to target !!!
             if(msd_csw.bCSWStatus == 0x00)
             {   // notice the LBA.Val+1 !!!
@@ -1284,7 +1348,9 @@ uint8_t MSDWriteHandler(void)
 //            ptrNextData += MSD_OUT_EP_SIZE; // keep the pointer fixed !!!
             
             MSDWriteState = MSD_WRITE10_RX_SECTOR;
+            STATS_LEAVE(STAT_MSD_WRITE);
             break;
+        }
             
         case MSD_WRITE10_SECTOR:
         {
@@ -28,6 +28,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include "ihex.h"
 
 #define PM_SIZE_IN_BYTES		 16384
 #define	CODE_OFFSET_ADDRESS		 0x200
@@ -36,17 +37,17 @@
 #define USB_PRODUCT_ID			0x0057
 #define USB_VENDOR_ID			0x04d8
 
-static unsigned readhex(const char *text, unsigned digits);
 static unsigned calc_modified_crc14(unsigned data, unsigned crc);
 static unsigned crc32_calc(unsigned crc, unsigned char *buffer, unsigned length);
 
 int main(int argc, char *argv[])
 {
-	FILE *input, *output;
-	char line[256];
-	unsigned address, upper_address;
+	FILE *output;
+	struct iheximage hex;
+	struct ihexparser parser;
+	static const unsigned char blank[2] = { 0xFF, 0x3F };
+	unsigned address, end;
 	unsigned count, next_address, crc;
-	const char *ptr;
 	struct
 	{
 		unsigned out_of_bounds:1;
@@ -68,11 +69,14 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
-	input = fopen(argv[1], "rb");
+	IHEX_imageInit(&hex);
 
-	if (NULL == input)
+	if (!IHEX_load(&hex, argv[1], &parser))
 	{
-		fprintf(stderr, "ERROR: unable to open input file %s\n", argv[1]);
+		if (IHEX_ERR_IO == parser.error)
+			fprintf(stderr, "ERROR: unable to open input file %s\n", argv[1]);
+		else
+			fprintf(stderr, "ERROR: %s: line %u: %s\n", argv[1], parser.error_line, IHEX_errorText(parser.error));
 		return -1;
 	}
 
@@ -84,48 +88,20 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
-	for (address = 0; address < PM_SIZE_IN_BYTES; address += 2)
-	{
-		image[address + 0] = 0xFF;
-		image[address + 1] = 0x3F;
-	}
-
 	memset(&flags, 0, sizeof(flags));
-	upper_address = 0;
 
-	while (!feof(input))
+	/* only the first 64k is program memory (the config words are above) */
+	for (address = 0; IHEX_next(&hex, &address, &end) && (address < 0x10000); address = end)
 	{
-		if (fgets(line, sizeof(line), input))
-		{
-			if (':' == line[0])
-			{
-				count = readhex(line + 1, 2);
-				address = readhex(line + 3, 4);
-				if (0 == strncmp(line + 7, "00", 2) && (0 == upper_address)) /* data record */
-				{
-					ptr = line + 9;
-					while (count--)
-					{
-						if ( (address < 0x400) || (address >= 0x8000) )
-							flags.out_of_bounds = 1;
-						else
-							image[address] = readhex(ptr, 2);
-						address++; ptr += 2;
-					}
-				}
-				else if (0 == strncmp(line + 7, "04", 2)) /* encoding of upper 16-bits (non-zero indicates not part of program memory) */
-				{
-					upper_address = readhex(line + 9, 4);
-				}
-				else if (0 == strncmp(line + 7, "01", 2)) /* end of file record */
-				{
-					break;
-				}
-			}
-		}
+		if ( (address < 0x400) || (end > PM_SIZE_IN_BYTES) )
+			flags.out_of_bounds = 1;
+		if (0 == end)
+			break;
 	}
 
-	fclose(input);
+	/* blank words (0x3FFF) where the file has no data */
+	IHEX_read(&hex, 0, image, PM_SIZE_IN_BYTES, blank, sizeof(blank));
+	IHEX_imageFree(&hex);
 
 	if (flags.out_of_bounds)
 	{
@@ -190,27 +166,6 @@ skip_write:
 	return 0;
 }
 
-static unsigned readhex(const char *text, unsigned digits)
-{
-	unsigned result = 0;
-
-	while (digits--)
-	{
-		result <<= 4;
-		
-		if ( (*text >= '0') && (*text <= '9') )
-			result += *text - '0';
-		else if ( (*text >= 'A') && (*text <= 'F') )
-			result += 10 + *text - 'A';
-		else if ( (*text >= 'a') && (*text <= 'f') )
-			result += 10 + *text - 'a';
-
-		text++;
-	}
-
-	return result;
-}
-
 static unsigned calc_modified_crc14(unsigned data, unsigned crc)
 {
 	unsigned bit, result;
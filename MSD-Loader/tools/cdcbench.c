@@ -0,0 +1,161 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ CDC serial bridge throughput benchmark
+
+ Streams a test pattern to the XPRESS virtual serial port at each of the
+ baud rates given on the command line and reports the sustained host to
+ target throughput against the line rate. With a jumper between the target
+ UART TX and RX pins (-l), the data looped back is checked as well, so that
+ any byte lost by the bridge in either direction is reported.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+#define CHUNK           4096
+#define LOOPBACK_IDLE   500     // ms without data before giving up
+
+static const struct { unsigned baud; speed_t code; } speeds[] = {
+    { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+    { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 },
+    { 500000, B500000 }, { 921600, B921600 }, { 1000000, B1000000 },
+};
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int set_baud(int fd, unsigned baud)
+{
+    struct termios tio;
+    unsigned i;
+
+    for (i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+        if (speeds[i].baud == baud) break;
+    if (i == sizeof(speeds) / sizeof(speeds[0])) return -1;
+    if (tcgetattr(fd, &tio) < 0) return -1;
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speeds[i].code);
+    cfsetospeed(&tio, speeds[i].code);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tio) < 0) return -1;
+    usleep(100000);                 // let the bridge apply the line coding
+    tcflush(fd, TCIOFLUSH);
+    return 0;
+}
+
+// the pattern byte at a given stream offset
+static uint8_t pattern(unsigned long offset)
+{
+    return (uint8_t)(offset + (offset >> 8));
+}
+
+static void bench(int fd, unsigned baud, unsigned long total, int loopback)
+{
+    uint8_t buf[CHUNK];
+    unsigned long sent = 0, received = 0, errors = 0;
+    double start, end, last_rx;
+    fd_set wfds, rfds;
+    struct timeval tv;
+    int n;
+
+    if (set_baud(fd, baud) < 0) {
+        printf("%8u baud: not supported\n", baud);
+        return;
+    }
+    start = last_rx = now();
+    while ((sent < total) || (loopback && (received < total))) {
+        FD_ZERO(&wfds);
+        FD_ZERO(&rfds);
+        if (sent < total) FD_SET(fd, &wfds);
+        if (loopback) FD_SET(fd, &rfds);
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
+        if (select(fd + 1, &rfds, &wfds, NULL, &tv) < 0) break;
+
+        if (FD_ISSET(fd, &wfds)) {
+            unsigned long len = total - sent;
+            unsigned i;
+            if (len > CHUNK) len = CHUNK;
+            for (i = 0; i < len; i++) buf[i] = pattern(sent + i);
+            if ((n = write(fd, buf, len)) > 0) sent += n;
+        }
+        if (FD_ISSET(fd, &rfds) && ((n = read(fd, buf, CHUNK)) > 0)) {
+            int i;
+            for (i = 0; i < n; i++, received++)
+                if (buf[i] != pattern(received)) errors++;
+            last_rx = now();
+        }
+        if (loopback && (sent == total) && ((now() - last_rx) * 1000 > LOOPBACK_IDLE))
+            break;
+    }
+    if (!loopback) tcdrain(fd);
+    end = now();
+
+    printf("%8u baud: %lu bytes in %.2fs, %.0f B/s, %.1f%% of the line rate",
+           baud, sent, end - start, sent / (end - start),
+           sent / (end - start) * 1000.0 / baud);
+    if (loopback)
+        printf(", looped back %lu, lost %lu, corrupted %lu",
+               received, total > received ? total - received : 0, errors);
+    printf("\n");
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "%s [-n bytes] [-l] <tty> [baud...]\n"
+                    "  -n bytes   amount of data per baud rate (default 262144)\n"
+                    "  -l         check the data looped back (target TX wired to RX)\n"
+                    "  baud       default 115200 460800 1000000\n", name);
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    static const unsigned defaults[] = { 115200, 460800, 1000000 };
+    unsigned long total = 262144;
+    int loopback = 0, fd, i;
+
+    for (i = 1; (i < argc) && (argv[i][0] == '-'); i++) {
+        if (!strcmp(argv[i], "-l")) loopback = 1;
+        else if (!strcmp(argv[i], "-n") && (i + 1 < argc)) total = strtoul(argv[++i], NULL, 0);
+        else usage(argv[0]);
+    }
+    if (i >= argc) usage(argv[0]);
+    if ((fd = open(argv[i], O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0) {
+        perror(argv[i]);
+        return -1;
+    }
+    if (++i == argc)
+        for (i = 0; i < (int)(sizeof(defaults) / sizeof(defaults[0])); i++)
+            bench(fd, defaults[i], total, loopback);
+    else
+        for (; i < argc; i++)
+            bench(fd, atoi(argv[i]), total, loopback);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ CDC programming channel client
+
+ Programs a hex file into the target through the XPRESS virtual serial port,
+ without the MSD drive and the host file system: the programming channel
+ is selected (vendor request CDC_VENDOR_SET_PROGRAM, sent through usbfs),
+ the records are streamed keeping a window of unacknowledged records in flight and the
+ firmware acknowledges each record once it has been programmed ('.'), or
+ reports a decoding failure ('!')
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include "cdcvendor.h"
+
+#define ACK_TIMEOUT     5       // s without acknowledgement (bulk erase included)
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "%s [-w window] <tty> <file.hex>\n"
+                    "  -w window  records in flight (default 16)\n", name);
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct termios tio, saved;
+    char line[600], ack[64];
+    unsigned long sent = 0, acked = 0, records = 0;
+    unsigned window = 16;
+    int i = 1, fd, n, eof = 0, rc = 0;
+    const char *tty;
+    double start, last;
+    FILE *hex;
+
+    if ((argc > 2) && !strcmp(argv[1], "-w")) {
+        window = atoi(argv[2]);
+        i = 3;
+    }
+    if ((argc != i + 2) || (window == 0)) usage(argv[0]);
+    if ((hex = fopen(argv[i + 1], "r")) == NULL) {
+        perror(argv[i + 1]);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), hex))
+        if (line[0] == ':') records++;
+    rewind(hex);
+
+    tty = argv[i];
+    if ((fd = open(tty, O_RDWR | O_NOCTTY)) < 0) {
+        perror(tty);
+        return -1;
+    }
+    tcgetattr(fd, &saved);
+    tio = saved;
+    cfmakeraw(&tio);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tio);
+    if (CDCV_programChannel(tty, CDC_PROGRAM_HEX) < 0) {
+        tcsetattr(fd, TCSANOW, &saved);
+        close(fd);
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+
+    start = last = now();
+    while (acked < records) {
+        fd_set rfds;
+        struct timeval tv = { 0, 100000 };
+
+        // keep the window full
+        while (!eof && (sent - acked < window)) {
+            if (!fgets(line, sizeof(line), hex)) { eof = 1; break; }
+            if (line[0] != ':') continue;
+            if (write(fd, line, strlen(line)) < 0) { perror("write"); rc = -1; goto done; }
+            sent++;
+        }
+
+        FD_ZERO(&rfds);
+        FD_SET(fd, &rfds);
+        if (select(fd + 1, &rfds, NULL, NULL, &tv) < 0) break;
+        if (FD_ISSET(fd, &rfds) && ((n = read(fd, ack, sizeof(ack))) > 0)) {
+            for (i = 0; i < n; i++) {
+                if (ack[i] == '.') acked++;
+                else if (ack[i] == '!') {
+                    fprintf(stderr, "decoding failure after record %lu\n", acked);
+                    rc = -1;
+                    goto done;
+                }
+            }
+            last = now();
+        }
+        if (now() - last > ACK_TIMEOUT) {
+            fprintf(stderr, "timeout, %lu/%lu records acknowledged\n", acked, records);
+            rc = -1;
+            goto done;
+        }
+    }
+    printf("%lu records programmed in %.2fs\n", acked, now() - start);
+
+done:
+    CDCV_programChannel(tty, CDC_PROGRAM_BRIDGE);
+    tcsetattr(fd, TCSANOW, &saved);
+    close(fd);
+    fclose(hex);
+    return rc;
+}
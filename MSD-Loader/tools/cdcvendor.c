@@ -0,0 +1,78 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ Vendor requests of the XPRESS virtual serial port, see cdcvendor.h
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/usbdevice_fs.h>
+#include "cdcvendor.h"
+
+/**
+ * Send a vendor request to the USB device behind the tty
+ * (/sys/class/tty/<name>/device is the CDC interface, its parent the device)
+ */
+int CDCV_request(const char *tty, uint8_t request, uint16_t value)
+{
+    char path[PATH_MAX], dev[PATH_MAX], *name;
+    unsigned bus, addr;
+    struct usbdevfs_ctrltransfer ctrl = {
+        .bRequestType = 0x40,           // vendor, device, OUT
+        .bRequest = request,
+        .wValue = value,
+        .timeout = 1000,
+    };
+    FILE *f;
+    int fd, rc;
+
+    strncpy(dev, tty, sizeof(dev) - 1);
+    dev[sizeof(dev) - 1] = '\0';
+    name = basename(dev);
+    snprintf(path, sizeof(path), "/sys/class/tty/%s/device/../busnum", name);
+    if (!(f = fopen(path, "r")) || (fscanf(f, "%u", &bus) != 1)) goto fail;
+    fclose(f);
+    snprintf(path, sizeof(path), "/sys/class/tty/%s/device/../devnum", name);
+    if (!(f = fopen(path, "r")) || (fscanf(f, "%u", &addr) != 1)) goto fail;
+    fclose(f);
+    snprintf(path, sizeof(path), "/dev/bus/usb/%03u/%03u", bus, addr);
+    if ((fd = open(path, O_RDWR)) < 0) {
+        perror(path);
+        return -1;
+    }
+    rc = ioctl(fd, USBDEVFS_CONTROL, &ctrl);
+    if (rc < 0) fprintf(stderr, "vendor request 0x%02x: %s\n", request, strerror(errno));
+    close(fd);
+    return (rc < 0) ? -2 : 0;
+
+fail:
+    if (f) fclose(f);
+    fprintf(stderr, "%s: not a USB serial port\n", tty);
+    return -1;
+}
+
+int CDCV_programChannel(const char *tty, uint8_t channel)
+{
+    int rc = CDCV_request(tty, CDC_VENDOR_SET_PROGRAM, channel);
+
+    if (rc == -2) fprintf(stderr, "SET_PROGRAM %u refused (firmware without CDC_PROGRAM_CHANNEL?)\n", channel);
+    return (rc < 0) ? -1 : 0;
+}
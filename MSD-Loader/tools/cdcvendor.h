@@ -0,0 +1,36 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ Vendor requests of the XPRESS virtual serial port
+
+ The host tools address the USB device behind a tty through usbfs to send
+ the CDC vendor requests of app_device_cdc.h (the request and channel codes
+ are taken from the firmware header, MPLAB.X must be in the include path).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#ifndef CDCVENDOR_H
+#define CDCVENDOR_H
+
+#include <stdint.h>
+#include "app_device_cdc.h"
+
+// vendor request without data stage, 0, -1 no USB device behind the tty or
+// -2 request refused (both reported on stderr)
+int CDCV_request(const char *tty, uint8_t request, uint16_t value);
+
+// SET_PROGRAM: CDC_PROGRAM_BRIDGE, CDC_PROGRAM_HEX or CDC_PROGRAM_FRAME
+int CDCV_programChannel(const char *tty, uint8_t channel);
+
+#endif
@@ -0,0 +1,374 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ Framed programming protocol client
+
+ Programs a hex file into the target through the XPRESS virtual serial port
+ with the binary framed protocol (CDC_PROGRAM_FRAME, frame.h), selected by
+ the vendor request CDC_VENDOR_SET_PROGRAM sent through usbfs:
+ the hex file is decoded on the host, the data is sent in WRITE frames
+ keeping a window of unacknowledged frames in flight (go-back-N after a NAK
+ or a timeout), then each region programmed is checked against the CRC16
+ computed by the firmware (VERIFY) and the target is reset.
+ Each frame is written with a single write(), the CDC driver sends it in a
+ packet of its own.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include "frame.h"
+#include "cdcvendor.h"
+
+#define ACK_TIMEOUT     5       // s without reply (bulk erase included)
+#define RETRIES         3       // timeouts before giving up
+
+struct segment {                // contiguous data of the hex file
+    uint32_t address;
+    uint32_t length;
+    uint8_t *data;
+};
+
+struct request {
+    uint8_t frame[FRAME_SIZE];
+    uint8_t length;
+    uint8_t reply[FRAME_SIZE];
+};
+
+static struct segment *segments;
+static unsigned segment_count;
+static uint8_t sequence;
+static unsigned long naks, timeouts;
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static uint16_t crc16(uint16_t crc, const uint8_t *p, unsigned n)
+{
+    int i;
+
+    while (n--) {
+        crc ^= (uint16_t)*p++ << 8;
+        for (i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Append data to the hex image, merging it with the last segment when contiguous
+ */
+static void image_add(uint32_t address, const uint8_t *data, unsigned n)
+{
+    struct segment *s = segment_count ? &segments[segment_count - 1] : NULL;
+
+    if (!s || (s->address + s->length != address)) {
+        segments = realloc(segments, ++segment_count * sizeof(*segments));
+        s = &segments[segment_count - 1];
+        s->address = address;
+        s->length = 0;
+        s->data = NULL;
+    }
+    s->data = realloc(s->data, s->length + n);
+    memcpy(&s->data[s->length], data, n);
+    s->length += n;
+}
+
+static int hex_load(const char *name)
+{
+    char line[600];
+    uint8_t rec[260];
+    uint32_t base = 0;
+    unsigned n, i, sum, v, lineno = 0;
+    FILE *f;
+
+    if ((f = fopen(name, "r")) == NULL) {
+        perror(name);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        if (line[0] != ':') continue;
+        for (n = 0, sum = 0; (n < sizeof(rec)) && (sscanf(&line[1 + 2 * n], "%2x", &v) == 1); n++)
+            sum += rec[n] = v;
+        if ((n < 5) || (n != rec[0] + 5u) || (sum & 0xff)) {
+            fprintf(stderr, "%s:%u: invalid record\n", name, lineno);
+            fclose(f);
+            return -1;
+        }
+        switch (rec[3]) {
+            case 0:
+                image_add(base + ((rec[1] << 8) | rec[2]), &rec[4], rec[0]);
+                break;
+            case 2:
+                base = ((rec[4] << 8) | rec[5]) << 4;
+                break;
+            case 4:
+                base = ((uint32_t)rec[4] << 24) | ((uint32_t)rec[5] << 16);
+                break;
+        }
+        if (rec[3] == 1) break;
+    }
+    fclose(f);
+    for (i = 0; i < segment_count; i++)
+        if (segments[i].address & 1) {
+            fprintf(stderr, "%s: odd address 0x%x\n", name, segments[i].address);
+            return -1;
+        }
+    return 0;
+}
+
+static void request(struct request *r, uint8_t type, const uint8_t *payload, uint8_t length)
+{
+    uint16_t crc;
+
+    r->frame[0] = length;
+    r->frame[1] = type;
+    r->frame[2] = sequence++;
+    if (length) memcpy(&r->frame[FRAME_HEADER], payload, length);
+    crc = crc16(0xffff, r->frame, length + FRAME_HEADER);
+    r->frame[length + FRAME_HEADER] = crc;
+    r->frame[length + FRAME_HEADER + 1] = crc >> 8;
+    r->length = length + FRAME_HEADER + FRAME_CRC;
+}
+
+/**
+ * Send a list of requests keeping up to window frames in flight
+ *
+ * @return  0 when all were acknowledged, the replies are in the requests
+ */
+static int transact(int fd, struct request *r, unsigned count, unsigned window)
+{
+    static uint8_t rx[FRAME_SIZE * 4];
+    static unsigned fill;
+    unsigned base = 0, next = 0, retries = 0, i, total;
+    double last = now();
+    int n;
+
+    while (base < count) {
+        fd_set rfds;
+        struct timeval tv = { 0, 100000 };
+
+        while ((next < count) && (next - base < window)) {
+            if (write(fd, r[next].frame, r[next].length) != r[next].length) {
+                perror("write");
+                return -1;
+            }
+            next++;
+        }
+
+        FD_ZERO(&rfds);
+        FD_SET(fd, &rfds);
+        if (select(fd + 1, &rfds, NULL, NULL, &tv) < 0) return -1;
+        if (FD_ISSET(fd, &rfds) && ((n = read(fd, &rx[fill], sizeof(rx) - fill)) > 0))
+            fill += n;
+
+        // replies, delimited by their length byte
+        while (fill > 0) {
+            uint8_t *f = rx;
+            uint16_t crc;
+
+            total = f[0] + FRAME_HEADER + FRAME_CRC;
+            if (f[0] > FRAME_PAYLOAD_MAX) total = 0;
+            else if (fill < total) break;
+            else {
+                crc = crc16(0xffff, f, f[0] + FRAME_HEADER);
+                if ((f[total - 2] != (uint8_t)crc) || (f[total - 1] != (uint8_t)(crc >> 8)))
+                    total = 0;
+            }
+            if (total == 0) {       // out of sync, drop a byte
+                memmove(rx, &rx[1], --fill);
+                continue;
+            }
+
+            if (f[1] == FRAME_NAK) {
+                if ((f[3] != FRAME_ERR_CRC) && (f[3] != FRAME_ERR_SEQUENCE)) {
+                    fprintf(stderr, "request type %u rejected, error %u\n",
+                            r[base].frame[1], f[3]);
+                    return -1;
+                }
+                // go back to the expected frame, those before it were executed
+                for (i = base; (i < next) && (r[i].frame[2] != f[4]); i++);
+                base = next = i;
+                naks++;
+            }
+            else if ((base < next) && (f[2] == r[base].frame[2])
+                     && (f[1] == (r[base].frame[1] | FRAME_ACK))) {
+                memcpy(r[base].reply, f, total);
+                base++;
+                retries = 0;
+            }
+            memmove(rx, &rx[total], fill -= total);
+            last = now();
+        }
+
+        if (now() - last > ACK_TIMEOUT) {
+            if (++retries > RETRIES) {
+                fprintf(stderr, "timeout, no reply to request type %u\n", r[base].frame[1]);
+                return -1;
+            }
+            next = base;            // resend the window
+            timeouts++;
+            last = now();
+        }
+    }
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "%s [-w window] [-n] [-s] <tty> <file.hex>\n"
+                    "  -w window  frames in flight (default: reported by the firmware)\n"
+                    "  -n         no verify\n"
+                    "  -s         the channel is already selected (framesim)\n", name);
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct termios tio, saved;
+    struct request *reqs, r;
+    uint8_t payload[FRAME_PAYLOAD_MAX];
+    unsigned window = 0, count, i, j, k, verify = 1, channel = 1, data_max;
+    unsigned long bytes = 0;
+    uint32_t flash_size, len, end;
+    double start, programmed;
+    const char *tty;
+    int fd, rc = -1;
+
+    for (i = 1; (i < (unsigned)argc) && (argv[i][0] == '-'); i++) {
+        if (!strcmp(argv[i], "-n")) verify = 0;
+        else if (!strcmp(argv[i], "-s")) channel = 0;
+        else if (!strcmp(argv[i], "-w") && (i + 1 < (unsigned)argc)) window = atoi(argv[++i]);
+        else usage(argv[0]);
+    }
+    if (i + 2 != (unsigned)argc) usage(argv[0]);
+    if (hex_load(argv[i + 1]) < 0) return -1;
+
+    tty = argv[i];
+    if ((fd = open(tty, O_RDWR | O_NOCTTY)) < 0) {
+        perror(tty);
+        return -1;
+    }
+    tcgetattr(fd, &saved);
+    tio = saved;
+    cfmakeraw(&tio);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tio);
+    if (channel && (CDCV_programChannel(tty, CDC_PROGRAM_FRAME) < 0)) {
+        tcsetattr(fd, TCSANOW, &saved);
+        close(fd);
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+
+    // INFO (restarts the sequence numbering), then ERASE
+    start = now();
+    sequence = 0;
+    request(&r, FRAME_INFO, NULL, 0);
+    if (transact(fd, &r, 1, 1) < 0) goto done;
+    if (r.reply[FRAME_HEADER] != FRAME_VERSION) {
+        fprintf(stderr, "protocol version %u not supported\n", r.reply[FRAME_HEADER]);
+        goto done;
+    }
+    data_max = r.reply[FRAME_HEADER + 1];
+    if (window == 0) window = r.reply[FRAME_HEADER + 2];
+    flash_size = get32(&r.reply[FRAME_HEADER + 3]);
+    request(&r, FRAME_ERASE, NULL, 0);
+    if (transact(fd, &r, 1, 1) < 0) goto done;
+
+    // WRITE frames, followed by END
+    for (i = 0, count = 1; i < segment_count; i++)
+        count += (segments[i].length + data_max - 1) / data_max;
+    reqs = calloc(count, sizeof(*reqs));
+    for (i = 0, count = 0; i < segment_count; i++)
+        for (j = 0; j < segments[i].length; j += len) {
+            len = segments[i].length - j;
+            if (len > data_max) len = data_max;
+            put32(payload, segments[i].address + j);
+            memcpy(&payload[4], &segments[i].data[j], len);
+            request(&reqs[count++], FRAME_WRITE, payload, len + 4);
+            bytes += len;
+        }
+    request(&reqs[count++], FRAME_END, NULL, 0);
+    if (transact(fd, reqs, count, window) < 0) goto done;
+    programmed = now();
+    printf("%lu bytes programmed in %.2fs, %.0f B/s, window %u (%lu NAK, %lu timeouts)\n",
+           bytes, programmed - start, bytes / (programmed - start), window, naks, timeouts);
+
+    // VERIFY each region of the flash memory programmed, FRAME_VERIFY_MAX bytes per request
+    if (verify) {
+        for (i = 0, count = 0; i < segment_count; i++) {
+            if (segments[i].address >= flash_size) continue;
+            end = segments[i].length;
+            if (segments[i].address + end > flash_size) end = flash_size - segments[i].address;
+            for (j = 0; j < end; j += len) {
+                len = end - j;
+                if (len > FRAME_VERIFY_MAX) len = FRAME_VERIFY_MAX;
+                put32(payload, segments[i].address + j);
+                put32(&payload[4], len);
+                request(&reqs[count++], FRAME_VERIFY, payload, 8);
+            }
+        }
+        if (transact(fd, reqs, count, window) < 0) goto done;
+        for (i = 0, k = 0; i < segment_count; i++) {
+            if (segments[i].address >= flash_size) continue;
+            end = segments[i].length;
+            if (segments[i].address + end > flash_size) end = flash_size - segments[i].address;
+            for (j = 0; j < end; j += len, k++) {
+                uint16_t crc;
+                len = get32(&reqs[k].frame[FRAME_HEADER + 4]);
+                crc = crc16(0xffff, &segments[i].data[j], len);
+                if ((reqs[k].reply[FRAME_HEADER] | (reqs[k].reply[FRAME_HEADER + 1] << 8)) != crc) {
+                    fprintf(stderr, "verify failed, 0x%x-0x%x\n", segments[i].address + j,
+                            segments[i].address + j + len - 1);
+                    goto done;
+                }
+            }
+        }
+        printf("%u blocks verified in %.2fs\n", count, now() - programmed);
+    }
+
+    request(&r, FRAME_RESET, NULL, 0);
+    if (transact(fd, &r, 1, 1) < 0) goto done;
+    rc = 0;
+
+done:
+    if (channel) CDCV_programChannel(tty, CDC_PROGRAM_BRIDGE);
+    tcsetattr(fd, TCSANOW, &saved);
+    close(fd);
+    return rc;
+}
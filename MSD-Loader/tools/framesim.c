@@ -0,0 +1,193 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ Framed programming protocol loopback simulator
+
+ Runs the firmware frame decoder (../MPLAB.X/frame.c) on the host, behind a
+ pseudo terminal, against a simulated target (flash array, bulk erase and
+ row write times), so that frameprog can be exercised and benchmarked
+ without a board. Frames can be corrupted on purpose (-c) to exercise the
+ NAK / go-back-N recovery.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "frame.h"
+#include "lvp.h"
+#include "direct.h"
+
+#define IMAGE_SIZE      0x40000     // bytes of target memory simulated
+#define ROW_BYTES       64
+
+// simulated target
+static uint8_t  image[IMAGE_SIZE];
+static uint32_t flash_size = 0x8000;
+static uint32_t ee_address = 0;
+static unsigned erase_ms = 10, row_us = 2500, packet_us = 0;
+static long     row_current = -1;
+static bool     lvp, session;
+static unsigned long rows, erases, resets, frames, corrupted;
+
+void ICSP_slaveReset(void) { resets++; }
+void ICSP_slaveRun(void) { }
+void LVP_enter(void) { lvp = true; }
+bool LVP_inProgress(void) { return lvp; }
+uint32_t LVP_flashSize(void) { return flash_size; }
+uint32_t LVP_eeAddress(void) { return ee_address; }
+
+static void LvpCommitRow(void)
+{
+    if (row_current >= 0) {
+        usleep(row_us);
+        rows++;
+    }
+    row_current = -1;
+}
+
+void LVP_exit(void)
+{
+    LvpCommitRow();
+    lvp = false;
+}
+
+void LVP_erase(void)
+{
+    lvp = true;
+    memset(image, 0xff, sizeof(image));
+    usleep(erase_ms * 1000);
+    erases++;
+}
+
+void LVP_packRow(uint32_t address, uint8_t *data, uint8_t data_count)
+{
+    if (!lvp) LVP_erase();          // first row, as LVP_commitRow()
+    for (; data_count > 0; data_count--, address++) {
+        if ((long)(address / ROW_BYTES) != row_current) {
+            LvpCommitRow();
+            row_current = address / ROW_BYTES;
+        }
+        if (address < IMAGE_SIZE) image[address] = *data;
+        data++;
+    }
+}
+
+void LVP_programLastRow(void)
+{
+    LVP_exit();
+}
+
+void LVP_read(uint32_t address, uint8_t *data, uint8_t data_count)
+{
+    for (; data_count > 0; data_count--, address++)
+        *data++ = (address < IMAGE_SIZE) ? image[address] : 0xff;
+}
+
+bool DIRECT_SessionOpen(void)
+{
+    if (!session) {
+        if (lvp) return false;
+        LVP_enter();
+        session = true;
+    }
+    return true;
+}
+
+void DIRECT_SessionClose(void)
+{
+    if (session) {
+        LVP_exit();
+        session = false;
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "%s [-f flash] [-e ee] [-E ms] [-r us] [-u us] [-c n]\n"
+                    "  -f flash   flash size in bytes (default 0x8000)\n"
+                    "  -e ee      EE address reported, 0 = none (default)\n"
+                    "  -E ms      bulk erase time (default 10)\n"
+                    "  -r us      row write time (default 2500)\n"
+                    "  -u us      time per CDC packet (default 0)\n"
+                    "  -c n       corrupt one frame in n (default 0 = none)\n", name);
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    uint8_t buf[FRAME_SIZE * 4], frame[FRAME_SIZE];
+    unsigned corrupt = 0, fill = 0, total;
+    struct termios tio;
+    int fd, slave, i, n;
+
+    for (i = 1; i < argc; i++) {
+        if (i + 1 == argc) usage(argv[0]);
+        if (!strcmp(argv[i], "-f")) flash_size = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-e")) ee_address = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-E")) erase_ms = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-r")) row_us = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-u")) packet_us = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-c")) corrupt = strtoul(argv[++i], NULL, 0);
+        else usage(argv[0]);
+    }
+    if (((fd = posix_openpt(O_RDWR | O_NOCTTY)) < 0) || grantpt(fd) || unlockpt(fd)) {
+        perror("pty");
+        return -1;
+    }
+    slave = open(ptsname(fd), O_RDWR | O_NOCTTY); // keep the pty up between clients
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    printf("%s\n", ptsname(fd));
+    fflush(stdout);
+    memset(image, 0xff, sizeof(image));
+
+    while ((n = read(fd, &buf[fill], sizeof(buf) - fill)) > 0) {
+        fill += n;
+        // the length byte delimits the frames (one per CDC packet)
+        while (fill > 0) {
+            if (buf[0] > FRAME_PAYLOAD_MAX) {
+                memmove(buf, &buf[1], --fill);  // out of sync, drop a byte
+                continue;
+            }
+            total = buf[0] + FRAME_HEADER + FRAME_CRC;
+            if (fill < total) break;
+            memcpy(frame, buf, total);
+            memmove(buf, &buf[total], fill -= total);
+            frames++;
+            if (corrupt && (frames % corrupt == 0)) {
+                frame[total - 1] ^= 0x55;
+                corrupted++;
+            }
+            usleep(packet_us);
+            if ((n = FRAME_process(frame, total)) > 0) {
+                usleep(packet_us);
+                if (write(fd, frame, n) != n) break;
+            }
+            if (frame[1] == (FRAME_RESET | FRAME_ACK)) {
+                printf("%lu frames (%lu corrupted), %lu erases, %lu rows written, %lu resets\n",
+                       frames, corrupted, erases, rows, resets);
+                fflush(stdout);
+            }
+        }
+    }
+    close(slave);
+    return 0;
+}
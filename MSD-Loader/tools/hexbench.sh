@@ -0,0 +1,70 @@
+#!/bin/bash
+#
+# Program the hex files of corpus/ with the host build of each MPLAB X
+# configuration (hostcore, see the Makefile target host) and report, per
+# configuration and file, the bytes and records parsed, the rows written,
+# the ICSP clock edges and the programming time of the virtual target
+#
+# usage: ./hexbench.sh [-f csv|json] [-c] [-b baseline.csv] [configuration...]
+#   -f format       csv (default) or json
+#   -c              stream the files through the CDC channel instead of the
+#                   PROGRAM drive
+#   -b baseline     compare with a previous csv run: the files programmed
+#                   slower (virtual time) are listed and the exit status is 1
+#
+# The exit status is also 1 when a file fails verification or causes an
+# ICSP protocol violation, or when the target reset through the CDC line
+# state (hostcore -r) is not released as expected.
+#
+set -e
+
+DIR=$(dirname "$0")
+FORMAT=csv
+CDC=
+BASELINE=
+while getopts "f:cb:" OPT; do
+    case $OPT in
+        f) FORMAT=$OPTARG ;;
+        c) CDC=-c ;;
+        b) BASELINE=$OPTARG ;;
+        *) echo "usage: $0 [-f csv|json] [-c] [-b baseline.csv] [configuration...]"; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+CONFS=${*:-XPRESS_171x XPRESS_18345 XPRESS_18877 XPRESS_18K42 CLICKER2_18K40 mTouch_Xpress mTouch_Q10}
+[ -n "$BASELINE" ] && FORMAT=csv
+
+make -s -C "$DIR" host
+cd "$DIR"
+
+OUT=$(mktemp)
+STATUS=0
+for CONF in $CONFS; do
+    case $CONF in
+        XPRESS_171x|XPRESS_18345|XPRESS_18877) FAMILY=pic16 ;;
+        *) FAMILY=pic18 ;;
+    esac
+    for HEX in corpus/$FAMILY-*.hex; do
+        ./hostcore-$CONF $CDC -v -f $FORMAT $HEX >> $OUT || STATUS=1
+    done
+    RESET=$(./hostcore-$CONF -r) || { echo "$RESET" >&2; STATUS=1; }
+done
+
+if [ $FORMAT = json ]; then
+    echo "["
+    sed '$!s/$/,/' $OUT
+    echo "]"
+else
+    echo "config,file,bytes,records,rows,edges,sessions,lvp_ms,busy_ms,time_ms,violations,verify"
+    cat $OUT
+fi
+
+if [ -n "$BASELINE" ]; then
+    awk -F, 'NR == FNR { if (FNR > 1) base[$1 "," $2] = $10; next }
+             ($1 "," $2) in base && $10 > base[$1 "," $2] {
+                 printf "slower: %s %s %.3f ms -> %.3f ms\n", $1, $2, base[$1 "," $2], $10 > "/dev/stderr"
+                 slower = 1 }
+             END { exit slower }' "$BASELINE" $OUT || STATUS=1
+fi
+rm -f $OUT
+exit $STATUS
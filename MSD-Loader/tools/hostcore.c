@@ -0,0 +1,322 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ Host build of the firmware core
+
+ The hex parser (direct.c), the FAT emulation (files.c), the MSD class
+ (usb_device_msd.c), the CDC class (app_device_cdc.c, usb_device_cdc.c) and
+ one of the LVP modules (lvp-*.c) are compiled for the host against the xc.h
+ stand-in of sim/ (see the Makefile, target host): a hex file is programmed
+ as written to the PROGRAM drive or, with -c, streamed through the CDC
+ programming channel (the CDC data endpoint behind the simulated SIE of
+ sim/usb.c, the acknowledgements counted), and the virtual time spent by
+ the LVP routines is reported, so that changes to the protocol timing can
+ be measured without a board. The virtual target of
+ sim/target.c decodes the ICSP traffic, reports the commands sent and
+ checks the protocol timings, the hex file can then be verified against it
+ by the firmware, as on the VERIFY drive. With -t, the ICSP waveforms are
+ saved as a VCD file (sim/trace.c) for GTKWave, with -s the STATS.TXT file
+ of the drive (stats.c, hot path stage times) is printed. With -r, no file
+ is programmed: the target is reset through the CDC line state (DTR, built
+ with CDC_RESET_LINE_STATE) and its release and boot marker are checked.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "target.h"
+#include "trace.h"
+#include "usb.h"
+#include "usb_device_cdc.h"
+#include "app_device_cdc.h"
+#include "direct.h"
+#include "lvp.h"
+#include "bsp.h"
+#include "stats.h"
+
+#define CHUNK   64                      // one CDC/MSD packet at a time
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "%s [-c] [-v] [-q | -f csv | -f json] [-t trace.vcd] <file.hex>\n"
+                    "%s -r [-t trace.vcd]\n"
+                    "  -c         stream the file through the CDC channel (default: PROGRAM drive)\n"
+                    "  -v         verify the target after programming\n"
+                    "  -q         print the virtual time only (ms)\n"
+                    "  -f format  print one csv line or json object, see hexbench.sh\n"
+                    "  -t file    record the ICSP pins as a VCD file\n"
+                    "  -s         print STATS.TXT after programming\n"
+                    "  -r         reset the target through the CDC line state and check its release\n",
+                    name, name);
+    exit(-1);
+}
+
+/**
+ * One main loop pass of the firmware, the CDC programming channel part of it
+ * (main.c calls the CDC tasks after DIRECT_Tasks)
+ */
+static void firmware(void)
+{
+    DIRECT_Tasks();
+    APP_DeviceCDCEmulatorTasks();
+}
+
+/**
+ * Vendor request of the CDC class, as received on EP0
+ */
+static void vendor_request(uint8_t request, uint16_t value)
+{
+    SetupPkt.bmRequestType = USB_SETUP_HOST_TO_DEVICE | USB_SETUP_TYPE_VENDOR | USB_SETUP_RECIPIENT_DEVICE;
+    SetupPkt.bRequest = request;
+    SetupPkt.wValue = value;
+    APP_DeviceCDCVendorRequest();
+}
+
+#if defined(CDC_RESET_LINE_STATE)
+void USB_CDC_SET_CONTROL_LINE_STATE_HANDLER(void);     // as usb_device_cdc.c calls it
+
+/**
+ * Main loop passes, 0.1 ms apart, for ms of virtual time: the time the
+ * target is held in reset is added up, a marker chunk of the timestamp
+ * capture (empty) is looked for in the IN packets
+ */
+static void reset_passes(unsigned ms, uint64_t *held, bool *released, bool *marker)
+{
+    uint8_t buf[CDC_DATA_IN_EP_SIZE], len;
+    uint64_t end = SIM_time + ms * 1000000ull, t;
+
+    while (SIM_time < end) {
+        firmware();
+        t = SIM_time;
+        SIM_delay(100000);
+        if (TARGET_inReset()) *held += SIM_time - t;
+        else if (*held) *released = true;
+        len = sizeof(buf);
+        if ((SIM_usbIn(CDC_DATA_EP, buf, &len) == SIM_USB_ACK) && (len == CDC_CHUNK_HEADER) && (buf[0] == 0))
+            *marker = true;
+    }
+}
+
+/**
+ * Reset the target as an Arduino style host does, with the line
+ * CDC_RESET_LINE_STATE of SET_CONTROL_LINE_STATE (asserted for 50 ms, then
+ * released), in timestamp capture mode: the target must be held in reset
+ * (CDC_RESET_PULSE_MS, or as long as the line is asserted), released and
+ * the release marked by an empty chunk
+ *
+ * @return  0 passed, 1 failed
+ */
+static int reset_check(void)
+{
+    uint64_t held = 0;
+    bool released = false, marker = false;
+
+    SIM_usbSIE = true;
+    APP_DeviceCDCEmulatorInitialize();
+    vendor_request(CDC_VENDOR_SET_TIMESTAMP, 1);
+
+    control_signal_bitmap._byte = CDC_RESET_ACTIVE_LEVEL ? CDC_RESET_LINE_STATE : 0;
+    USB_CDC_SET_CONTROL_LINE_STATE_HANDLER();
+    reset_passes(50, &held, &released, &marker);
+    control_signal_bitmap._byte ^= CDC_RESET_LINE_STATE;
+    USB_CDC_SET_CONTROL_LINE_STATE_HANDLER();
+    reset_passes(50, &held, &released, &marker);
+
+    printf("%s: target held in reset %.1f ms (CDC_RESET_PULSE_MS %u), %s, %s\n", SIM_CONF, held / 1e6,
+           (unsigned)CDC_RESET_PULSE_MS, released ? "released" : "NOT RELEASED",
+           marker ? "marker chunk sent" : "NO MARKER CHUNK");
+    return (held && released && marker) ? 0 : 1;
+}
+#endif
+
+/**
+ * Read the IN packets of the programming channel: '.' acknowledges a
+ * record, '!' reports a decoding failure
+ *
+ * @return  bytes received
+ */
+static unsigned acks(unsigned *records, unsigned *errors)
+{
+    uint8_t buf[CDC_DATA_IN_EP_SIZE], len, i;
+    unsigned bytes = 0;
+
+    for (len = sizeof(buf); SIM_usbIn(CDC_DATA_EP, buf, &len) == SIM_USB_ACK; len = sizeof(buf)) {
+        for (i = 0; i < len; i++) {
+            if (buf[i] == '.') (*records)++;
+            else if (buf[i] == '!') (*errors)++;
+        }
+        bytes += len;
+    }
+    return bytes;
+}
+
+/**
+ * Pass a file to the firmware in 64-byte segments, as the host writes the
+ * data sectors of a drive, or as the host sends it to the CDC data endpoint
+ * (the firmware runs until the packet is acknowledged)
+ */
+static unsigned send(FILE *f, const DRIVE_CONFIG *drive, bool cdc, unsigned *records)
+{
+    uint8_t buf[CHUNK];
+    unsigned bytes = 0, errors = 0;
+    size_t n;
+
+    *records = 0;
+
+    rewind(f);
+    memset(buf, '\n', sizeof(buf));    // the last segment is padded
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        if (cdc) {
+            while (SIM_usbOut(CDC_DATA_EP, buf, n) == SIM_USB_NAK) {
+                firmware();             // the previous packet is still parsed
+                acks(records, &errors);
+            }
+            do firmware();
+            while (acks(records, &errors) > 0);
+            if (errors) break;
+        }
+        else {
+            DIRECT_SectorWrite((void*)drive, DRV_DATA_SECTOR, buf, 0);
+            *records += DIRECT_StreamRecords();
+        }
+        memset(buf, '\n', sizeof(buf));
+        bytes += n;
+    }
+    return bytes;
+}
+
+int main(int argc, char *argv[])
+{
+    static const DRIVE_CONFIG program = { DRIVE_PROGRAM, "XPRESS     " };
+    static const DRIVE_CONFIG verify = { DRIVE_VERIFY, "VERIFY     " };
+    uint8_t result[VERIFY_RESULT_SIZE] = "-";
+    const char *format = NULL, *vcd = NULL;
+    unsigned bytes, size, records, checked;
+    uint64_t time;
+    int quiet = 0, check = 0, cdc = 0, stats_txt = 0, reset = 0, rc, i;
+    TARGET_STATS stats, after;
+    FILE *f;
+
+    for (i = 1; (i < argc) && (argv[i][0] == '-'); i++) {
+        if (!strcmp(argv[i], "-q")) quiet = 1;
+        else if (!strcmp(argv[i], "-v")) check = 1;
+        else if (!strcmp(argv[i], "-c")) cdc = 1;
+        else if (!strcmp(argv[i], "-s")) stats_txt = 1;
+        else if (!strcmp(argv[i], "-r")) reset = 1;
+        else if (!strcmp(argv[i], "-f") && (i + 1 < argc)) format = argv[++i];
+        else if (!strcmp(argv[i], "-t") && (i + 1 < argc)) vcd = argv[++i];
+        else usage(argv[0]);
+    }
+    if ((i + !reset != argc) || (format && strcmp(format, "csv") && strcmp(format, "json")))
+        usage(argv[0]);
+
+    SIM_reset();
+    if (!TARGET_init(SIM_LVP)) {
+        fprintf(stderr, "no target model for lvp-%s.c\n", SIM_LVP);
+        return -1;
+    }
+    if (vcd && !TRACE_open(vcd)) {
+        perror(vcd);
+        return -1;
+    }
+    SIM_timer1ISR = UART_timeISR;
+    UART_stampStart(false);             // Timer1 on, as once enumerated
+    if (reset) {
+#if defined(CDC_RESET_LINE_STATE)
+        rc = reset_check();
+#else
+        fprintf(stderr, "CDC_RESET_LINE_STATE is not defined\n");
+        rc = -1;
+#endif
+        TRACE_close();
+        return rc;
+    }
+    if (!(f = fopen(argv[i], "rb"))) {
+        perror(argv[i]);
+        return -1;
+    }
+    if (cdc) {
+#if defined(CDC_PROGRAM_CHANNEL)
+        SIM_usbSIE = true;              // the endpoints stay armed until moved
+        APP_DeviceCDCEmulatorInitialize();
+        vendor_request(CDC_VENDOR_SET_PROGRAM, CDC_PROGRAM_HEX);
+#else
+        fprintf(stderr, "CDC_PROGRAM_CHANNEL is not defined (usb_config.h)\n");
+        return -1;
+#endif
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    bytes = send(f, &program, cdc, &records);
+    if (bytes != size) {
+        fprintf(stderr, "%s: hex error after %u records\n", argv[i], records);
+        return -1;
+    }
+    if (LVP_inProgress()) {             // no end of file record
+        fprintf(stderr, "%s: incomplete, last row not programmed\n", argv[i]);
+        LVP_exit();
+    }
+    TARGET_statsGet(&stats);            // programming only
+    time = SIM_time;
+
+    if (check) {                        // hex file dropped on the VERIFY drive
+        send(f, &verify, false, &checked);
+        VerifyResultGet(result);
+        result[4] = 0;
+        TARGET_statsGet(&after);
+        if (after.violations != stats.violations) {
+            fprintf(stderr, "%s: protocol violation(s) during verification\n", argv[i]);
+            strcpy((char*)result, "ICSP");
+        }
+    }
+    fclose(f);
+    TRACE_close();
+
+    if (quiet)
+        printf("%.3f\n", time / 1e6);
+    else if (format && !strcmp(format, "csv"))
+        printf("%s,%s,%u,%u,%u,%u,%u,%.3f,%.3f,%.3f,%u,%s\n", SIM_CONF, argv[i],
+               bytes, records, stats.rows, stats.clocks * 2, stats.sessions,
+               stats.lvp / 1e6, stats.busy / 1e6, time / 1e6, stats.violations, result);
+    else if (format)
+        printf("{\"config\": \"%s\", \"file\": \"%s\", \"bytes\": %u, \"records\": %u, "
+               "\"rows\": %u, \"edges\": %u, \"sessions\": %u, \"lvp_ms\": %.3f, "
+               "\"busy_ms\": %.3f, \"time_ms\": %.3f, \"violations\": %u, \"verify\": \"%s\"}\n",
+               SIM_CONF, argv[i], bytes, records, stats.rows, stats.clocks * 2, stats.sessions,
+               stats.lvp / 1e6, stats.busy / 1e6, time / 1e6, stats.violations, result);
+    else {
+        printf("%s: %u bytes, %u records, %.3f ms (flash %u bytes)\n", argv[i], bytes,
+               records, time / 1e6, (unsigned)LVP_flashSize());
+        TARGET_report(stdout);
+        if (check)
+            printf("verify: %s\n", result);
+    }
+#ifdef DRV_STATS
+    if (stats_txt) {
+        uint8_t segment[MSD_IN_EP_SIZE];
+        size_t offset, n;
+
+        for (offset = 0; offset < STATS_SIZE; offset += n) {
+            n = STATS_SIZE - offset;    // the last segment is partial
+            if (n > sizeof(segment)) n = sizeof(segment);
+            memset(segment, 0, sizeof(segment));
+            STATS_get(offset, segment);
+            fwrite(segment, 1, n, stdout);
+        }
+    }
+#endif
+    return (stats.violations || (check && strcmp((char*)result, "PASS"))) ? 1 : 0;
+}
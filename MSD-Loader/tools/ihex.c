@@ -0,0 +1,584 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ Intel HEX library of the host tools, see ihex.h
+
+ The parser works a line at a time: the lines found whole in the input are
+ decoded in place, only a line split between two chunks is copied. The hex
+ digits go through a 256-entry table (-1 for the other characters), two
+ lookups and a shift per byte.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ihex.h"
+
+#define CHUNK           65536           // read size when the input is not mapped
+#define PAGES           (1u << IHEX_DIR_BITS)
+#define TOP             (1ull << 32)
+
+// value of a hex digit, -1 otherwise
+#define N(c)    (((c) >= '0' && (c) <= '9') ? (c) - '0' : ((c) >= 'A' && (c) <= 'F') ? (c) - 'A' + 10 \
+                 : ((c) >= 'a' && (c) <= 'f') ? (c) - 'a' + 10 : -1)
+#define N4(c)   N(c), N(c + 1), N(c + 2), N(c + 3)
+#define N16(c)  N4(c), N4(c + 4), N4(c + 8), N4(c + 12)
+#define N64(c)  N16(c), N16(c + 16), N16(c + 32), N16(c + 48)
+
+static const int8_t nibble[256] = { N64(0), N64(64), N64(128), N64(192) };
+
+static const char * const error_text[] = {
+    "no error", "syntax error", "wrong record length", "bad record type",
+    "checksum error", "I/O error", "out of memory"
+};
+
+const char *IHEX_errorText(enum ihexerror error)
+{
+    return error_text[error];
+}
+
+void IHEX_init(struct ihexparser *p, ihexhandler handler, void *ctx)
+{
+    memset(p, 0, sizeof(*p));
+    p->handler = handler;
+    p->ctx = ctx;
+}
+
+static bool fail(struct ihexparser *p, enum ihexerror error)
+{
+    p->error = error;
+    p->error_line = p->line;
+    return false;
+}
+
+/**
+ * Decode and check a line (end of line removed), pass its record on
+ *
+ * @return  false on error or when the handler stops the parsing
+ */
+static bool line(struct ihexparser *p, const char *s, size_t n)
+{
+    uint8_t b[5 + 255];
+    struct ihexrecord r;
+    unsigned i, count, sum = 0;
+    int v;
+
+    p->line++;
+    if (n && (s[n - 1] == '\r')) n--;
+    if (!n || p->eof) return true;          // blank line, or past the EOF record
+    if (s[0] != ':') return fail(p, IHEX_ERR_SYNTAX);
+    if ((n < 11) || !(n & 1) || (n > 1 + 2 * sizeof(b))) return fail(p, IHEX_ERR_LENGTH);
+    count = (n - 1) / 2;
+    for (i = 0, s++; i < count; i++, s += 2) {
+        v = nibble[(uint8_t)s[0]] << 4 | nibble[(uint8_t)s[1]];
+        if (v < 0) return fail(p, IHEX_ERR_SYNTAX);
+        b[i] = v;
+        sum += v;
+    }
+    if (b[0] + 5u != count) return fail(p, IHEX_ERR_LENGTH);
+    if (sum & 0xff) return fail(p, IHEX_ERR_CHECKSUM);
+
+    r.type = b[3];
+    r.count = b[0];
+    r.address = b[1] << 8 | b[2];
+    r.data = &b[4];
+    r.line = p->line;
+    switch (r.type) {
+        case 0:                             // data
+            r.address += p->base;
+            break;
+        case 1:                             // end of file
+            if (r.count != 0) return fail(p, IHEX_ERR_TYPE);
+            p->eof = true;
+            break;
+        case 2:                             // extended segment address
+            if (r.count != 2) return fail(p, IHEX_ERR_TYPE);
+            p->base = (uint32_t)(b[4] << 8 | b[5]) << 4;
+            break;
+        case 4:                             // extended linear address
+            if (r.count != 2) return fail(p, IHEX_ERR_TYPE);
+            p->base = (uint32_t)(b[4] << 8 | b[5]) << 16;
+            break;
+        case 3:                             // start segment address (CS:IP)
+        case 5:                             // start linear address
+            if (r.count != 4) return fail(p, IHEX_ERR_TYPE);
+            break;
+        default:
+            return fail(p, IHEX_ERR_TYPE);
+    }
+    return p->handler(p->ctx, &r);
+}
+
+/**
+ * Parse the next chunk of a file, the lines can be split anywhere
+ */
+bool IHEX_feed(struct ihexparser *p, const char *text, size_t size)
+{
+    const char *end = text + size, *nl;
+    size_t n;
+
+    if (p->error) return false;
+    if (p->carry) {                         // complete the line split by the last chunk
+        nl = memchr(text, '\n', size);
+        n = (nl ? nl : end) - text;
+        if (p->carry + n > sizeof(p->carried)) {
+            p->line++;
+            return fail(p, IHEX_ERR_LENGTH);
+        }
+        memcpy(&p->carried[p->carry], text, n);
+        p->carry += n;
+        if (!nl) return true;
+        n = p->carry;
+        p->carry = 0;
+        if (!line(p, p->carried, n)) return false;
+        text = nl + 1;
+    }
+    while (text < end) {
+        nl = memchr(text, '\n', end - text);
+        if (!nl) {                          // kept for the next chunk
+            n = end - text;
+            if (n > sizeof(p->carried)) {
+                p->line++;
+                return fail(p, IHEX_ERR_LENGTH);
+            }
+            memcpy(p->carried, text, n);
+            p->carry = n;
+            break;
+        }
+        if (!line(p, text, nl - text)) return false;
+        text = nl + 1;
+    }
+    return true;
+}
+
+bool IHEX_finish(struct ihexparser *p)
+{
+    size_t n = p->carry;
+
+    if (p->error) return false;
+    p->carry = 0;
+    return !n || line(p, p->carried, n);
+}
+
+/**
+ * Parse a whole file, memory mapped if it is a regular file, read in chunks
+ * otherwise
+ */
+bool IHEX_parseFile(struct ihexparser *p, const char *path)
+{
+    static char buffer[CHUNK];
+    struct stat st;
+    bool ok = true;
+    ssize_t n;
+    void *map;
+    int fd;
+
+    fd = strcmp(path, "-") ? open(path, O_RDONLY) : 0;
+    if (fd < 0) return fail(p, IHEX_ERR_IO);
+    if (!fstat(fd, &st) && S_ISREG(st.st_mode) && (st.st_size > 0)
+        && ((map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED)) {
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        ok = IHEX_feed(p, map, st.st_size);
+        munmap(map, st.st_size);
+    }
+    else {
+        while (ok && ((n = read(fd, buffer, sizeof(buffer))) > 0))
+            ok = IHEX_feed(p, buffer, n);
+        if (n < 0) ok = fail(p, IHEX_ERR_IO);
+    }
+    if (fd) close(fd);
+    return ok && IHEX_finish(p);
+}
+
+/*******************************************************************************
+ Sparse image
+ ******************************************************************************/
+static inline bool used(const struct ihexpage *page, unsigned i)
+{
+    return page->used[i >> 3] & (1 << (i & 7));
+}
+
+static struct ihexpage *page_get(const struct iheximage *image, uint32_t address)
+{
+    struct ihexpage **dir = image->table[address >> (32 - IHEX_DIR_BITS)];
+
+    return dir ? dir[(address >> IHEX_PAGE_BITS) & (PAGES - 1)] : NULL;
+}
+
+static struct ihexpage *page_new(struct iheximage *image, uint32_t address)
+{
+    struct ihexpage ***dir = &image->table[address >> (32 - IHEX_DIR_BITS)];
+    struct ihexpage **page;
+
+    if (!*dir && !(*dir = calloc(PAGES, sizeof(**dir)))) return NULL;
+    page = &(*dir)[(address >> IHEX_PAGE_BITS) & (PAGES - 1)];
+    if (!*page) *page = calloc(1, sizeof(**page));
+    return *page;
+}
+
+void IHEX_imageInit(struct iheximage *image)
+{
+    memset(image, 0, sizeof(*image));
+}
+
+void IHEX_imageFree(struct iheximage *image)
+{
+    unsigned d, i;
+
+    for (d = 0; d < PAGES; d++) {
+        if (!image->table[d]) continue;
+        for (i = 0; i < PAGES; i++)
+            free(image->table[d][i]);
+        free(image->table[d]);
+    }
+    IHEX_imageInit(image);
+}
+
+// mark n bytes from i as set, return how many were not
+static unsigned mark(struct ihexpage *page, unsigned i, unsigned n)
+{
+    unsigned added = 0, bits;
+
+    for (; n && (i & 7); i++, n--)
+        if (!used(page, i)) {
+            page->used[i >> 3] |= 1 << (i & 7);
+            added++;
+        }
+    for (; n >= 8; i += 8, n -= 8) {        // 8 bytes at a time
+        if (page->used[i >> 3] != 0xff)
+            added += page->used[i >> 3] ? __builtin_popcount((uint8_t)~page->used[i >> 3]) : 8;
+        page->used[i >> 3] = 0xff;
+    }
+    if (n) {
+        bits = (1u << n) - 1;
+        added += __builtin_popcount(bits & ~page->used[i >> 3]);
+        page->used[i >> 3] |= bits;
+    }
+    return added;
+}
+
+/**
+ * Set bytes, overwriting
+ *
+ * @return  false if out of memory
+ */
+bool IHEX_write(struct iheximage *image, uint32_t address, const uint8_t *data, size_t count)
+{
+    struct ihexpage *page;
+    unsigned i, n;
+
+    while (count) {
+        i = address & (IHEX_PAGE_SIZE - 1);
+        n = (count < IHEX_PAGE_SIZE - i) ? count : IHEX_PAGE_SIZE - i;
+        if (!(page = page_new(image, address))) return false;
+        memcpy(&page->data[i], data, n);
+        image->bytes += mark(page, i, n);
+        address += n;
+        data += n;
+        count -= n;
+    }
+    return true;
+}
+
+bool IHEX_get(const struct iheximage *image, uint32_t address, uint8_t *value)
+{
+    const struct ihexpage *page = page_get(image, address);
+    unsigned i = address & (IHEX_PAGE_SIZE - 1);
+
+    if (!page || !used(page, i)) return false;
+    *value = page->data[i];
+    return true;
+}
+
+/**
+ * @return  the first address from a where a byte is set (set = true) or not
+ *          set, TOP if none
+ */
+static uint64_t scan(const struct iheximage *image, uint64_t a, bool set)
+{
+    const struct ihexpage *page;
+    unsigned i;
+
+    while (a < TOP) {
+        if (!image->table[a >> (32 - IHEX_DIR_BITS)]) {
+            if (!set) return a;
+            a = (a | ((1ull << (32 - IHEX_DIR_BITS)) - 1)) + 1;
+            continue;
+        }
+        if (!(page = page_get(image, a))) {
+            if (!set) return a;
+            a = (a | (IHEX_PAGE_SIZE - 1)) + 1;
+            continue;
+        }
+        for (i = a & (IHEX_PAGE_SIZE - 1); i < IHEX_PAGE_SIZE; ) {
+            if (!(i & 7) && (page->used[i >> 3] == (set ? 0x00 : 0xff)))
+                i += 8;                     // 8 bytes at a time
+            else if (used(page, i) == set)
+                return (a & ~(uint64_t)(IHEX_PAGE_SIZE - 1)) + i;
+            else
+                i++;
+        }
+        a = (a | (IHEX_PAGE_SIZE - 1)) + 1;
+    }
+    return TOP;
+}
+
+/**
+ * The next run of bytes set
+ *
+ * @param address   from, then the start of the run
+ * @param end       end of the run (exclusive, 0 = the top of the space)
+ * @return          false if no byte is set from address
+ */
+bool IHEX_next(const struct iheximage *image, uint32_t *address, uint32_t *end)
+{
+    uint64_t a = scan(image, *address, true);
+
+    if (a == TOP) return false;
+    *address = a;
+    *end = (uint32_t)scan(image, a, false);
+    return true;
+}
+
+/**
+ * Copy bytes out, the bytes not set are taken from a pattern (aligned on
+ * its size, e.g. the erased value of a PIC16 word) or left as they are
+ *
+ * @return  number of bytes set in the image
+ */
+size_t IHEX_read(const struct iheximage *image, uint32_t address, uint8_t *data, size_t count, const uint8_t *pattern, unsigned size)
+{
+    const struct ihexpage *page;
+    size_t found = 0;
+    unsigned i;
+
+    for (; count; address++, data++, count--) {
+        i = address & (IHEX_PAGE_SIZE - 1);
+        page = page_get(image, address);
+        if (page && used(page, i)) {
+            *data = page->data[i];
+            found++;
+        }
+        else if (pattern)
+            *data = pattern[address % size];
+    }
+    return found;
+}
+
+/**
+ * Set the bytes not set in [address, end) from a pattern (aligned on its size)
+ *
+ * @return  number of bytes filled, -1 if out of memory
+ */
+unsigned long IHEX_fill(struct iheximage *image, uint32_t address, uint32_t end, const uint8_t *pattern, unsigned size)
+{
+    uint8_t block[IHEX_PAGE_SIZE];
+    unsigned long filled = 0;
+    uint64_t a = address, b;
+    unsigned i, n;
+
+    while (a < end) {
+        a = scan(image, a, false);
+        if (a >= end) break;
+        b = scan(image, a, true);
+        if (b > end) b = end;
+        for (; a < b; a += n) {             // a page at most at a time
+            n = ((b - a) < sizeof(block)) ? (unsigned)(b - a) : sizeof(block);
+            for (i = 0; i < n; i++)
+                block[i] = pattern[(a + i) % size];
+            if (!IHEX_write(image, a, block, n)) return -1;
+            filled += n;
+        }
+    }
+    return filled;
+}
+
+/**
+ * Copy the bytes set in src to dst; where both are set with different values,
+ * dst keeps its own unless overwrite is set
+ *
+ * @return  number of such conflicting bytes, -1 if out of memory
+ */
+unsigned long IHEX_merge(struct iheximage *dst, const struct iheximage *src, bool overwrite)
+{
+    unsigned long conflicts = 0;
+    const struct ihexpage *s;
+    struct ihexpage *d;
+    unsigned dir, p, i;
+    uint32_t a;
+
+    for (dir = 0; dir < PAGES; dir++) {
+        if (!src->table[dir]) continue;
+        for (p = 0; p < PAGES; p++) {
+            if (!(s = src->table[dir][p])) continue;
+            a = (uint32_t)(dir * PAGES + p) << IHEX_PAGE_BITS;
+            if (!(d = page_new(dst, a))) return -1;
+            for (i = 0; i < IHEX_PAGE_SIZE; i++) {
+                if (!used(s, i)) continue;
+                if (!used(d, i)) {
+                    d->used[i >> 3] |= 1 << (i & 7);
+                    dst->bytes++;
+                }
+                else if (d->data[i] != s->data[i]) {
+                    conflicts++;
+                    if (!overwrite) continue;
+                }
+                d->data[i] = s->data[i];
+            }
+        }
+    }
+    if (src->has_start && (overwrite || !dst->has_start)) {
+        dst->start = src->start;
+        dst->has_start = true;
+    }
+    return conflicts;
+}
+
+/**
+ * Compare two images, the runs of bytes set in one only or set to different
+ * values are reported in address order
+ *
+ * @param report    called for each run (end exclusive, 0 = the top), or NULL
+ * @return          number of bytes that differ
+ */
+unsigned long IHEX_diff(const struct iheximage *a, const struct iheximage *b, ihexdiff report, void *ctx)
+{
+    static const struct ihexpage blank;
+    const struct ihexpage *pa, *pb;
+    unsigned long differ = 0;
+    uint64_t start = TOP, addr;
+    unsigned dir, p, i;
+    bool d;
+
+    for (dir = 0; dir < PAGES; dir++) {
+        for (p = 0; p < PAGES; p++) {
+            pa = a->table[dir] ? a->table[dir][p] : NULL;
+            pb = b->table[dir] ? b->table[dir][p] : NULL;
+            addr = (uint64_t)(dir * PAGES + p) << IHEX_PAGE_BITS;
+            if (!pa && !pb) {
+                if ((start != TOP) && report) report(ctx, start, addr);
+                start = TOP;
+                if (!a->table[dir] && !b->table[dir]) break;
+                continue;
+            }
+            if (!pa) pa = &blank;
+            if (!pb) pb = &blank;
+            for (i = 0; i < IHEX_PAGE_SIZE; i++) {
+                d = (used(pa, i) != used(pb, i)) || (used(pa, i) && (pa->data[i] != pb->data[i]));
+                if (d) {
+                    differ++;
+                    if (start == TOP) start = addr + i;
+                }
+                else if (start != TOP) {
+                    if (report) report(ctx, start, addr + i);
+                    start = TOP;
+                }
+            }
+        }
+    }
+    if ((start != TOP) && report) report(ctx, start, 0);
+    return differ;
+}
+
+static void record(FILE *f, uint8_t type, uint16_t address, const uint8_t *data, unsigned count)
+{
+    uint8_t sum = count + (address >> 8) + address + type;
+    unsigned i;
+
+    fprintf(f, ":%02X%04X%02X", count, address, type);
+    for (i = 0; i < count; i++) {
+        fprintf(f, "%02X", data[i]);
+        sum += data[i];
+    }
+    fprintf(f, "%02X\n", (uint8_t)-sum);
+}
+
+/**
+ * Write the image as a hex file: data records of up to record_size bytes
+ * (within 64 KB pages), extended linear addresses and start linear address
+ *
+ * @return  false on a write error
+ */
+bool IHEX_save(const struct iheximage *image, FILE *f, unsigned record_size)
+{
+    uint8_t data[255], ela[2];
+    uint32_t address = 0, end, upper = 0;
+    unsigned n;
+
+    if ((record_size == 0) || (record_size > sizeof(data))) record_size = 16;
+    while (IHEX_next(image, &address, &end)) {
+        do {
+            if ((address >> 16) != upper) {
+                upper = address >> 16;
+                ela[0] = upper >> 8;
+                ela[1] = upper;
+                record(f, 4, 0, ela, 2);
+            }
+            n = 0x10000 - (address & 0xffff);   // up to the end of the 64 KB page
+            if (n > record_size) n = record_size;
+            if (end && (n > end - address)) n = end - address;
+            IHEX_read(image, address, data, n, NULL, 0);
+            record(f, 0, address, data, n);
+            address += n;
+        } while (address != end);
+        if (!address) break;                // the top of the space
+    }
+    if (image->has_start) {
+        data[0] = image->start >> 24;
+        data[1] = image->start >> 16;
+        data[2] = image->start >> 8;
+        data[3] = image->start;
+        record(f, 5, 0, data, 4);
+    }
+    record(f, 1, 0, NULL, 0);
+    return !ferror(f);
+}
+
+/**
+ * Image loader, the handler of IHEX_load()
+ */
+static bool load(void *ctx, const struct ihexrecord *r)
+{
+    struct iheximage *image = ctx;
+
+    switch (r->type) {
+        case 0:
+            return IHEX_write(image, r->address, r->data, r->count);
+        case 3:
+        case 5:
+            image->start = (uint32_t)r->data[0] << 24 | r->data[1] << 16 | r->data[2] << 8 | r->data[3];
+            image->has_start = true;
+            break;
+    }
+    return true;
+}
+
+/**
+ * Load a hex file into an image (added to its content)
+ *
+ * @param p     parser, for the error and its line, and to tell if the EOF
+ *              record was found
+ * @return      false on error
+ */
+bool IHEX_load(struct iheximage *image, const char *path, struct ihexparser *p)
+{
+    IHEX_init(p, load, image);
+    if (IHEX_parseFile(p, path)) return true;
+    if (!p->error) fail(p, IHEX_ERR_MEMORY);    // stopped by load()
+    return false;
+}
@@ -0,0 +1,109 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ Intel HEX library of the host tools
+
+ A streaming, table driven parser of the six record types (data, EOF,
+ extended segment address, start segment address, extended linear address,
+ start linear address) and a sparse image of the 32-bit address space, in
+ 4 KB pages indexed by a two level table, with the merge, diff and fill
+ operations. The files are memory mapped when possible, read in chunks
+ otherwise (pipes), the records are passed on as the lines complete.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#ifndef IHEX_H
+#define IHEX_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IHEX_LINE_MAX   (1 + 2 * (5 + 255) + 2)     // ':' + 255 data bytes + "\r\n"
+
+enum ihexerror {
+    IHEX_OK,
+    IHEX_ERR_SYNTAX,            // no ':' at the start of a line, not a hex digit
+    IHEX_ERR_LENGTH,            // byte count and line length disagree
+    IHEX_ERR_TYPE,              // unknown record type, or bad length for its type
+    IHEX_ERR_CHECKSUM,
+    IHEX_ERR_IO,                // see errno
+    IHEX_ERR_MEMORY
+};
+
+// a record, once checked; the address of a data record includes the last
+// extended (segment or linear) address
+struct ihexrecord {
+    uint8_t  type;              // 0..5
+    uint8_t  count;
+    uint32_t address;           // data record: absolute, others: the 16-bit field
+    const uint8_t *data;
+    unsigned line;
+};
+
+typedef bool (*ihexhandler)(void *ctx, const struct ihexrecord *record);  // false stops
+
+// streaming parser state, see IHEX_feed()
+struct ihexparser {
+    ihexhandler handler;
+    void *ctx;
+    uint32_t base;              // last extended segment/linear address
+    unsigned line;              // lines seen
+    bool eof;                   // EOF record seen, the rest is ignored
+    enum ihexerror error;
+    unsigned error_line;
+    unsigned carry;             // partial line kept between chunks
+    char carried[IHEX_LINE_MAX];
+};
+
+void IHEX_init(struct ihexparser *p, ihexhandler handler, void *ctx);
+bool IHEX_feed(struct ihexparser *p, const char *text, size_t size);   // false on error or stop
+bool IHEX_finish(struct ihexparser *p);  // a last line without end of line
+bool IHEX_parseFile(struct ihexparser *p, const char *path);    // "-" = stdin
+const char *IHEX_errorText(enum ihexerror error);
+
+/*
+ * Sparse image: each page holds its bytes and a bitmap of the bytes set;
+ * the untouched pages are not allocated
+ */
+#define IHEX_PAGE_BITS  12
+#define IHEX_PAGE_SIZE  (1u << IHEX_PAGE_BITS)
+#define IHEX_DIR_BITS   ((32 - IHEX_PAGE_BITS) / 2)     // 1024 x 1024 pages
+
+struct ihexpage {
+    uint8_t data[IHEX_PAGE_SIZE];
+    uint8_t used[IHEX_PAGE_SIZE / 8];
+};
+
+struct iheximage {
+    struct ihexpage **table[1u << IHEX_DIR_BITS];   // [directory][page]
+    uint32_t start;             // start address (03: CS << 16 | IP, 05: EIP)
+    bool has_start;
+    unsigned long bytes;        // bytes set
+};
+
+void IHEX_imageInit(struct iheximage *image);
+void IHEX_imageFree(struct iheximage *image);
+bool IHEX_load(struct iheximage *image, const char *path, struct ihexparser *p);   // p: error report
+bool IHEX_write(struct iheximage *image, uint32_t address, const uint8_t *data, size_t count);
+bool IHEX_get(const struct iheximage *image, uint32_t address, uint8_t *value);
+bool IHEX_next(const struct iheximage *image, uint32_t *address, uint32_t *end);
+size_t IHEX_read(const struct iheximage *image, uint32_t address, uint8_t *data, size_t count, const uint8_t *pattern, unsigned size);
+unsigned long IHEX_fill(struct iheximage *image, uint32_t address, uint32_t end, const uint8_t *pattern, unsigned size);
+unsigned long IHEX_merge(struct iheximage *dst, const struct iheximage *src, bool overwrite);
+typedef void (*ihexdiff)(void *ctx, uint32_t address, uint32_t end);
+unsigned long IHEX_diff(const struct iheximage *a, const struct iheximage *b, ihexdiff report, void *ctx);
+bool IHEX_save(const struct iheximage *image, FILE *f, unsigned record_size);
+
+#endif
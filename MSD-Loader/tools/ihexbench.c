@@ -0,0 +1,270 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ Intel HEX library benchmark
+
+ Times the parser of ihex.c on a multi-megabyte hex file, memory mapped and
+ streamed in chunks, against the line by line parsing the host tools used
+ before (fgets and a digit at a time), then loads the file in a sparse image
+ and times the fill, merge and diff operations on it. Without a file, one is
+ generated: random data in 16-byte records, with a 4 KB gap every 32 KB.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include "ihex.h"
+
+#define RUNS    3                       // best of
+
+static const uint8_t erased[2] = { 0xFF, 0x3F };   // PIC16 blank word
+
+static unsigned long records, data_bytes;
+static unsigned sum;                    // keeps the decoded bytes alive
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/**
+ * A hex file spanning size MB (7/8 of it data), in record_size byte records
+ */
+static int generate(const char *path, unsigned size, unsigned record_size)
+{
+    struct iheximage image;
+    uint8_t block[4096];
+    uint32_t a;
+    unsigned i;
+    FILE *f;
+    bool ok;
+
+    IHEX_imageInit(&image);
+    srand(1);
+    for (a = 0; a < size * 1048576u; a += sizeof(block)) {
+        if ((a / sizeof(block)) % 8 == 7) continue;
+        for (i = 0; i < sizeof(block); i++)
+            block[i] = rand();
+        if (!IHEX_write(&image, a, block, sizeof(block))) {
+            fprintf(stderr, "out of memory\n");
+            return -1;
+        }
+    }
+    image.start = 0;
+    image.has_start = true;
+    if (!(f = fopen(path, "w"))) {
+        perror(path);
+        return -1;
+    }
+    ok = IHEX_save(&image, f, record_size);
+    ok = !fclose(f) && ok;
+    IHEX_imageFree(&image);
+    if (!ok) perror(path);
+    return ok ? 0 : -1;
+}
+
+static bool count(void *ctx, const struct ihexrecord *r)
+{
+    (void)ctx;
+    records++;
+    if (r->type == 0) data_bytes += r->count;
+    return true;
+}
+
+// the line parser of the former host tools
+static unsigned readhex(const char *text, unsigned digits)
+{
+    unsigned result = 0;
+
+    while (digits--) {
+        result <<= 4;
+        if ((*text >= '0') && (*text <= '9'))
+            result += *text - '0';
+        else if ((*text >= 'A') && (*text <= 'F'))
+            result += *text - 'A' + 10;
+        else if ((*text >= 'a') && (*text <= 'f'))
+            result += *text - 'a' + 10;
+        text++;
+    }
+    return result;
+}
+
+static bool lines(const char *path)
+{
+    char line[IHEX_LINE_MAX + 1];
+    unsigned n, i;
+    FILE *f;
+
+    if (!(f = fopen(path, "r"))) return false;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] != ':') continue;
+        records++;
+        n = readhex(line + 1, 2);
+        if (readhex(line + 7, 2) != 0) continue;
+        for (i = 0; i < n; i++)
+            sum += readhex(line + 9 + 2 * i, 2);
+        data_bytes += n;
+    }
+    fclose(f);
+    return true;
+}
+
+static bool mapped(const char *path)
+{
+    struct ihexparser p;
+
+    IHEX_init(&p, count, NULL);
+    return IHEX_parseFile(&p, path);
+}
+
+static unsigned chunk = 65536;
+
+static bool streamed(const char *path)
+{
+    static char buffer[1 << 20];
+    struct ihexparser p;
+    bool ok = true;
+    ssize_t n;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) return false;
+    IHEX_init(&p, count, NULL);
+    while (ok && ((n = read(fd, buffer, chunk)) > 0))
+        ok = IHEX_feed(&p, buffer, n);
+    close(fd);
+    return ok && IHEX_finish(&p);
+}
+
+static double best(bool (*parse)(const char *), const char *path)
+{
+    double t, min = 0;
+    int i;
+
+    for (i = 0; i < RUNS; i++) {
+        records = data_bytes = 0;
+        t = now();
+        if (!parse(path)) {
+            fprintf(stderr, "%s: parse failed\n", path);
+            exit(-1);
+        }
+        t = now() - t;
+        if (!i || (t < min)) min = t;
+    }
+    return min;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "%s [-s MB] [-r record size] [file.hex]\n"
+                    "  -s MB      data generated when no file is given (default 16)\n"
+                    "  -r bytes   data bytes per generated record (default 16)\n",
+                    name);
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    char tmp[] = "/tmp/ihexbenchXXXXXX";
+    const char *path = NULL;
+    struct iheximage a, b;
+    struct ihexparser p;
+    unsigned size = 16, record_size = 16;
+    uint32_t low, high, end;
+    unsigned long n;
+    struct stat st;
+    double mb, t;
+    int i, fd;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-s") && (i + 1 < argc)) size = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-r") && (i + 1 < argc)) record_size = atoi(argv[++i]);
+        else if ((argv[i][0] != '-') && !path) path = argv[i];
+        else usage(argv[0]);
+    }
+    if (!path) {
+        if ((size == 0) || (size > 4095) || (record_size == 0) || (record_size > 255)) usage(argv[0]);
+        if ((fd = mkstemp(tmp)) < 0) {
+            perror(tmp);
+            return -1;
+        }
+        close(fd);
+        path = tmp;
+        t = now();
+        if (generate(path, size, record_size) < 0) {
+            unlink(tmp);
+            return -1;
+        }
+        printf("generated %u MB in %u-byte records (%.2f s)\n", size, record_size, now() - t);
+    }
+    if (stat(path, &st) < 0) {
+        perror(path);
+        return -1;
+    }
+    mb = st.st_size / 1048576.0;
+
+    printf("%s: %.1f MB of hex\n", path, mb);
+    printf("%-22s %10s %10s %12s\n", "parser", "ms", "MB/s", "records/s");
+    t = best(lines, path);
+    printf("%-22s %10.1f %10.1f %12.0f\n", "fgets + readhex", t * 1e3, mb / t, records / t);
+    t = best(mapped, path);
+    printf("%-22s %10.1f %10.1f %12.0f\n", "mapped", t * 1e3, mb / t, records / t);
+    t = best(streamed, path);
+    printf("%-22s %10.1f %10.1f %12.0f\n", "streamed, 64 KB", t * 1e3, mb / t, records / t);
+    chunk = 61;                         // lines split between the reads
+    t = best(streamed, path);
+    printf("%-22s %10.1f %10.1f %12.0f\n", "streamed, 61 bytes", t * 1e3, mb / t, records / t);
+    printf("%lu records, %lu data bytes\n", records, data_bytes);
+
+    IHEX_imageInit(&a);
+    IHEX_imageInit(&b);
+    t = now();
+    if (!IHEX_load(&a, path, &p)) {
+        fprintf(stderr, "%s: line %u: %s\n", path, p.error_line, IHEX_errorText(p.error));
+        return -1;
+    }
+    t = now() - t;
+    printf("%-22s %10.1f %10.1f\n", "load", t * 1e3, mb / t);
+
+    t = now();
+    n = IHEX_merge(&b, &a, false);
+    t = now() - t;
+    printf("%-22s %10.1f %10.1f  %lu conflicts\n", "merge", t * 1e3, a.bytes / 1048576.0 / t, n);
+
+    for (low = 0; low < a.bytes; low += 65536)  // a byte changed every 64 KB
+        IHEX_write(&b, low, (const uint8_t *)"\x5a", 1);
+    t = now();
+    n = IHEX_diff(&a, &b, NULL, NULL);
+    t = now() - t;
+    printf("%-22s %10.1f %10.1f  %lu bytes differ\n", "diff", t * 1e3, a.bytes / 1048576.0 / t, n);
+
+    for (high = 0, low = 0; IHEX_next(&b, &low, &end) && end; low = end)
+        high = end;
+    t = now();
+    n = IHEX_fill(&b, 0, high, erased, sizeof(erased));
+    t = now() - t;
+    printf("%-22s %10.1f %10.1f  %lu bytes filled\n", "fill", t * 1e3, high / 1048576.0 / t, n);
+
+    IHEX_imageFree(&a);
+    IHEX_imageFree(&b);
+    if (path == tmp) unlink(tmp);
+    return 0;
+}
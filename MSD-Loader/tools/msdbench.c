@@ -0,0 +1,170 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ MSD command overhead benchmark
+
+ Decodes a Linux usbmon text capture (/sys/kernel/debug/usb/usbmon/<bus>u) of
+ a file copy to the XPRESS drive and reports the number of CBWs, the FAT/ROOT
+ rewrites interleaved with the file data and the total bytes moved, for the
+ volume geometry given on the command line (see fileio_config.h)
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define SECTOR_SIZE     512
+#define CBW_SIZE        31
+#define CBW_SIGNATURE   0x55534243      // "USBC" as shown by usbmon
+
+#define OP_READ_10      0x28
+#define OP_WRITE_10     0x2a
+
+enum region { VBR, FAT, ROOT, DATA, REGIONS };
+static const char *region_name[REGIONS] = { "VBR", "FAT", "ROOT", "data" };
+
+// volume geometry, same defaults as fileio_config.h
+static unsigned capacity = 4096;        // DRV_CONFIG_DRIVE_CAPACITY
+static unsigned spc = 8;                // DRV_SECTORS_PER_CLUSTER
+static unsigned root_entries = 16;      // DRV_MAX_NUM_FILES_IN_ROOT
+static int fat16 = 0;                   // DRV_FAT16
+
+// first host LBA of each region (the host LBA 0 is the VBR)
+static uint32_t region_start[REGIONS];
+
+static unsigned long opcode_count[256];
+static unsigned long write_cmds[REGIONS], write_sectors[REGIONS];
+static unsigned long read_sectors;
+static unsigned long cbw_count, bytes_out, bytes_in;
+
+static void geometry(void)
+{
+    unsigned clusters = capacity / spc;
+    unsigned fat_bytes = fat16 ? (clusters + 2) * 2 : ((clusters + 2) * 3 + 1) / 2;
+    unsigned fat_sectors = (fat_bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+    region_start[VBR] = 0;
+    region_start[FAT] = 1;
+    region_start[ROOT] = region_start[FAT] + fat_sectors;
+    region_start[DATA] = region_start[ROOT] + (root_entries + 15) / 16;
+}
+
+static enum region region_of(uint32_t lba)
+{
+    int r;
+    for (r = DATA; r > VBR; r--)
+        if (lba >= region_start[r]) break;
+    return (enum region)r;
+}
+
+// account a WRITE(10), split at the region boundaries
+static void count_write(uint32_t lba, uint32_t blocks)
+{
+    enum region last = REGIONS;
+    while (blocks > 0) {
+        enum region r = region_of(lba);
+        uint32_t n = blocks;
+        if ((r < DATA) && (lba + n > region_start[r + 1]))
+            n = region_start[r + 1] - lba;
+        if (r != last) write_cmds[r]++;
+        write_sectors[r] += n;
+        last = r;
+        lba += n;
+        blocks -= n;
+    }
+}
+
+// decode a CBW from the usbmon data words (big endian groups of 4 bytes)
+static int decode_cbw(const char *words, uint8_t *cbw)
+{
+    unsigned n = 0, v;
+    while (n < CBW_SIZE) {
+        while (*words == ' ') words++;
+        if ((*words == '\0') || (*words == '\n')) break;
+        if (sscanf(words, "%2x", &v) != 1) return 0;
+        cbw[n++] = v;
+        words += 2;
+    }
+    return (n == CBW_SIZE) &&
+           (((uint32_t)cbw[0] << 24 | cbw[1] << 16 | cbw[2] << 8 | cbw[3]) == CBW_SIGNATURE);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "%s [-d devnum] [-c capacity] [-s sectors_per_cluster] [-r root_entries] [-16] < usbmon.txt\n", name);
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    char line[1024], type[16];
+    int devnum = -1, i;
+    unsigned bus, dev, ep, length;
+    uint8_t cbw[CBW_SIZE];
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-16")) fat16 = 1;
+        else if (i + 1 >= argc) usage(argv[0]);
+        else if (!strcmp(argv[i], "-d")) devnum = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-c")) capacity = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-s")) spc = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-r")) root_entries = atoi(argv[++i]);
+        else usage(argv[0]);
+    }
+    if ((spc == 0) || (capacity < spc)) usage(argv[0]);
+    geometry();
+
+    // usbmon text: tag timestamp event address status length data_tag data...
+    while (fgets(line, sizeof(line), stdin)) {
+        char *p;
+        if (sscanf(line, "%*s %*s S %15[^:]:%u:%u:%u %*s %u", type, &bus, &dev, &ep, &length) != 5)
+            continue;
+        if (strcmp(type, "Bo") || (length != CBW_SIZE)) continue;
+        if ((devnum >= 0) && ((int)dev != devnum)) continue;
+        if ((p = strstr(line, " = ")) == NULL) continue;
+        if (!decode_cbw(p + 3, cbw)) continue;
+
+        uint32_t data_length = cbw[8] | cbw[9] << 8 | cbw[10] << 16 | (uint32_t)cbw[11] << 24;
+        uint8_t *cb = &cbw[15];
+        cbw_count++;
+        opcode_count[cb[0]]++;
+        if (cbw[12] & 0x80) bytes_in += data_length;
+        else bytes_out += data_length;
+
+        if ((cb[0] == OP_WRITE_10) || (cb[0] == OP_READ_10)) {
+            uint32_t lba = (uint32_t)cb[2] << 24 | cb[3] << 16 | cb[4] << 8 | cb[5];
+            uint32_t blocks = cb[7] << 8 | cb[8];
+            if (cb[0] == OP_WRITE_10) count_write(lba, blocks);
+            else read_sectors += blocks;
+        }
+    }
+
+    printf("geometry          : %s, %u sectors, %u sectors/cluster, FAT at %u, ROOT at %u, data at %u\n",
+           fat16 ? "FAT16" : "FAT12", capacity, spc,
+           region_start[FAT], region_start[ROOT], region_start[DATA]);
+    printf("CBWs              : %lu\n", cbw_count);
+    printf("  READ(10)        : %lu (%lu sectors)\n", opcode_count[OP_READ_10], read_sectors);
+    printf("  WRITE(10)       : %lu\n", opcode_count[OP_WRITE_10]);
+    printf("  other           : %lu\n", cbw_count - opcode_count[OP_READ_10] - opcode_count[OP_WRITE_10]);
+    for (i = VBR; i < REGIONS; i++)
+        printf("writes to %-8s: %lu (%lu sectors)\n", region_name[i], write_cmds[i], write_sectors[i]);
+    printf("bytes OUT / IN    : %lu / %lu\n", bytes_out, bytes_in);
+    if (write_cmds[DATA])
+        printf("sectors/data write: %.1f\n", (double)write_sectors[DATA] / write_cmds[DATA]);
+    if (write_sectors[DATA])
+        printf("CBWs per data KB  : %.3f\n", cbw_count * 2.0 / write_sectors[DATA]);
+    return 0;
+}
@@ -0,0 +1,51 @@
+#!/bin/bash
+#
+# Copy a hex file to the XPRESS drive on a Linux host with async and sync
+# vfat mounts, capture the bulk traffic with usbmon and report the MSD
+# command overhead of each copy (see msdbench.c)
+#
+# usage: sudo ./msdbench.sh <file.hex> <sdX> [-m max_sectors] [msdbench options]
+#   -m max_sectors  limit the size of each READ/WRITE(10) (the usb-storage
+#                   driver does not read the Block Limits VPD page, this is
+#                   the host side equivalent of MSD_MAX_TRANSFER_LENGTH)
+#   msdbench options must match the firmware geometry (fileio_config.h)
+#
+set -e
+
+HEX=$1
+DISK=${2#/dev/}
+shift 2 || { echo "usage: $0 <file.hex> <sdX> [-m max_sectors] [msdbench options]"; exit 1; }
+if [ "$1" = "-m" ]; then
+    echo "$2" > /sys/block/$DISK/device/max_sectors
+    shift 2
+fi
+
+BENCH=$(dirname "$0")/msdbench
+MNT=$(mktemp -d)
+CAP=$(mktemp)
+
+# locate the USB device (bus and address) behind the block device
+DEV=$(readlink -f /sys/block/$DISK/device)
+while [ ! -f "$DEV/busnum" ]; do DEV=$(dirname "$DEV"); done
+BUS=$(cat $DEV/busnum)
+ADDR=$(cat $DEV/devnum)
+
+modprobe usbmon
+mountpoint -q /sys/kernel/debug || mount -t debugfs none /sys/kernel/debug
+
+for MODE in async sync; do
+    mount -t vfat -o $MODE /dev/$DISK $MNT
+    cat /sys/kernel/debug/usb/usbmon/${BUS}u > $CAP &
+    MON=$!
+    sleep 1
+    cp "$HEX" $MNT/
+    sync
+    umount $MNT
+    sleep 1
+    kill $MON
+    echo "=== $(basename "$HEX"), $MODE mount, max_sectors $(cat /sys/block/$DISK/device/max_sectors)"
+    $BENCH -d $ADDR "$@" < $CAP
+done
+
+rm -f $CAP
+rmdir $MNT
@@ -0,0 +1,413 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ MSD replay harness
+
+ Replays the bulk-only transport traffic of a host copying a file to the
+ XPRESS drive into the host build of the MSD class (usb_device_msd.c), the
+ FAT emulation and the LVP module of a configuration (see the Makefile,
+ target host), through the simulated SIE of sim/usb.c. The host side moves
+ one full speed packet at a time and retries the packets NAKed while the
+ firmware is busy (programming a row of the virtual target): the handling
+ time of each CBW, the time lost to NAKs and the duration of the copy are
+ reported in virtual time.
+
+ Trace format (text, one item per line, '#' starts a comment):
+   CBW <31 bytes in hex>         command block wrapper, followed by its OUT
+                                 data when the CBW announces any
+   DATA <bytes in hex>           OUT data
+   ZERO <count>                  OUT data, count zeros
+   FILE <path> <offset> <count>  OUT data read from a file (path relative to
+                                 the trace), zeros past its end
+   DELAY <ms>                    host idle time before the next CBW
+ The IN data is not part of the trace, it is produced by the firmware.
+ usbmon2replay.c converts usbmon captures of a Linux host to this format.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "target.h"
+#include "usb.h"
+#include "usb_device_msd.h"
+#include "app_device_msd.h"
+#include "direct.h"
+
+#define PACKET          64              // MSD_IN_EP_SIZE, MSD_OUT_EP_SIZE
+#define TIMEOUT         10000000000ull  // NAKs before the device is declared stuck (ns)
+
+#define OP_READ_10      0x28
+#define OP_WRITE_10     0x2a
+
+// full speed transaction, token, data and handshake packets (ns)
+#define BUS_NS(len)     (((len) + 13) * 2000ull / 3)
+
+enum item_type { CBW, OUT, DELAY };
+
+typedef struct {
+    enum item_type type;
+    unsigned line;
+    unsigned len;                       // bytes (CBW, OUT) or ms (DELAY)
+    uint8_t *data;
+} ITEM;
+
+typedef struct {
+    uint32_t tag;
+    uint8_t op;
+    uint32_t lba, blocks;               // READ(10), WRITE(10)
+    uint32_t bytes;                     // data phase, transferred
+    int status;                         // CSW status, -1 = no CSW
+    uint64_t start, time, nak;          // ns
+} CBW_STATS;
+
+static ITEM *items;
+static unsigned item_count;
+static uint64_t nak_retry = BUS_NS(0);  // a NAKed transaction takes an empty packet slot
+static unsigned long packets, naks, stalls;
+static uint64_t bus_time, nak_time;
+
+static void fail(const char *trace, unsigned line, const char *msg)
+{
+    fprintf(stderr, "%s:%u: %s\n", trace, line, msg);
+    exit(-1);
+}
+
+static ITEM *item_add(enum item_type type, unsigned line, unsigned len)
+{
+    items = realloc(items, (item_count + 1) * sizeof(ITEM));
+    if (!items) { perror("realloc"); exit(-1); }
+    items[item_count].type = type;
+    items[item_count].line = line;
+    items[item_count].len = len;
+    items[item_count].data = len && (type != DELAY) ? calloc(len, 1) : NULL;
+    return &items[item_count++];
+}
+
+// hex digits, optionally separated by spaces, up to the end of the line or a comment
+static unsigned hex_count(const char *s)
+{
+    unsigned n = 0;
+    for (; *s && (*s != '#'); s++)
+        if (*s > ' ') n++;
+    return n;
+}
+
+static int hex_read(const char *s, uint8_t *data)
+{
+    unsigned v, n = 0;
+    for (; *s && (*s != '#'); s++) {
+        if (*s <= ' ') continue;
+        if (sscanf(s, "%1x", &v) != 1) return 0;
+        data[n / 2] = (n & 1) ? data[n / 2] | v : v << 4;
+        n++;
+    }
+    return 1;
+}
+
+/**
+ * Load a trace, the OUT data items following a CBW are merged into one
+ */
+static void load(const char *trace)
+{
+    char line[4096], path[1024], *p;
+    unsigned number = 0, n;
+    long offset;
+    FILE *f, *file;
+    ITEM *item;
+
+    if (!(f = fopen(trace, "r"))) {
+        perror(trace);
+        exit(-1);
+    }
+    while (fgets(line, sizeof(line), f)) {
+        number++;
+        if (!strchr(line, '\n') && !feof(f)) fail(trace, number, "line too long");
+        for (p = line; (*p == ' ') || (*p == '\t'); p++);
+        if ((*p == '#') || (*p == '\r') || (*p == '\n') || !*p) continue;
+
+        if (!strncmp(p, "CBW ", 4)) {
+            if (hex_count(p + 4) != 2 * MSD_CBW_SIZE) fail(trace, number, "CBW: 31 bytes expected");
+            if (!hex_read(p + 4, item_add(CBW, number, MSD_CBW_SIZE)->data))
+                fail(trace, number, "CBW: bad hex digit");
+            continue;
+        }
+        if (!strncmp(p, "DELAY ", 6)) {
+            item_add(DELAY, number, atoi(p + 6));
+            continue;
+        }
+        if (!item_count || (items[item_count - 1].type == DELAY))
+            fail(trace, number, "OUT data without a CBW");
+        if (!strncmp(p, "DATA ", 5)) {
+            n = hex_count(p + 5);
+            if (n & 1) fail(trace, number, "DATA: odd number of hex digits");
+            item = item_add(OUT, number, n / 2);
+            if (!hex_read(p + 5, item->data)) fail(trace, number, "DATA: bad hex digit");
+        }
+        else if (!strncmp(p, "ZERO ", 5))
+            item_add(OUT, number, atoi(p + 5));
+        else if (sscanf(p, "FILE %1023s %ld %u", path, &offset, &n) == 3) {
+            char name[2048];
+            const char *slash = strrchr(trace, '/');
+            if ((path[0] != '/') && slash)
+                snprintf(name, sizeof(name), "%.*s/%s", (int)(slash - trace), trace, path);
+            else
+                snprintf(name, sizeof(name), "%s", path);
+            if (!(file = fopen(name, "rb"))) {
+                perror(name);
+                exit(-1);
+            }
+            item = item_add(OUT, number, n);
+            fseek(file, offset, SEEK_SET);
+            if (fread(item->data, 1, n, file)) {}     // zeros past the end
+            fclose(file);
+        }
+        else
+            fail(trace, number, "unknown item");
+
+        // merge with the OUT data of the same CBW
+        if ((item_count > 1) && (items[item_count - 2].type == OUT)) {
+            ITEM *prev = &items[item_count - 2];
+            item = &items[item_count - 1];
+            prev->data = realloc(prev->data, prev->len + item->len + 1);
+            if (item->len) memcpy(prev->data + prev->len, item->data, item->len);
+            prev->len += item->len;
+            free(item->data);
+            item_count--;
+        }
+    }
+    fclose(f);
+}
+
+/**
+ * One main loop pass of the firmware, the MSD part of it
+ */
+static void firmware(void)
+{
+    APP_DeviceMSDTasks();
+    DIRECT_Tasks();
+}
+
+/**
+ * Transfer one packet, retried while the endpoint NAKs: the firmware runs
+ * between the attempts and the time it takes (driving the target) is NAK
+ * time for the host, as is an idle retry interval
+ *
+ * @return  SIM_USB_ACK or SIM_USB_STALLED
+ */
+static int packet(uint8_t dir, uint8_t *data, uint8_t *len, CBW_STATS *cbw)
+{
+    uint64_t start = SIM_time, t;
+    int r;
+
+    for (;;) {
+        r = (dir == OUT_FROM_HOST) ? SIM_usbOut(MSD_DATA_OUT_EP, data, *len)
+                                   : SIM_usbIn(MSD_DATA_IN_EP, data, len);
+        if (r != SIM_USB_NAK) break;
+        t = SIM_time;
+        firmware();
+        if (SIM_time != t) continue;    // busy, NAKed meanwhile
+        r = (dir == OUT_FROM_HOST) ? SIM_usbOut(MSD_DATA_OUT_EP, data, *len)
+                                   : SIM_usbIn(MSD_DATA_IN_EP, data, len);
+        if (r != SIM_USB_NAK) break;
+        SIM_delay(nak_retry);
+        naks++;
+        if (SIM_time - start > TIMEOUT) {
+            fprintf(stderr, "CBW tag %08x: endpoint %s stuck, NAKed for %.0f ms\n",
+                    cbw->tag, (dir == OUT_FROM_HOST) ? "OUT" : "IN", (SIM_time - start) / 1e6);
+            exit(-1);
+        }
+    }
+    cbw->nak += SIM_time - start;
+    nak_time += SIM_time - start;
+    if (r == SIM_USB_STALLED) {
+        SIM_usbClearHalt((dir == OUT_FROM_HOST) ? MSD_DATA_OUT_EP : MSD_DATA_IN_EP, dir);
+        stalls++;
+        return r;
+    }
+    SIM_delay(BUS_NS(*len));
+    bus_time += BUS_NS(*len);
+    packets++;
+    return r;
+}
+
+/**
+ * Command, data and status stages of a CBW
+ */
+static void command(const ITEM *item, const ITEM *data, CBW_STATS *cbw)
+{
+    const uint8_t *w = item->data;
+    uint32_t length = w[8] | w[9] << 8 | w[10] << 16 | (uint32_t)w[11] << 24;
+    uint8_t buf[PACKET], len;
+    uint32_t done;
+
+    memset(cbw, 0, sizeof(*cbw));
+    cbw->tag = w[4] | w[5] << 8 | w[6] << 16 | (uint32_t)w[7] << 24;
+    cbw->op = w[15];
+    cbw->status = -1;
+    if ((cbw->op == OP_READ_10) || (cbw->op == OP_WRITE_10)) {
+        cbw->lba = (uint32_t)w[17] << 24 | w[18] << 16 | w[19] << 8 | w[20];
+        cbw->blocks = w[22] << 8 | w[23];
+    }
+    cbw->start = SIM_time;
+
+    memcpy(buf, w, MSD_CBW_SIZE);
+    len = MSD_CBW_SIZE;
+    if (packet(OUT_FROM_HOST, buf, &len, cbw) == SIM_USB_STALLED)
+        goto status;
+
+    if (length && (w[12] & 0x80)) {     // data IN, up to a short packet
+        for (done = 0; done < length; done += len) {
+            len = PACKET;
+            if (packet(IN_TO_HOST, buf, &len, cbw) == SIM_USB_STALLED) break;
+            cbw->bytes += len;
+            if (len < PACKET) break;
+        }
+    }
+    else if (length) {                  // data OUT, from the trace
+        if (!data || (data->len < length)) {
+            fprintf(stderr, "trace line %u: %u bytes of OUT data expected\n", item->line, length);
+            exit(-1);
+        }
+        for (done = 0; done < length; done += len) {
+            len = (length - done < PACKET) ? length - done : PACKET;
+            memcpy(buf, data->data + done, len);
+            if (packet(OUT_FROM_HOST, buf, &len, cbw) == SIM_USB_STALLED) break;
+            cbw->bytes += len;
+        }
+    }
+
+status:
+    len = PACKET;
+    if (packet(IN_TO_HOST, buf, &len, cbw) == SIM_USB_STALLED) {
+        len = PACKET;                   // a stalled data stage, the CSW follows
+        if (packet(IN_TO_HOST, buf, &len, cbw) == SIM_USB_STALLED) len = 0;
+    }
+    if ((len == MSD_CSW_SIZE)
+        && ((buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t)buf[3] << 24) == MSD_VALID_CSW_SIGNATURE)
+        && ((buf[4] | buf[5] << 8 | buf[6] << 16 | (uint32_t)buf[7] << 24) == cbw->tag))
+        cbw->status = buf[12];
+    cbw->time = SIM_time - cbw->start;
+}
+
+static const char *op_name(uint8_t op)
+{
+    switch (op) {
+        case 0x00: return "TEST UNIT READY";
+        case 0x03: return "REQUEST SENSE";
+        case 0x12: return "INQUIRY";
+        case 0x1a: return "MODE SENSE(6)";
+        case 0x1e: return "PREVENT ALLOW";
+        case 0x23: return "READ FORMAT CAP";
+        case 0x25: return "READ CAPACITY";
+        case 0x28: return "READ(10)";
+        case 0x2a: return "WRITE(10)";
+        case 0x35: return "SYNCHRONIZE CACHE";
+        case 0x5a: return "MODE SENSE(10)";
+        default:   return "other";
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "%s [-v] [-n ns] <trace>\n"
+                    "  -v     list the CBWs\n"
+                    "  -n ns  NAK retry interval (default %.0f ns)\n"
+                    "the hex file of a trace must match the target family of the configuration:\n"
+                    "traces/linux-pic16.trace for XPRESS_171x, XPRESS_18345 and XPRESS_18877,\n"
+                    "the other traces of traces/ (pic18-full.hex) for the PIC18 configurations\n",
+                    name, (double)BUS_NS(0));
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    CBW_STATS *cbw, *slowest = NULL;
+    uint64_t delays = 0, end, copy_start = 0, copy_end = 0;
+    unsigned count = 0, reads = 0, writes = 0, failed = 0, write_failed = 0, i;
+    unsigned long bytes_out = 0, bytes_in = 0;
+    int verbose = 0;
+    TARGET_STATS stats;
+
+    for (i = 1; (i < argc) && (argv[i][0] == '-'); i++) {
+        if (!strcmp(argv[i], "-v")) verbose = 1;
+        else if (!strcmp(argv[i], "-n") && (i + 1 < argc)) nak_retry = strtoull(argv[++i], NULL, 0);
+        else usage(argv[0]);
+    }
+    if ((i + 1 != argc) || !nak_retry)
+        usage(argv[0]);
+    load(argv[i]);
+
+    SIM_reset();
+    if (!TARGET_init(SIM_LVP)) {
+        fprintf(stderr, "no target model for lvp-%s.c\n", SIM_LVP);
+        return -1;
+    }
+    SIM_usbSIE = true;
+    APP_DeviceMSDInitialize();          // enumerated, configured
+
+    cbw = calloc(item_count, sizeof(CBW_STATS));
+    if (verbose)
+        printf("%5s %10s %-17s %8s %6s %7s %6s %9s %9s\n",
+               "#", "start_ms", "command", "lba", "blocks", "bytes", "status", "time_ms", "nak_ms");
+    for (i = 0; i < item_count; i++) {
+        if (items[i].type == DELAY) {   // the firmware keeps running
+            end = SIM_time + items[i].len * 1000000ull;
+            delays += items[i].len * 1000000ull;
+            while (SIM_time < end) {
+                firmware();
+                if (SIM_time < end)
+                    SIM_delay((end - SIM_time > 1000000) ? 1000000 : end - SIM_time);
+            }
+            continue;
+        }
+        if (items[i].type != CBW) continue;
+
+        CBW_STATS *c = &cbw[count++];
+        command(&items[i], ((i + 1 < item_count) && (items[i + 1].type == OUT)) ? &items[i + 1] : NULL, c);
+        if (c->op == OP_READ_10) reads++;
+        if (c->op == OP_WRITE_10) {
+            if (!writes++) copy_start = c->start;
+            copy_end = c->start + c->time;
+            if (c->status != 0) write_failed++;
+        }
+        if (items[i].data[12] & 0x80) bytes_in += c->bytes;
+        else bytes_out += c->bytes;
+        if (c->status != 0) failed++;
+        if (!slowest || (c->time > slowest->time)) slowest = c;
+        if (verbose) {
+            printf("%5u %10.3f %-17s ", count, c->start / 1e6, op_name(c->op));
+            if ((c->op == OP_READ_10) || (c->op == OP_WRITE_10))
+                printf("%8u %6u ", c->lba, c->blocks);
+            else
+                printf("%8s %6s ", "", "");
+            printf("%7u %6d %9.3f %9.3f\n", c->bytes, c->status, c->time / 1e6, c->nak / 1e6);
+        }
+    }
+    printf("%s: %u CBWs (%u READ(10), %u WRITE(10), %u other), %u failed, %lu stalls\n",
+           argv[argc - 1], count, reads, writes, count - reads - writes, failed, stalls);
+    printf("  data OUT / IN : %lu / %lu bytes\n", bytes_out, bytes_in);
+    printf("  bus           : %lu packets, %.3f ms\n", packets, bus_time / 1e6);
+    printf("  NAK           : %lu retries, %.3f ms\n", naks, nak_time / 1e6);
+    printf("  host delays   : %.3f ms\n", delays / 1e6);
+    printf("  total         : %.3f ms, copy (first to last WRITE(10)) %.3f ms\n",
+           SIM_time / 1e6, (copy_end - copy_start) / 1e6);
+    if (slowest)
+        printf("  slowest CBW   : #%u %s, %.3f ms (NAK %.3f ms)\n", (unsigned)(slowest - cbw) + 1,
+               op_name(slowest->op), slowest->time / 1e6, slowest->nak / 1e6);
+    TARGET_statsGet(&stats);
+    TARGET_report(stdout);
+    return (write_failed || stats.violations) ? 1 : 0;
+}
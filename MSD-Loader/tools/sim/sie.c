@@ -0,0 +1,138 @@
+/*
+ * Host simulation of the XPRESS board (tools/Makefile, host builds)
+ *
+ * Serial interface engine of the USB module, for the builds running the
+ * device stack of framework/usb (instead of the stand-ins of usb.c): the
+ * host side transactions go through the buffer descriptors the stack arms
+ * in the BDT and post USTAT and the interrupt flags as the module does, one
+ * transaction at a time (a single USTAT FIFO entry). The 16 bit buffer
+ * addresses of the BDT are indexes of the address table below, the staged
+ * sources convert their pointers with SIM_usbPhysical and SIM_usbVirtual.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xc.h>
+#include "usb.h"
+#include "sim.h"
+
+#if (USB_PING_PONG_MODE != USB_PING_PONG__FULL_PING_PONG)
+#error "sie.c models the full ping-pong mode of usb_config.h"
+#endif
+
+_Static_assert(sizeof(BDT_ENTRY) == 4, "BDT entries are 4 bytes (the stack toggles the pointers)");
+
+extern volatile BDT_ENTRY BDT[BDT_NUM_ENTRIES];
+
+#define ADDRESSES   64
+
+static const void *address[ADDRESSES];  // buffer addresses, 1 + index in the BDT
+static unsigned addresses;
+static uint8_t ppbi[USB_MAX_EP_NUMBER+1][2];    // next ping-pong buffer [ep][dir]
+static uint16_t frame;
+
+uint16_t SIM_usbPhysical(const void *p)
+{
+    unsigned i;
+
+    for (i = 0; i < addresses; i++)
+        if (address[i] == p) return i + 1;
+    if (addresses == ADDRESSES) {
+        fprintf(stderr, "sie: more than %u USB buffer addresses\n", ADDRESSES);
+        abort();
+    }
+    address[addresses++] = p;
+    return addresses;
+}
+
+void *SIM_usbVirtual(uint16_t adr)
+{
+    return adr ? (void *)address[adr - 1] : NULL;
+}
+
+bool SIM_usbReset(void)
+{
+    if (!UCONbits.USBEN || !UIEbits.URSTIE) return false;  // not attached yet
+    memset(ppbi, 0, sizeof(ppbi));
+    UIRbits.URSTIF = 1;
+    return true;
+}
+
+void SIM_usbFrame(void)
+{
+    if (!UCONbits.USBEN) return;
+    frame = (frame + 1) & 0x7ff;
+    UFRML = frame;
+    UFRMH = frame >> 8;
+    UIRbits.SOFIF = 1;
+}
+
+/**
+ * The buffer descriptor of the next transaction on an endpoint, NULL when
+ * the module cannot take it (bus reset not handled yet, USTAT not read yet,
+ * packet processing disabled after a SETUP or endpoint not enabled in that
+ * direction)
+ */
+static volatile BDT_ENTRY *entry(uint8_t ep, uint8_t dir)
+{
+    if (!UCONbits.USBEN || UIRbits.URSTIF || UCONbits.PKTDIS || UIRbits.TRNIF) return NULL;
+    if ((ep > USB_MAX_EP_NUMBER) || !(dir ? UEPbits[ep].EPINEN : UEPbits[ep].EPOUTEN)) return NULL;
+    return &BDT[ep * 4 + dir * 2 + ppbi[ep][dir]];
+}
+
+static void complete(uint8_t ep, uint8_t dir, volatile BDT_ENTRY *bd, uint8_t pid, uint8_t cnt)
+{
+    bd->CNT = cnt;
+    bd->STAT.Val = (bd->STAT.Val & _DTSMASK) | pid << 2;   // UOWN cleared
+    USTAT = ep << 3 | dir << 2 | ppbi[ep][dir] << 1;
+    ppbi[ep][dir] ^= 1;
+    UIRbits.TRNIF = 1;
+}
+
+int SIM_usbSetup(const uint8_t *setup)
+{
+    volatile BDT_ENTRY *bd = entry(0, OUT_FROM_HOST);
+
+    // a SETUP is never stalled, BSTALL only applies to the data packets
+    if (!bd || !bd->STAT.UOWN) return SIM_USB_NAK;
+    memcpy(SIM_usbVirtual(bd->ADR), setup, 8);
+    complete(0, OUT_FROM_HOST, bd, PID_SETUP, 8);
+    UCONbits.PKTDIS = 1;
+    // SET_CONFIGURATION: the stack resets the ping-pong pointers (PPBRST)
+    if ((setup[0] == 0x00) && (setup[1] == USB_REQUEST_SET_CONFIGURATION))
+        memset(ppbi, 0, sizeof(ppbi));
+    return SIM_USB_ACK;
+}
+
+int SIM_usbOut(uint8_t ep, const uint8_t *data, uint8_t len)
+{
+    volatile BDT_ENTRY *bd = entry(ep, OUT_FROM_HOST);
+
+    if (!bd || !bd->STAT.UOWN) return SIM_USB_NAK;
+    if (bd->STAT.BSTALL || UEPbits[ep].EPSTALL) {
+        UIRbits.STALLIF = 1;
+        return SIM_USB_STALLED;
+    }
+    if (len > bd->CNT) {
+        fprintf(stderr, "sie: EP%u OUT %u bytes, buffer of %u\n", ep, len, bd->CNT);
+        len = bd->CNT;
+    }
+    memcpy(SIM_usbVirtual(bd->ADR), data, len);
+    complete(ep, OUT_FROM_HOST, bd, PID_OUT, len);
+    return SIM_USB_ACK;
+}
+
+int SIM_usbIn(uint8_t ep, uint8_t *data, uint8_t *len)
+{
+    volatile BDT_ENTRY *bd = entry(ep, IN_TO_HOST);
+
+    if (!bd || !bd->STAT.UOWN) return SIM_USB_NAK;
+    if (bd->STAT.BSTALL || UEPbits[ep].EPSTALL) {
+        UIRbits.STALLIF = 1;
+        return SIM_USB_STALLED;
+    }
+    *len = bd->CNT;
+    memcpy(data, SIM_usbVirtual(bd->ADR), *len);
+    complete(ep, IN_TO_HOST, bd, PID_IN, *len);
+    return SIM_USB_ACK;
+}
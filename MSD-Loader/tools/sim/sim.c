@@ -0,0 +1,65 @@
+/*
+ * Host simulation of the XPRESS board (tools/Makefile, host builds)
+ *
+ * Register storage and virtual clock, see sim.h
+ */
+#define SIM_DEFINE_SFR
+#include <xc.h>
+#include "pinout.h"         // _XTAL_FREQ
+#include "sim.h"
+
+uint64_t SIM_time;
+void (*SIM_hook)(void);
+void (*SIM_timer1ISR)(void);
+
+static uint64_t timer1_ns, timer1_ticks;    // time Timer1 ran, ticks counted
+
+/**
+ * Advance Timer1 by the ticks of a delay, one overflow at a time
+ */
+static void timer1(uint64_t ns)
+{
+    uint64_t ticks;
+    uint32_t count, n;
+
+    timer1_ns += ns;
+    ticks = timer1_ns * (_XTAL_FREQ / 4 >> T1CONbits.T1CKPS) / 1000000000 - timer1_ticks;
+    timer1_ticks += ticks;
+    while (ticks) {
+        count = TMR1H << 8 | TMR1L;
+        n = (ticks < 0x10000 - count) ? ticks : 0x10000 - count;
+        count += n;
+        ticks -= n;
+        TMR1H = count >> 8;
+        TMR1L = count;
+        if (count == 0x10000) {
+            PIR1bits.TMR1IF = 1;
+            if (PIE1bits.TMR1IE && SIM_timer1ISR) SIM_timer1ISR();
+        }
+    }
+}
+
+void SIM_reset(void)
+{
+    TRISA = TRISB = TRISC = 0xff;   // all inputs
+    ANSELAbits.byte = ANSELBbits.byte = ANSELCbits.byte = 0xff;
+    LATA = LATB = LATC = 0;
+    PORTA = PORTB = PORTC = 0xff;   // pulled up
+    TXSTAbits.TRMT = 1;             // transmit shift register empty
+    SIM_time = 0;
+    timer1_ns = timer1_ticks = 0;
+}
+
+/**
+ * The output pins drive the port, then the hook sees the pins as they are
+ * at the end of the delay
+ */
+void SIM_delay(uint64_t ns)
+{
+    PORTA = (PORTA & TRISA) | (LATA & ~TRISA);
+    PORTB = (PORTB & TRISB) | (LATB & ~TRISB);
+    PORTC = (PORTC & TRISC) | (LATC & ~TRISC);
+    SIM_time += ns;
+    if (T1CONbits.TMR1ON) timer1(ns);
+    if (SIM_hook) SIM_hook();
+}
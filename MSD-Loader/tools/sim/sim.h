@@ -0,0 +1,44 @@
+/*
+ * Host simulation of the XPRESS board (tools/Makefile, host builds)
+ *
+ * Virtual clock advanced by the XC8 delays, the ICSP and UART routines
+ * delay between the edges they generate: the hook registered in SIM_hook
+ * is called on each delay, with the clock already advanced, so that a
+ * target model (or a trace recorder) sees the pins at that time.
+ */
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+extern uint64_t SIM_time;               // virtual time (ns)
+extern void (*SIM_hook)(void);
+
+// Timer1 counts Fosc/4 through its prescaler while TMR1ON, sets TMR1IF on
+// each overflow and then calls this handler if TMR1IE (the interrupt)
+extern void (*SIM_timer1ISR)(void);
+
+void SIM_delay(uint64_t ns);
+void SIM_reset(void);                   // power on values of the registers
+
+// USB transfers armed by the firmware (usb.c), completed on return unless
+// SIM_usbSIE is set, then completed by the host side calls below
+#define SIM_USB_STALL   0x80            // or'ed to dir: endpoint stalled
+extern void (*SIM_usbHook)(uint8_t ep, uint8_t dir, uint8_t *data, uint8_t len);
+extern bool SIM_usbSIE;
+
+enum { SIM_USB_ACK, SIM_USB_NAK, SIM_USB_STALLED };
+int SIM_usbOut(uint8_t ep, const uint8_t *data, uint8_t len);
+int SIM_usbIn(uint8_t ep, uint8_t *data, uint8_t *len);    // len: received
+void SIM_usbClearHalt(uint8_t ep, uint8_t dir);             // CLEAR_FEATURE
+
+// USB module under the device stack of framework/usb (sie.c, instead of
+// usb.c), same SIM_usbOut and SIM_usbIn: the stack handles CLEAR_FEATURE
+uint16_t SIM_usbPhysical(const void *p);    // ConvertToPhysicalAddress
+void *SIM_usbVirtual(uint16_t adr);         // ConvertToVirtualAddress
+bool SIM_usbReset(void);                    // false: not attached yet
+void SIM_usbFrame(void);                    // start of frame (1 ms)
+int SIM_usbSetup(const uint8_t *setup);     // SETUP packet, 8 bytes
+
+#endif
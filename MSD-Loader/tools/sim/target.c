@@ -0,0 +1,552 @@
+/*
+ * Host simulation of the XPRESS board (tools/Makefile, host builds)
+ *
+ * Virtual ICSP target, see target.h
+ *
+ * The pins are sampled at the end of each delay, the changes seen then took
+ * place at the end of the previous delay (the firmware code itself takes no
+ * virtual time). The data driven by the programmer is latched on the falling
+ * edges of ICSPCLK, the target drives its data after the rising edges.
+ */
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <xc.h>
+#include "pinout.h"
+#include "sim.h"
+#include "target.h"
+
+#define US              1000ull         // ns
+#define MS              1000000ull
+#define KEY             0x4D434850      // "MCHP"
+#define LATCH_MAX       128
+#define VIOLATIONS_SHOWN 20
+
+/*
+ * Timing parameters checked, by their symbols in the AC characteristics of
+ * the programming specifications (P1A TCKL, P1B TCKH, ..., the P numbers
+ * differ from one specification to the other). The edge timings are the
+ * minimums of the specification of a device, TPINT and TERAB the write and
+ * erase times of the device (devices[] below).
+ */
+enum param {
+    T_CKL, T_CKH, T_DS, T_DH, T_DLY, T_ENTS, T_ENTH, T_PINT, T_ERAB, T_NUM
+};
+
+static const char * const param_name[T_NUM] = {
+    "TCKL", "TCKH", "TDS", "TDH", "TDLY", "TENTS", "TENTH", "TPINT", "TERAB"
+};
+
+static const char * const param_text[T_NUM] = {
+    "clock low", "clock high", "data setup to clock low", "data hold after clock low",
+    "command/data delay", "nMCLR low to the key", "key to the first command",
+    "internally timed write", "bulk erase"
+};
+
+struct timing {
+    const char *spec;
+    uint64_t min[T_ENTH + 1];           // ns, T_CKL to T_ENTH
+};
+
+// PIC16F1 specifications, 6-bit commands (PIC16F171x, PIC16F183xx)
+static const struct timing timing_6bit = {
+    "PIC16F1 6-bit commands", { 100, 100, 100, 100, 1 * US, 100, 250 * US }
+};
+
+// 8-bit commands (PIC16F188xx, PIC18F K40/K42/Q10), same minimums so far
+static const struct timing timing_8bit = {
+    "8-bit commands", { 100, 100, 100, 100, 1 * US, 100, 250 * US }
+};
+
+enum op {
+    OP_KEY, OP_LOAD_CONFIG, OP_LOAD_ADDR, OP_RESET_ADDR, OP_INC_ADDR,
+    OP_LATCH, OP_LATCH_IA, OP_READ, OP_READ_IA, OP_BEGIN_PROG,
+    OP_PROG, OP_PROG_IA, OP_BULK_ERASE, OP_NUM
+};
+
+static const char * const op_name[OP_NUM] = {
+    "key", "LOAD_CONFIG", "LOAD_ADDRESS", "RESET_ADDRESS", "INC_ADDRESS",
+    "LATCH_DATA", "LATCH_DATA_IA", "READ_DATA", "READ_DATA_IA", "BEGIN_PROG",
+    "PROG_DATA", "PROG_DATA_IA", "BULK_ERASE"
+};
+
+struct cmd {
+    uint8_t code;
+    uint8_t op;
+    uint8_t payload;                    // bits, 0 = none
+};
+
+// 6-bit commands, Lsb first, 16-bit payloads (PIC16F171x)
+static const struct cmd cmd_16f171[] = {
+    { 0x00, OP_LOAD_CONFIG, 16 }, { 0x16, OP_RESET_ADDR, 0 },
+    { 0x06, OP_INC_ADDR, 0 },     { 0x02, OP_LATCH, 16 },
+    { 0x04, OP_READ, 16 },        { 0x08, OP_BEGIN_PROG, 0 },
+    { 0x09, OP_BULK_ERASE, 0 },   { 0, OP_NUM, 0 }
+};
+
+// PIC16F183xx: 6-bit commands, 24-bit address payload
+static const struct cmd cmd_16f183[] = {
+    { 0x00, OP_LOAD_CONFIG, 16 }, { 0x1D, OP_LOAD_ADDR, 24 },
+    { 0x16, OP_RESET_ADDR, 0 },   { 0x06, OP_INC_ADDR, 0 },
+    { 0x02, OP_LATCH, 16 },       { 0x22, OP_LATCH_IA, 16 },
+    { 0x04, OP_READ, 16 },        { 0x24, OP_READ_IA, 16 },
+    { 0x08, OP_BEGIN_PROG, 0 },   { 0x09, OP_BULK_ERASE, 0 },
+    { 0, OP_NUM, 0 }
+};
+
+// 8-bit commands, Msb first, 24-bit payloads (PIC16F188xx, PIC18F K40/K42)
+static const struct cmd cmd_8bit[] = {
+    { 0x80, OP_LOAD_ADDR, 24 },   { 0xF8, OP_INC_ADDR, 0 },
+    { 0x00, OP_LATCH, 24 },       { 0x02, OP_LATCH_IA, 24 },
+    { 0xFC, OP_READ, 24 },        { 0xFE, OP_READ_IA, 24 },
+    { 0xE0, OP_BEGIN_PROG, 0 },   { 0x18, OP_BULK_ERASE, 0 },
+    { 0, OP_NUM, 0 }
+};
+
+// PIC18F Q10: words programmed as they are loaded
+static const struct cmd cmd_8bit_q10[] = {
+    { 0x80, OP_LOAD_ADDR, 24 },   { 0xF8, OP_INC_ADDR, 0 },
+    { 0xC0, OP_PROG, 24 },        { 0xE0, OP_PROG_IA, 24 },
+    { 0xFC, OP_READ, 24 },        { 0xFE, OP_READ_IA, 24 },
+    { 0x18, OP_BULK_ERASE, 0 },   { 0, OP_NUM, 0 }
+};
+
+/*
+ * One entry per lvp-*.c module, same device and specification. The address
+ * is a word address on the PIC16, a byte address on the PIC18 (2 per word
+ * except in the data EE). From the configuration words on, the locations
+ * are programmed one at a time.
+ */
+static const struct device {
+    const char *lvp;
+    const char *part;
+    const struct timing *timing;
+    const struct cmd *cmds;
+    uint8_t  cmd_bits;
+    bool     msb_first;
+    uint8_t  key_clocks;
+    bool     pic18;
+    uint8_t  row;                       // latches (words)
+    uint16_t word_mask;
+    uint32_t addr_mask;
+    uint32_t flash_end;
+    uint32_t cfg_address;
+    uint32_t ee_address, ee_size;
+    uint64_t t_prog, t_cfg, t_ee, t_erase;
+} devices[] = {
+    { "171", "PIC16F1719", &timing_6bit, cmd_16f171, 6, false, 33, false, 32, 0x3fff, 0xffff,
+      0x4000, 0x8000, 0, 0, 2500 * US, 5 * MS, 0, 5 * MS },
+    { "183", "PIC16F18345", &timing_6bit, cmd_16f183, 6, false, 33, false, 32, 0x3fff, 0xffff,
+      0x2000, 0x8000, 0xF000, 0x100, 2500 * US, 5 * MS, 5 * MS, 5 * MS },
+    { "188", "PIC16F18877", &timing_8bit, cmd_8bit, 8, true, 32, false, 32, 0x3fff, 0xffff,
+      0x8000, 0x8000, 0xF000, 0x100, 2800 * US, 5600 * US, 5600 * US, 8400 * US },
+    { "18k40", "PIC18F67K40", &timing_8bit, cmd_8bit, 8, true, 32, true, 64, 0xffff, 0x3fffff,
+      0x20000, 0x300000, 0x310000, 0x400, 2800 * US, 5600 * US, 5600 * US, 25200 * US },
+    { "18k42", "PIC18F27K42", &timing_8bit, cmd_8bit, 8, true, 32, true, 32, 0xffff, 0x3fffff,
+      0x20000, 0x300000, 0x310000, 0x400, 2800 * US, 5600 * US, 5600 * US, 25200 * US },
+    // word and configuration times as used by lvp-18Q10.c
+    { "18Q10", "PIC18F47Q10", &timing_8bit, cmd_8bit_q10, 8, true, 32, true, 128, 0xffff, 0x3fffff,
+      0x20000, 0x300000, 0x310000, 0x400, 50 * US, 50 * US, 11 * MS, 75 * MS },
+};
+
+enum phase { P_IDLE, P_KEY, P_CMD, P_IN, P_OUT, P_LOCKED };
+
+static const struct device *dev;
+static uint16_t *mem;
+static uint16_t latch[LATCH_MAX];
+static uint32_t pc;
+
+// pin state, as of the previous sample
+static uint64_t last;
+static bool mclr = true, clk, dat, drove;
+
+static enum phase phase;
+static const struct cmd *cmd;
+static uint32_t shift, out;
+static uint8_t  bits;
+static uint64_t t_rise, t_fall, t_dat;
+static bool hold;                       // bit latched, data to be held (TDH)
+static enum param waiting = T_NUM;      // delay running before the next clock
+static uint64_t t_wait, wait_min;
+
+// statistics
+static unsigned sessions, violations, clocks, rows;
+static unsigned op_count[OP_NUM], op_bits[OP_NUM];
+static uint64_t t_session, t_lvp, t_busy;
+static uint32_t row_last = -1;          // row of the last word programmed (PROG_DATA)
+static unsigned param_count[T_NUM], param_violations[T_NUM];
+static int64_t  param_margin[T_NUM];    // smallest margin seen (ns)
+static uint64_t param_seen[T_NUM], param_min[T_NUM];    // observed, minimum then
+
+static void violation(uint64_t t, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (violations++ < VIOLATIONS_SHOWN) {
+        fprintf(stderr, "%12.6f ms  lvp-%s: ", t / 1e6, dev->lvp);
+        va_start(ap, fmt);
+        vfprintf(stderr, fmt, ap);
+        va_end(ap);
+        fprintf(stderr, "\n");
+    }
+}
+
+/**
+ * Check an observed timing against its minimum, keep the smallest margin
+ */
+static void check(uint64_t t, enum param p, uint64_t observed, uint64_t min, const char *when)
+{
+    int64_t margin = (int64_t)(observed - min);
+
+    if (!param_count[p]++ || (margin < param_margin[p])) {
+        param_margin[p] = margin;
+        param_seen[p] = observed;
+        param_min[p] = min;
+    }
+    if (observed < min) {
+        param_violations[p]++;
+        violation(t, "%s (%s) %llu ns, minimum %llu ns%s", param_name[p], param_text[p],
+                  (unsigned long long)observed, (unsigned long long)min, when);
+    }
+}
+
+/**
+ * Start a delay the programmer must wait before the next clock
+ */
+static void await(uint64_t t, enum param p, uint64_t min)
+{
+    waiting = p;
+    t_wait = t;
+    wait_min = min;
+}
+
+static bool is_ee(uint32_t a)
+{
+    return (a >= dev->ee_address) && (a < dev->ee_address + dev->ee_size);
+}
+
+static uint16_t erased(uint32_t a)
+{
+    return is_ee(a) ? 0xff : dev->word_mask;
+}
+
+static uint8_t step(uint32_t a)
+{
+    return (dev->pic18 && !is_ee(a)) ? 2 : 1;
+}
+
+static uint8_t latch_index(uint32_t a)
+{
+    return (a / step(a)) & (dev->row - 1);
+}
+
+static void busy(uint64_t t, uint64_t duration, enum param p)
+{
+    t_busy += duration;
+    await(t, p, duration);
+}
+
+static void write_location(uint64_t t, uint32_t a, uint16_t v)
+{
+    v &= erased(a);
+    if (is_ee(a))                       // erased before each write
+        mem[a] = v;
+    else {                              // blank latches leave the location as is
+        if ((v != erased(a)) && ((mem[a] & v) != v))
+            violation(t, "0x%06x programmed without erase", a);
+        mem[a] &= v;
+    }
+}
+
+static void program(uint64_t t)
+{
+    uint32_t base;
+    uint8_t i;
+
+    rows++;
+    if (pc >= dev->cfg_address) {       // one location at a time
+        write_location(t, pc, latch[latch_index(pc)]);
+        busy(t, is_ee(pc) ? dev->t_ee : dev->t_cfg, T_PINT);
+    }
+    else {
+        base = pc - latch_index(pc) * step(pc);
+        for (i = 0; i < dev->row; i++)
+            write_location(t, base + i * step(pc), latch[i]);
+        busy(t, dev->t_prog, T_PINT);
+    }
+    for (i = 0; i < dev->row; i++)
+        latch[i] = dev->word_mask;
+}
+
+static void bulk_erase(uint64_t t)
+{
+    uint32_t a;
+
+    for (a = 0; a <= dev->addr_mask; a++)
+        if ((a < dev->flash_end) || ((pc >= dev->cfg_address) && !is_ee(a)))
+            mem[a] = erased(a);
+    busy(t, dev->t_erase, T_ERAB);
+}
+
+/**
+ * Execute a command, once its payload (data) has been received or sent
+ */
+static void execute(uint64_t t, uint32_t data)
+{
+    await(t, T_DLY, dev->timing->min[T_DLY]);
+    switch (cmd->op) {
+    case OP_LOAD_CONFIG:
+        pc = dev->cfg_address;
+        latch[latch_index(pc)] = data;
+        break;
+    case OP_LOAD_ADDR:
+        pc = data & dev->addr_mask;
+        break;
+    case OP_RESET_ADDR:
+        pc = 0;
+        break;
+    case OP_LATCH:
+    case OP_LATCH_IA:
+        latch[latch_index(pc)] = data & dev->word_mask;
+        break;
+    case OP_BEGIN_PROG:
+        program(t);
+        break;
+    case OP_PROG:
+    case OP_PROG_IA:
+        if ((pc >= dev->cfg_address) || (pc - latch_index(pc) * step(pc) != row_last))
+            rows++;
+        row_last = pc - latch_index(pc) * step(pc);
+        write_location(t, pc, data);
+        busy(t, is_ee(pc) ? dev->t_ee : (pc >= dev->cfg_address) ? dev->t_cfg : dev->t_prog, T_PINT);
+        break;
+    case OP_BULK_ERASE:
+        bulk_erase(t);
+        break;
+    }
+    if ((cmd->op == OP_INC_ADDR) || (cmd->op == OP_LATCH_IA) || (cmd->op == OP_READ_IA)
+        || (cmd->op == OP_PROG_IA))
+        pc = (pc + step(pc)) & dev->addr_mask;
+    phase = P_CMD;
+    bits = 0;
+    shift = 0;
+}
+
+static void dispatch(uint64_t t)
+{
+    for (cmd = dev->cmds; cmd->op != OP_NUM; cmd++)
+        if (cmd->code == shift) break;
+    if (cmd->op == OP_NUM) {
+        violation(t, "unknown command 0x%02x", shift);
+        await(t, T_DLY, dev->timing->min[T_DLY]);
+        bits = 0;
+        shift = 0;
+        return;
+    }
+    op_count[cmd->op]++;
+    op_bits[cmd->op] += dev->cmd_bits + cmd->payload;
+    if (cmd->payload == 0) {
+        execute(t, 0);
+        return;
+    }
+    if ((cmd->op == OP_READ) || (cmd->op == OP_READ_IA)) {
+        phase = P_OUT;
+        out = (uint32_t)(mem[pc] & erased(pc)) << 1;    // start and stop bits
+    }
+    else
+        phase = P_IN;
+    await(t, T_DLY, dev->timing->min[T_DLY]);
+    bits = 0;
+    shift = 0;
+}
+
+static void shift_in(bool bit)
+{
+    if (dev->msb_first)
+        shift = (shift << 1) | bit;
+    else
+        shift |= (uint32_t)bit << bits;
+    bits++;
+}
+
+static void clock_rise(uint64_t t, bool driven)
+{
+    const uint64_t *min = dev->timing->min;
+
+    if (waiting != T_NUM) {
+        check(t, waiting, t - t_wait, wait_min, "");
+        waiting = T_NUM;
+    }
+    if ((phase == P_KEY) && (bits == 0))
+        check(t, T_ENTS, t - t_session, min[T_ENTS], "");
+    else
+        check(t, T_CKL, t - t_fall, min[T_CKL], "");
+    t_rise = t;
+    hold = false;
+    clocks++;
+    if (phase == P_OUT) {
+        uint8_t n = dev->msb_first ? cmd->payload - 1 - bits : bits;
+        if (driven)
+            violation(t, "%s bit %u driven by both ends", op_name[cmd->op], bits);
+        ICSP_DAT_IN = (out >> n) & 1;
+    }
+}
+
+static void clock_fall(uint64_t t, bool bit, bool driven)
+{
+    const uint64_t *min = dev->timing->min;
+    uint32_t mask;
+
+    check(t, T_CKH, t - t_rise, min[T_CKH], "");
+    if (driven && (phase != P_OUT)) {   // bit latched from the programmer
+        check(t, T_DS, t - t_dat, min[T_DS], "");
+        hold = true;
+    }
+    t_fall = t;
+    switch (phase) {
+    case P_KEY:
+        if (bits < 32) shift_in(bit);
+        else bits++;                    // 33rd clock of the PIC16F1 key
+        if (bits == dev->key_clocks) {
+            op_count[OP_KEY]++;
+            op_bits[OP_KEY] += bits;
+            if (shift != KEY) {
+                violation(t, "bad key 0x%08x", shift);
+                phase = P_LOCKED;
+                break;
+            }
+            phase = P_CMD;
+            bits = 0;
+            shift = 0;
+            await(t, T_ENTH, dev->timing->min[T_ENTH]);
+        }
+        break;
+    case P_CMD:
+        shift_in(bit);
+        if (bits == dev->cmd_bits) dispatch(t);
+        break;
+    case P_IN:
+        shift_in(bit);
+        if (bits == cmd->payload) {
+            mask = 1 | (1ul << (cmd->payload - 1));
+            if (shift & mask)
+                violation(t, "%s start/stop bit set", op_name[cmd->op]);
+            execute(t, (shift >> 1) & ((1ul << (cmd->payload - 2)) - 1));
+        }
+        break;
+    case P_OUT:
+        if (++bits == cmd->payload) execute(t, 0);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Sample the pins (SIM_hook), the changes took place at the previous sample
+ */
+static void sample(void)
+{
+    uint64_t t = last;
+    bool now_mclr = !((ICSP_TRIS_nMCLR == OUTPUT_PIN) && (ICSP_nMCLR == 0));
+    bool now_clk = (ICSP_TRIS_CLK == OUTPUT_PIN) && ICSP_CLK;
+    bool driven = (ICSP_TRIS_DAT == OUTPUT_PIN);
+    bool now_dat = driven ? ICSP_DAT : ICSP_DAT_IN;
+
+    last = SIM_time;
+    if (mclr && !now_mclr) {            // target held in reset
+        sessions++;
+        t_session = t;
+        pc = 0;
+        phase = P_KEY;
+        bits = 0;
+        shift = 0;
+        waiting = T_NUM;
+        hold = false;
+        t_fall = t;
+    }
+    else if (!mclr && now_mclr) {       // target released
+        if (waiting != T_NUM) {
+            check(t, waiting, t - t_wait, wait_min, ", target released");
+            waiting = T_NUM;
+        }
+        t_lvp += t - t_session;
+        phase = P_IDLE;
+    }
+    if (driven && (!drove || (dat != now_dat)))
+        t_dat = t;                      // data changed by the programmer
+    if ((phase != P_IDLE) && (phase != P_LOCKED)) {
+        if (clk && now_clk && driven && (dat != now_dat) && (phase != P_OUT))
+            violation(t, "data changed while the clock is high");
+        if (hold && !clk && drove && (t_dat == t)) {
+            check(t, T_DH, t - t_fall, dev->timing->min[T_DH], "");
+            hold = false;
+        }
+        if (!clk && now_clk) clock_rise(t, driven);
+        else if (clk && !now_clk) clock_fall(t, now_dat, driven);
+    }
+    mclr = now_mclr;
+    clk = now_clk;
+    dat = driven ? ICSP_DAT : ICSP_DAT_IN;
+    drove = driven;
+}
+
+bool TARGET_init(const char *lvp)
+{
+    uint32_t a;
+    uint8_t i;
+
+    for (dev = devices; dev < devices + sizeof(devices) / sizeof(devices[0]); dev++)
+        if (!strcmp(dev->lvp, lvp)) break;
+    if (dev == devices + sizeof(devices) / sizeof(devices[0])) return false;
+    mem = malloc((dev->addr_mask + 1) * sizeof(*mem));
+    if (!mem) return false;
+    for (a = 0; a <= dev->addr_mask; a++)
+        mem[a] = erased(a);
+    for (i = 0; i < dev->row; i++)
+        latch[i] = dev->word_mask;
+    SIM_hook = sample;
+    return true;
+}
+
+void TARGET_report(FILE *f)
+{
+    unsigned i;
+
+    sample();                           // changes since the last delay
+    fprintf(f, "target %s (lvp-%s.c): %u session(s), %.3f ms in LVP, %.3f ms writing/erasing\n",
+            dev->part, dev->lvp, sessions, t_lvp / 1e6, t_busy / 1e6);
+    fprintf(f, "  %-14s %8s %10s\n", "command", "count", "bits");
+    for (i = 0; i < OP_NUM; i++)
+        if (op_count[i])
+            fprintf(f, "  %-14s %8u %10u\n", op_name[i], op_count[i], op_bits[i]);
+    fprintf(f, "  %-14s %12s %12s %8s %10s  (%s)\n", "timing", "minimum us", "observed us",
+            "count", "violations", dev->timing->spec);
+    for (i = 0; i < T_NUM; i++)
+        if (param_count[i])
+            fprintf(f, "  %-14s %12.3f %12.3f %8u %10u\n", param_name[i], param_min[i] / 1e3,
+                    param_seen[i] / 1e3, param_count[i], param_violations[i]);
+    fprintf(f, "  %u rows written, %u clocks, %u protocol violation(s)\n", rows, clocks, violations);
+}
+
+void TARGET_statsGet(TARGET_STATS *stats)
+{
+    sample();
+    stats->sessions = sessions;
+    stats->clocks = clocks;
+    stats->rows = rows;
+    stats->violations = violations;
+    stats->lvp = t_lvp;
+    stats->busy = t_busy;
+}
+
+bool TARGET_inReset(void)
+{
+    sample();
+    return !mclr;
+}
+
+uint16_t TARGET_peek(uint32_t address)
+{
+    return mem[address & dev->addr_mask];
+}
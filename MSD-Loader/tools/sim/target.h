@@ -0,0 +1,31 @@
+/*
+ * Host simulation of the XPRESS board (tools/Makefile, host builds)
+ *
+ * Virtual ICSP target: watches the ICSP pins at each delay of the virtual
+ * clock (SIM_hook), decodes the LVP key, the commands and their payloads,
+ * keeps the target memory and checks the minimum protocol timings. It is
+ * the reference the LVP modules are measured and checked against.
+ */
+#ifndef TARGET_H
+#define TARGET_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    unsigned sessions;                  // LVP entries
+    unsigned clocks;                    // ICSPCLK pulses
+    unsigned rows;                      // rows written (config/EE: locations)
+    unsigned violations;
+    uint64_t lvp;                       // time in LVP (ns)
+    uint64_t busy;                      // minimum write and erase time (ns)
+} TARGET_STATS;
+
+bool TARGET_init(const char *lvp);      // lvp module name, e.g. "171"
+void TARGET_report(FILE *f);
+void TARGET_statsGet(TARGET_STATS *stats);
+uint16_t TARGET_peek(uint32_t address); // target address (word or byte)
+bool TARGET_inReset(void);              // nMCLR driven low
+
+#endif
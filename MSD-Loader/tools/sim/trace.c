@@ -0,0 +1,131 @@
+/*
+ * Host simulation of the XPRESS board (tools/Makefile, host builds)
+ *
+ * Pin trace recorder, see trace.h
+ *
+ * As in the target model, the changes seen at the end of a delay took place
+ * at its start (the firmware code itself takes no virtual time). ICSPCLK is
+ * high impedance (z) when the programmer does not drive it, ICSPDAT is the
+ * level on the line, ICSPDAT_OE tells which end drives it. The UART frames
+ * are queued ahead of the virtual clock and written in time order with the
+ * pin changes. The time scale is 1 ns.
+ */
+#include <stdio.h>
+#include <xc.h>
+#include "pinout.h"
+#include "sim.h"
+#include "trace.h"
+
+#define QUEUE   32                      // UART line changes ahead of the clock
+
+enum signal { S_MCLR, S_CLK, S_DAT, S_OE, S_TX, S_RTS, S_NUM };
+
+static const char * const signal_name[S_NUM] = {
+    "nMCLR", "ICSPCLK", "ICSPDAT", "ICSPDAT_OE", "UART_TX", "UART_RTS"
+};
+
+static FILE *vcd;
+static void (*chained)(void);           // the target model
+static uint64_t last, t_out;
+static char value[S_NUM];
+
+static struct { uint64_t t; char v; } queue[QUEUE];
+static unsigned head, tail;
+
+static void emit(uint64_t t, enum signal s, char v)
+{
+    if (value[s] == v) return;
+    value[s] = v;
+    if (t > t_out) {
+        fprintf(vcd, "#%llu\n", (unsigned long long)t);
+        t_out = t;
+    }
+    fprintf(vcd, "%c%c\n", v, '!' + s);
+}
+
+// UART line changes up to t
+static void uart(uint64_t t)
+{
+    for (; (tail != head) && (queue[tail % QUEUE].t <= t); tail++)
+        emit(queue[tail % QUEUE].t, S_TX, queue[tail % QUEUE].v);
+}
+
+static void pins(char *v)
+{
+    v[S_MCLR] = ((ICSP_TRIS_nMCLR == OUTPUT_PIN) && (ICSP_nMCLR == 0)) ? '0' : '1';
+    v[S_CLK] = (ICSP_TRIS_CLK == OUTPUT_PIN) ? '0' + ICSP_CLK : 'z';
+    v[S_OE] = (ICSP_TRIS_DAT == OUTPUT_PIN) ? '1' : '0';
+    v[S_DAT] = '0' + ((ICSP_TRIS_DAT == OUTPUT_PIN) ? ICSP_DAT : ICSP_DAT_IN);
+#ifdef UART_RTS
+    v[S_RTS] = '0' + UART_RTS;
+#else
+    v[S_RTS] = 'x';
+#endif
+}
+
+/**
+ * Sample the pins (SIM_hook) once the target has driven ICSPDAT
+ */
+static void sample(void)
+{
+    uint64_t t = last;
+    char v[S_NUM];
+    int s;
+
+    if (chained) chained();
+    last = SIM_time;
+    uart(t);
+    pins(v);
+    for (s = 0; s < S_NUM; s++)
+        if (s != S_TX) emit(t, s, v[s]);
+}
+
+bool TRACE_open(const char *path)
+{
+    int s;
+
+    vcd = fopen(path, "w");
+    if (!vcd) return false;
+    fprintf(vcd, "$version MSD-Loader %s (lvp-%s.c), host simulation $end\n", SIM_CONF, SIM_LVP);
+    fprintf(vcd, "$timescale 1ns $end\n$scope module %s $end\n", SIM_CONF);
+    for (s = 0; s < S_NUM; s++)
+        fprintf(vcd, "$var wire 1 %c %s $end\n", '!' + s, signal_name[s]);
+    fprintf(vcd, "$upscope $end\n$enddefinitions $end\n");
+
+    last = t_out = SIM_time;
+    pins(value);
+    value[S_TX] = '1';                  // idle
+    fprintf(vcd, "#%llu\n$dumpvars\n", (unsigned long long)t_out);
+    for (s = 0; s < S_NUM; s++)
+        fprintf(vcd, "%c%c\n", value[s], '!' + s);
+    fprintf(vcd, "$end\n");
+    chained = SIM_hook;
+    SIM_hook = sample;
+    return true;
+}
+
+void TRACE_uart(uint8_t c, uint64_t start, uint64_t bit)
+{
+    int i;
+
+    if (!vcd) return;
+    for (i = 0; i < 10; i++) {          // start bit, 8 data bits Lsb first, stop bit
+        if (head - tail == QUEUE)
+            uart(queue[tail % QUEUE].t);    // frames queued faster than sent
+        queue[head % QUEUE].t = start + i * bit;
+        queue[head % QUEUE].v = (i == 0) ? '0' : (i == 9) ? '1' : '0' + ((c >> (i - 1)) & 1);
+        head++;
+    }
+}
+
+void TRACE_close(void)
+{
+    if (!vcd) return;
+    sample();                           // changes since the last delay
+    uart(-1);
+    if (SIM_time > t_out)
+        fprintf(vcd, "#%llu\n", (unsigned long long)SIM_time);
+    fclose(vcd);
+    vcd = NULL;
+    SIM_hook = chained;
+}
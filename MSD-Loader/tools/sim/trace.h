@@ -0,0 +1,19 @@
+/*
+ * Host simulation of the XPRESS board (tools/Makefile, host builds)
+ *
+ * Pin trace recorder: the ICSP pins, sampled after the virtual target at
+ * each delay of the virtual clock, and the frames of the EUSART transmitter
+ * are written with their virtual time stamps as a VCD file, to be viewed
+ * in GTKWave next to the timing report of the target (sim/target.c).
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+bool TRACE_open(const char *path);      // after TARGET_init (chains SIM_hook)
+void TRACE_uart(uint8_t c, uint64_t start, uint64_t bit);  // 8N1 frame, times in ns
+void TRACE_close(void);
+
+#endif
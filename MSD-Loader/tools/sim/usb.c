@@ -0,0 +1,115 @@
+/*
+ * Host simulation of the XPRESS board (tools/Makefile, host builds)
+ *
+ * Stand-ins for the USB device stack (usb_device.c): by default the transfers
+ * complete as soon as they are armed and are passed to SIM_usbHook. With
+ * SIM_usbSIE set, the buffer descriptors stay owned by the (simulated) SIE
+ * until the host side transfers a packet with SIM_usbOut or SIM_usbIn, the
+ * two ping-pong buffers of each endpoint are used in turn as on the PIC.
+ * The 1ms tick (SOF count on the device) follows the virtual clock.
+ */
+#include <string.h>
+#include <xc.h>
+#include "usb.h"
+#include "sim.h"
+
+USB_VOLATILE USB_DEVICE_STATE USBDeviceState = CONFIGURED_STATE;
+volatile BDT_ENTRY *pBDTEntryOut[USB_MAX_EP_NUMBER+1];
+volatile BDT_ENTRY *pBDTEntryIn[USB_MAX_EP_NUMBER+1];
+USB_VOLATILE IN_PIPE inPipes[1];
+USB_VOLATILE OUT_PIPE outPipes[1];
+volatile CTRL_TRF_SETUP SetupPkt;
+volatile uint8_t CtrlTrfData[USB_EP0_BUFF_SIZE];
+
+void (*SIM_usbHook)(uint8_t ep, uint8_t dir, uint8_t *data, uint8_t len);
+bool SIM_usbSIE;
+
+static struct {
+    BDT_ENTRY bd[2];                    // even and odd buffer descriptors
+    uint8_t *adr[2];                    // buffer of each descriptor
+    uint8_t next;                       // descriptor the SIE completes next
+    bool stalled;
+} pipe[USB_MAX_EP_NUMBER+1][2];         // [ep][OUT_FROM_HOST, IN_TO_HOST]
+
+uint32_t USBGet1msTickCount(void)
+{
+    return (uint32_t)(SIM_time / 1000000);
+}
+
+USB_HANDLE USBTransferOnePacket(uint8_t ep, uint8_t dir, uint8_t *data, uint8_t len)
+{
+    volatile BDT_ENTRY **entry = dir ? &pBDTEntryIn[ep] : &pBDTEntryOut[ep];
+    BDT_ENTRY *bd = pipe[ep][dir ? 1 : 0].bd;
+    BDT_ENTRY *handle;
+    uint8_t odd;
+
+    if (!SIM_usbSIE) {
+        handle = &bd[0];
+        handle->STAT.Val = 0;           // not owned by the SIE: already complete
+        handle->CNT = len;
+        if (SIM_usbHook) SIM_usbHook(ep, dir, data, len);
+        return (USB_HANDLE)handle;
+    }
+    if (*entry == 0) return 0;          // endpoint not enabled
+    handle = (BDT_ENTRY*)*entry;
+    odd = (handle == &bd[1]);
+    pipe[ep][dir ? 1 : 0].adr[odd] = data;
+    handle->CNT = len;
+    handle->STAT.Val = _USIE;           // armed, until the host transfers it
+    *entry = &bd[odd ^ 1];              // ping-pong
+    return (USB_HANDLE)handle;
+}
+
+void USBEnableEndpoint(uint8_t ep, uint8_t options)
+{
+    memset(pipe[ep], 0, sizeof(pipe[ep]));
+    if (options & USB_OUT_ENABLED) pBDTEntryOut[ep] = &pipe[ep][0].bd[0];
+    if (options & USB_IN_ENABLED) pBDTEntryIn[ep] = &pipe[ep][1].bd[0];
+}
+
+void USBStallEndpoint(uint8_t ep, uint8_t dir)
+{
+    if (SIM_usbSIE) pipe[ep][dir ? 1 : 0].stalled = true;
+    if (SIM_usbHook) SIM_usbHook(ep, dir | SIM_USB_STALL, 0, 0);
+}
+
+/**
+ * Host side of the simulated SIE: transfer one packet with the descriptor
+ * the SIE completes next, if the firmware has armed it
+ */
+static int transfer(uint8_t ep, uint8_t dir, uint8_t *data, uint8_t *len)
+{
+    BDT_ENTRY *bd = &pipe[ep][dir].bd[pipe[ep][dir].next];
+    uint8_t *adr = pipe[ep][dir].adr[pipe[ep][dir].next];
+
+    if (pipe[ep][dir].stalled) return SIM_USB_STALLED;
+    if (!bd->STAT.UOWN) return SIM_USB_NAK;
+    if (dir == OUT_FROM_HOST) {
+        if (*len > bd->CNT) *len = bd->CNT;     // babble, truncated
+        memcpy(adr, data, *len);
+        bd->CNT = *len;
+    }
+    else {
+        *len = bd->CNT;
+        memcpy(data, adr, *len);
+    }
+    bd->STAT.Val = 0;                   // back to the firmware
+    pipe[ep][dir].next ^= 1;
+    if (SIM_usbHook) SIM_usbHook(ep, dir, adr, *len);
+    return SIM_USB_ACK;
+}
+
+int SIM_usbOut(uint8_t ep, const uint8_t *data, uint8_t len)
+{
+    return transfer(ep, OUT_FROM_HOST, (uint8_t*)data, &len);
+}
+
+int SIM_usbIn(uint8_t ep, uint8_t *data, uint8_t *len)
+{
+    return transfer(ep, IN_TO_HOST, data, len);
+}
+
+void SIM_usbClearHalt(uint8_t ep, uint8_t dir)
+{
+    pipe[ep][dir ? 1 : 0].stalled = false;
+}
@@ -0,0 +1,106 @@
+/*
+ * xc.h stand-in for the host builds of the firmware (tools/Makefile)
+ *
+ * The special function registers used by the firmware are plain variables
+ * (defined in sim.c), a register and its bit fields share the same byte.
+ * The XC8 delays advance the virtual clock of sim.c instead of spinning.
+ */
+#ifndef XC_H
+#define XC_H
+
+#include <stdint.h>
+#include "sim.h"
+
+typedef uint32_t uint24_t;
+typedef int32_t int24_t;
+
+#define __delay_us(x)   SIM_delay((uint64_t)(x) * 1000)
+#define __delay_ms(x)   SIM_delay((uint64_t)(x) * 1000000)
+#define interrupt
+#define NOP()
+#define CLRWDT()
+#define di()
+#define ei()
+
+#ifdef SIM_DEFINE_SFR
+#define SIM_EXTERN
+#else
+#define SIM_EXTERN extern
+#endif
+
+#define SIM_SFR(name, ...) \
+    typedef union { uint8_t byte; struct { unsigned __VA_ARGS__; }; } name##bits_t; \
+    SIM_EXTERN volatile name##bits_t name##bits
+#define SIM_PORT(name, bit) \
+    SIM_SFR(name, bit##0:1, bit##1:1, bit##2:1, bit##3:1, bit##4:1, bit##5:1, bit##6:1, bit##7:1)
+
+// I/O ports
+SIM_PORT(PORTA, RA);
+SIM_PORT(PORTB, RB);
+SIM_PORT(PORTC, RC);
+SIM_PORT(LATA, LATA);
+SIM_PORT(LATB, LATB);
+SIM_PORT(LATC, LATC);
+SIM_PORT(TRISA, TRISA);
+SIM_PORT(TRISB, TRISB);
+SIM_PORT(TRISC, TRISC);
+SIM_PORT(ANSELA, ANSA);
+SIM_PORT(ANSELB, ANSB);
+SIM_PORT(ANSELC, ANSC);
+#define PORTA       PORTAbits.byte
+#define PORTB       PORTBbits.byte
+#define PORTC       PORTCbits.byte
+#define LATA        LATAbits.byte
+#define LATB        LATBbits.byte
+#define LATC        LATCbits.byte
+#define TRISA       TRISAbits.byte
+#define TRISB       TRISBbits.byte
+#define TRISC       TRISCbits.byte
+
+// EUSART, Timer1, interrupts, oscillator
+SIM_SFR(TXSTA, TX9D:1, TRMT:1, BRGH:1, SENDB:1, SYNC:1, TXEN:1, TX9:1, CSRC:1);
+SIM_SFR(RCSTA, RX9D:1, OERR:1, FERR:1, ADDEN:1, CREN:1, SREN:1, RX9:1, SPEN:1);
+SIM_SFR(BAUDCON, ABDEN:1, WUE:1, :1, BRG16:1, SCKP:1, :1, RCIDL:1, ABDOVF:1);
+SIM_SFR(T1CON, TMR1ON:1, :1, nT1SYNC:1, T1OSCEN:1, T1CKPS:2, TMR1CS:2);
+SIM_SFR(PIR1, TMR1IF:1, TMR2IF:1, :1, SSP1IF:1, TXIF:1, RCIF:1, ADIF:1, TMR1GIF:1);
+SIM_SFR(PIE1, TMR1IE:1, TMR2IE:1, :1, SSP1IE:1, TXIE:1, RCIE:1, ADIE:1, TMR1GIE:1);
+SIM_SFR(PIR2, :2, USBIF:1, BCL1IF:1, :3, OSFIF:1);
+SIM_SFR(PIE2, :2, USBIE:1, BCL1IE:1, :3, OSFIE:1);
+SIM_SFR(INTCON, IOCIF:1, INTF:1, TMR0IF:1, IOCIE:1, INTE:1, TMR0IE:1, PEIE:1, GIE:1);
+SIM_SFR(OSCCON, SCS:2, :1, IRCF:4, SPLLMULT:1);
+#define TXSTA       TXSTAbits.byte
+#define RCSTA       RCSTAbits.byte
+#define BAUDCON     BAUDCONbits.byte
+#define T1CON       T1CONbits.byte
+#define PIR1        PIR1bits.byte
+#define PIE1        PIE1bits.byte
+#define INTCON      INTCONbits.byte
+
+SIM_EXTERN volatile uint8_t SPBRG, SPBRGH, RCREG, TXREG, TMR1L, TMR1H, ACTCON;
+
+// USB module
+SIM_SFR(UCON, :1, SUSPND:1, RESUME:1, USBEN:1, PKTDIS:1, SE0:1, PPBRST:1, :1);
+SIM_SFR(UIR, URSTIF:1, UERRIF:1, ACTVIF:1, TRNIF:1, IDLEIF:1, STALLIF:1, SOFIF:1, :1);
+SIM_SFR(UIE, URSTIE:1, UERRIE:1, ACTVIE:1, TRNIE:1, IDLEIE:1, STALLIE:1, SOFIE:1, :1);
+SIM_SFR(UCFG, PPB:2, FSEN:1, UTRDIS:1, :2, UPUEN:1, UTEYE:1);
+#define UCON        UCONbits.byte
+#define UIR         UIRbits.byte
+#define UIE         UIEbits.byte
+#define UCFG        UCFGbits.byte
+
+SIM_EXTERN volatile uint8_t UEIR, UEIE, UADDR, USTAT, UFRML, UFRMH;
+
+// endpoint control registers, contiguous as the stack indexes them from UEP0
+typedef union { uint8_t byte; struct { uint8_t EPSTALL:1, EPINEN:1, EPOUTEN:1, EPCONDIS:1, EPHSHK:1, :3; }; } UEPbits_t;
+SIM_EXTERN volatile UEPbits_t UEPbits[8];
+#define UEP0        UEPbits[0].byte
+#define UEP1        UEPbits[1].byte
+#define UEP2        UEPbits[2].byte
+#define UEP3        UEPbits[3].byte
+#define UEP4        UEPbits[4].byte
+#define UEP5        UEPbits[5].byte
+#define UEP6        UEPbits[6].byte
+#define UEP7        UEPbits[7].byte
+#define UEP0bits    UEPbits[0]
+
+#endif
@@ -0,0 +1,285 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ Telemetry monitor
+
+ Polls the telemetry vendor requests of the XPRESS firmware on EP0 (see
+ stats.h, sent through usbfs): build and configuration, programming and UART
+ counters with the last error, hot path stage times and main loop statistics.
+ They need no bulk bandwidth and are answered while the drive is busy. With
+ -l, one CSV line of counters is printed per poll, for station monitoring.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <dirent.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/usbdevice_fs.h>
+
+#define VENDOR_ID           0x04d8      // usb_descriptors.c
+#define PRODUCT_ID          0x0057
+
+#define GET_LOOP            0x41        // STATS_VENDOR_GET_..
+#define GET_INFO            0x42
+#define GET_COUNTERS        0x43
+#define GET_STAGES          0x44
+
+#define FEATURE_PROFILE     0x01        // STATS_FEATURE_..
+#define FEATURE_TARGET_HEX  0x02
+#define FEATURE_UART_SHARED 0x04
+#define FEATURE_FLOW_CONTROL 0x08
+
+static const char * const feature_name[] = { "profile", "TARGET.HEX", "shared UART", "flow control" };
+static const char * const stage_name[] = { "MSDWrite", "ParseHex", "packRow", "commitRow", "rowWrite", "bulkErase" };
+static const char * const task_name[] = { "USB", "main", "MSD", "DIRECT", "CDC" };
+static const char * const error_name[] = { "none", "syntax", "length", "record type", "checksum", "verify" };
+
+#define NAME(table, i)  (((unsigned)(i) < sizeof(table) / sizeof(table[0])) ? table[i] : "?")
+
+static struct {
+    unsigned major, minor, year, month, day, features;
+    uint32_t flash, ee, hz;
+    unsigned stages, buckets, tasks;
+} info;
+
+static uint32_t get(const uint8_t *p, int size)
+{
+    uint32_t v = 0;
+
+    while (size-- > 0)
+        v = v << 8 | p[size];
+    return v;
+}
+
+/**
+ * One telemetry request
+ *
+ * @return  number of bytes received, -1 if not answered (stalled)
+ */
+static int request(int fd, uint8_t code, uint16_t value, uint8_t *data, uint16_t size)
+{
+    struct usbdevfs_ctrltransfer ctrl = {
+        .bRequestType = 0xc0,           // vendor, device, IN
+        .bRequest = code,
+        .wValue = value,
+        .wLength = size,
+        .timeout = 1000,
+        .data = data,
+    };
+
+    return ioctl(fd, USBDEVFS_CONTROL, &ctrl);
+}
+
+/**
+ * The usbfs node of the first XPRESS device, or of the device behind a tty
+ */
+static int find(const char *tty, char *path, size_t size)
+{
+    // a tty name, a usb device directory: one NAME_MAX field each
+    char name[sizeof("/sys/class/tty//device/..") + NAME_MAX];
+    char file[sizeof(name) + sizeof("/sys/bus/usb/devices//idProduct") + NAME_MAX];
+    const char *base = "/sys/bus/usb/devices";
+    unsigned id[4];
+    struct dirent *d;
+    DIR *dir;
+    FILE *f;
+    int i;
+
+    if (tty) {
+        const char *slash = strrchr(tty, '/');
+        snprintf(name, sizeof(name), "/sys/class/tty/%s/device/..", slash ? slash + 1 : tty);
+        snprintf(file, sizeof(file), "%s/busnum", name);
+        if (!(f = fopen(file, "r")) || (fscanf(f, "%u", &id[2]) != 1)) goto fail;
+        fclose(f);
+        snprintf(file, sizeof(file), "%s/devnum", name);
+        if (!(f = fopen(file, "r")) || (fscanf(f, "%u", &id[3]) != 1)) goto fail;
+        fclose(f);
+        snprintf(path, size, "/dev/bus/usb/%03u/%03u", id[2], id[3]);
+        return 0;
+fail:
+        if (f) fclose(f);
+        fprintf(stderr, "%s: not a USB serial port\n", tty);
+        return -1;
+    }
+
+    if (!(dir = opendir(base))) {
+        perror(base);
+        return -1;
+    }
+    while ((d = readdir(dir))) {
+        static const char * const attr[4] = { "idVendor", "idProduct", "busnum", "devnum" };
+
+        for (i = 0; i < 4; i++) {
+            snprintf(file, sizeof(file), "%s/%s/%s", base, d->d_name, attr[i]);
+            if (!(f = fopen(file, "r"))) break;
+            if (fscanf(f, (i < 2) ? "%x" : "%u", &id[i]) != 1) i = 4;
+            fclose(f);
+        }
+        if ((i == 4) && (id[0] == VENDOR_ID) && (id[1] == PRODUCT_ID)) {
+            closedir(dir);
+            snprintf(path, size, "/dev/bus/usb/%03u/%03u", id[2], id[3]);
+            return 0;
+        }
+    }
+    closedir(dir);
+    fprintf(stderr, "no %04x:%04x device found\n", VENDOR_ID, PRODUCT_ID);
+    return -1;
+}
+
+static int get_info(int fd, int csv)
+{
+    uint8_t b[64];
+    unsigned i;
+
+    if (request(fd, GET_INFO, 0, b, sizeof(b)) < 22) {
+        fprintf(stderr, "no telemetry (firmware without DRV_TELEMETRY?)\n");
+        return -1;
+    }
+    info.major = b[0];
+    info.minor = b[1];
+    info.year = get(&b[2], 2);
+    info.month = b[4];
+    info.day = b[5];
+    info.features = b[6];
+    info.flash = get(&b[7], 4);
+    info.ee = get(&b[11], 4);
+    info.hz = get(&b[15], 4);
+    info.stages = b[19];
+    info.buckets = b[20];
+    info.tasks = b[21];
+    if (!info.hz) info.hz = 1;
+
+    printf("%sfirmware %u.%u (%04u-%02u-%02u), target flash %u bytes, data EE ", csv ? "# " : "",
+           info.major, info.minor, info.year, info.month, info.day, (unsigned)info.flash);
+    if (info.ee) printf("at 0x%06x", (unsigned)info.ee);
+    else printf("none");
+    printf("\n%sfeatures:", csv ? "# " : "");
+    for (i = 0; i < sizeof(feature_name) / sizeof(feature_name[0]); i++)
+        if (info.features & (1 << i)) printf(" %s", feature_name[i]);
+    printf("\n");
+    if (csv)
+        printf("time,hex bytes,rows,hex errors,checksum errors,UART overruns,UART drops,bus resets,last error,address\n");
+    return 0;
+}
+
+static double us(uint32_t ticks)
+{
+    return ticks * 1e6 / info.hz;
+}
+
+static int show(int fd, int csv, int clear)
+{
+    uint8_t b[64];
+    unsigned i;
+    int n;
+
+    if (request(fd, GET_COUNTERS, 0, b, sizeof(b)) < 27) {
+        perror("GET_COUNTERS");
+        return -1;
+    }
+    if (csv) {
+        printf("%ld,%u,%u,%u,%u,%u,%u,%u,%s,0x%06x\n", (long)time(NULL),
+               (unsigned)get(&b[0], 4), (unsigned)get(&b[4], 4), (unsigned)get(&b[8], 4),
+               (unsigned)get(&b[12], 4), (unsigned)get(&b[16], 2), (unsigned)get(&b[18], 2),
+               (unsigned)get(&b[20], 2), NAME(error_name, b[22]), (unsigned)get(&b[23], 4));
+        return 0;
+    }
+    printf("hex bytes %u, rows written %u, hex errors %u, checksum errors %u\n",
+           (unsigned)get(&b[0], 4), (unsigned)get(&b[4], 4), (unsigned)get(&b[8], 4), (unsigned)get(&b[12], 4));
+    printf("UART overruns %u, drops %u, bus resets %u\n",
+           (unsigned)get(&b[16], 2), (unsigned)get(&b[18], 2), (unsigned)get(&b[20], 2));
+    printf("last error: %s", NAME(error_name, b[22]));
+    if (b[22]) printf(" at 0x%06x", (unsigned)get(&b[23], 4));
+    printf("\n");
+
+    if (!(info.features & FEATURE_PROFILE)) return 0;
+
+    n = request(fd, GET_STAGES, 0, b, sizeof(b));
+    if (n < 0) {
+        perror("GET_STAGES");
+        return -1;
+    }
+    printf("%-10s %8s %10s %10s\n", "stage", "count", "total ms", "max us");
+    for (i = 0; (i < info.stages) && ((int)(10 * i + 10) <= n); i++)
+        printf("%-10s %8u %10.1f %10.1f\n", NAME(stage_name, i), (unsigned)get(&b[10 * i], 2),
+               us(get(&b[10 * i + 2], 4)) / 1000, us(get(&b[10 * i + 6], 4)));
+
+    n = request(fd, GET_LOOP, clear, b, sizeof(b));
+    if (n < (int)(2 * info.buckets + 9)) {
+        perror("GET_LOOP");
+        return -1;
+    }
+    printf("main loop passes:\n");
+    for (i = 0; i < info.buckets; i++)
+        printf("  %s %8.0f us %8u\n", (i < info.buckets - 1) ? "< " : ">=",
+               us(64 << ((i < info.buckets - 1) ? i : i - 1)), (unsigned)get(&b[2 * i], 2));
+    n = 2 * info.buckets;
+    printf("longest pass %.1f us, %s task %.1f us\n", us(get(&b[n], 4)),
+           NAME(task_name, b[n + 8]), us(get(&b[n + 4], 4)));
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "%s [-i seconds] [-l] [-c] [-d /dev/bus/usb/BBB/DDD | tty]\n"
+                    "  -i seconds poll period (default: once)\n"
+                    "  -l         one CSV line of counters per poll: time, hex bytes,\n"
+                    "             rows, hex errors, checksum errors, UART overruns,\n"
+                    "             UART drops, bus resets, last error, its address\n"
+                    "  -c         clear the main loop statistics once read\n"
+                    "  -d device  usbfs node (default: the first %04x:%04x device)\n",
+                    name, VENDOR_ID, PRODUCT_ID);
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    char path[PATH_MAX];
+    const char *device = NULL, *tty = NULL;
+    int period = 0, csv = 0, clear = 0, fd, i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-l")) csv = 1;
+        else if (!strcmp(argv[i], "-c")) clear = 1;
+        else if (!strcmp(argv[i], "-i") && (i + 1 < argc)) period = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-d") && (i + 1 < argc)) device = argv[++i];
+        else if ((argv[i][0] != '-') && !tty) tty = argv[i];
+        else usage(argv[0]);
+    }
+    if (device) {
+        strncpy(path, device, sizeof(path) - 1);
+        path[sizeof(path) - 1] = '\0';
+    }
+    else if (find(tty, path, sizeof(path)) < 0)
+        return -1;
+    if ((fd = open(path, O_RDWR)) < 0) {
+        perror(path);
+        return -1;
+    }
+    if (get_info(fd, csv) < 0) return -1;
+    do {
+        if (show(fd, csv, clear) < 0) return -1;
+        fflush(stdout);
+        if (period) sleep(period);
+    } while (period);
+    close(fd);
+    return 0;
+}
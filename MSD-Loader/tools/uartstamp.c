@@ -0,0 +1,175 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ Timestamped UART capture decoder
+
+ Enables the timestamp capture mode of the XPRESS virtual serial port (vendor
+ request CDC_VENDOR_SET_TIMESTAMP, sent through usbfs) and decodes the chunks
+ received: each line of the target output is printed with the time of its
+ first byte, taken by the RX interrupt, and the time since the previous line.
+ The release of the target reset (CDC_RESET_LINE_STATE) is marked and
+ restarts the time, so that boot times are read directly.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <linux/usbdevice_fs.h>
+
+#define TIME_HZ             1500000     // UART_TIME_HZ (Fosc/4 / 8)
+#define VENDOR_SET_TIMESTAMP 0x40       // CDC_VENDOR_SET_TIMESTAMP
+#define CHUNK_HEADER        5           // CDC_CHUNK_HEADER
+#define CHUNK_DATA_MAX      59
+
+static const struct { unsigned baud; speed_t code; } speeds[] = {
+    { 9600, B9600 }, { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 },
+    { 115200, B115200 }, { 230400, B230400 }, { 460800, B460800 },
+    { 500000, B500000 }, { 921600, B921600 }, { 1000000, B1000000 },
+};
+
+/**
+ * Send the timestamp vendor request to the USB device behind a tty
+ * (/sys/class/tty/<name>/device is the CDC interface, its parent the device)
+ */
+static int timestamp_enable(const char *tty, int enable)
+{
+    char path[PATH_MAX], dev[PATH_MAX], *name;
+    unsigned bus, addr;
+    struct usbdevfs_ctrltransfer ctrl = {
+        .bRequestType = 0x40,           // vendor, device, OUT
+        .bRequest = VENDOR_SET_TIMESTAMP,
+        .wValue = enable,
+        .timeout = 1000,
+    };
+    FILE *f;
+    int fd, rc;
+
+    strncpy(dev, tty, sizeof(dev) - 1);
+    name = basename(dev);
+    snprintf(path, sizeof(path), "/sys/class/tty/%s/device/../busnum", name);
+    if (!(f = fopen(path, "r")) || (fscanf(f, "%u", &bus) != 1)) goto fail;
+    fclose(f);
+    snprintf(path, sizeof(path), "/sys/class/tty/%s/device/../devnum", name);
+    if (!(f = fopen(path, "r")) || (fscanf(f, "%u", &addr) != 1)) goto fail;
+    fclose(f);
+    snprintf(path, sizeof(path), "/dev/bus/usb/%03u/%03u", bus, addr);
+    if ((fd = open(path, O_RDWR)) < 0) {
+        perror(path);
+        return -1;
+    }
+    rc = ioctl(fd, USBDEVFS_CONTROL, &ctrl);
+    if (rc < 0) perror("SET_TIMESTAMP");
+    close(fd);
+    return rc;
+
+fail:
+    if (f) fclose(f);
+    fprintf(stderr, "%s: not a USB serial port\n", tty);
+    return -1;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "%s [-b baud] [-c] [-n] <tty>\n"
+                    "  -b baud    target UART rate (default 115200)\n"
+                    "  -c         print the raw chunks instead of lines\n"
+                    "  -n         the capture mode is already enabled\n", name);
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct termios tio;
+    uint8_t buf[4096], chunk[CHUNK_HEADER + CHUNK_DATA_MAX];
+    char line[256];
+    unsigned baud = 115200, fill = 0, len = 0, i, j;
+    int raw = 0, enable = 1, fd, n;
+    uint64_t now = 0, origin = 0, last = 0, line_time = 0;
+    uint32_t stamp, prev = 0;
+
+    for (i = 1; (i < (unsigned)argc) && (argv[i][0] == '-'); i++) {
+        if (!strcmp(argv[i], "-c")) raw = 1;
+        else if (!strcmp(argv[i], "-n")) enable = 0;
+        else if (!strcmp(argv[i], "-b") && (i + 1 < (unsigned)argc)) baud = atoi(argv[++i]);
+        else usage(argv[0]);
+    }
+    if (i + 1 != (unsigned)argc) usage(argv[0]);
+    for (j = 0; j < sizeof(speeds) / sizeof(speeds[0]); j++)
+        if (speeds[j].baud == baud) break;
+    if (j == sizeof(speeds) / sizeof(speeds[0])) usage(argv[0]);
+
+    if ((fd = open(argv[i], O_RDWR | O_NOCTTY)) < 0) {
+        perror(argv[i]);
+        return -1;
+    }
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speeds[j].code);
+    cfsetospeed(&tio, speeds[j].code);
+    tcsetattr(fd, TCSANOW, &tio);
+    if (enable && (timestamp_enable(argv[i], 1) < 0)) return -1;
+    tcflush(fd, TCIFLUSH);
+
+    while ((n = read(fd, &buf[fill], sizeof(buf) - fill)) > 0) {
+        fill += n;
+        for (i = 0; (i < fill) && (i + CHUNK_HEADER + buf[i] <= fill); i += CHUNK_HEADER + chunk[0]) {
+            if (buf[i] > CHUNK_DATA_MAX) {
+                fprintf(stderr, "out of sync\n");
+                return -1;
+            }
+            memcpy(chunk, &buf[i], CHUNK_HEADER + buf[i]);
+            // 32-bit time, unwrapped
+            stamp = chunk[1] | (chunk[2] << 8) | ((uint32_t)chunk[3] << 16) | ((uint32_t)chunk[4] << 24);
+            now += (uint32_t)(stamp - prev);
+            prev = stamp;
+
+            if (chunk[0] == 0) {        // target reset released
+                if (len) printf("%12.6f %+10.6f  %.*s\n", (line_time - origin) / (double)TIME_HZ,
+                                (line_time - last) / (double)TIME_HZ, len, line);
+                len = 0;
+                origin = last = now;
+                printf("---------- reset ----------\n");
+            }
+            else if (raw) {
+                printf("%12.6f %+10.6f %3u:", (now - origin) / (double)TIME_HZ,
+                       (now - last) / (double)TIME_HZ, chunk[0]);
+                for (j = 0; j < chunk[0]; j++) printf(" %02x", chunk[CHUNK_HEADER + j]);
+                printf("\n");
+                last = now;
+            }
+            else for (j = 0; j < chunk[0]; j++) {
+                char c = chunk[CHUNK_HEADER + j];
+                if (len == 0) line_time = now;  // a line gets the time of its first chunk
+                if ((c == '\n') || (len == sizeof(line) - 1)) {
+                    printf("%12.6f %+10.6f  %.*s\n", (line_time - origin) / (double)TIME_HZ,
+                           (line_time - last) / (double)TIME_HZ, len, line);
+                    last = line_time;
+                    len = 0;
+                }
+                else if (c != '\r') line[len++] = c;
+            }
+            fflush(stdout);
+        }
+        memmove(buf, &buf[i], fill -= i);
+    }
+    return 0;
+}
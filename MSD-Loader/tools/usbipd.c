@@ -0,0 +1,734 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ USB/IP device
+
+ Runs the firmware of a configuration on the host, main loop, USB device
+ stack (usb_device.c), MSD and CDC classes and all (see the Makefile, target
+ usbipd), behind the USB module of sim/sie.c, and exports it as a USB/IP
+ device. Attached by the vhci-hcd driver, the drives and the CDC port show
+ up as with a board and the files copied to the XPRESS drive are programmed
+ into the virtual target of sim/target.c, so that the whole stack, the
+ usb-storage and cdc_acm drivers and the page cache write back included,
+ can be timed without hardware:
+
+   ./usbipd-XPRESS_18K42 &
+   sudo modprobe vhci-hcd
+   sudo usbip attach -r localhost -b 1-1
+   time cp corpus/pic18-full.hex /media/$USER/XPRESS/
+   sudo usbip detach -p 0
+
+ The virtual clock follows the wall clock, the transactions NAKed while the
+ firmware programs the target take as long as on the board; with -f it runs
+ as fast as the host allows instead. The session report (transfers, virtual
+ and wall time, virtual target) is printed on each detach. The UART of the
+ CDC port is not connected: the bytes sent to the target go out at the baud
+ rate of the line coding and are dropped, none are received. With -t, the
+ ICSP pins and the UART TX line are saved as a VCD file (sim/trace.c).
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <xc.h>
+#include "pinout.h"
+#include "sim.h"
+#include "target.h"
+#include "trace.h"
+
+#define USBIP_PORT      3240
+#define USBIP_VERSION   0x0111
+#define OP_REQ_DEVLIST  0x8005
+#define OP_REP_DEVLIST  0x0005
+#define OP_REQ_IMPORT   0x8003
+#define OP_REP_IMPORT   0x0003
+#define CMD_SUBMIT      1
+#define CMD_UNLINK      2
+#define RET_SUBMIT      3
+#define RET_UNLINK      4
+#define URB_ZERO_PACKET 0x0040
+#define HEADER_SIZE     48              // CMD_SUBMIT, RET_SUBMIT, CMD_UNLINK, RET_UNLINK
+
+#define BUSID           "1-1"
+#define BUSNUM          1
+#define DEVNUM          2               // address set by the server
+#define SPEED_FULL      2
+
+#define CLIENTS         4
+#define ENDPOINTS       16
+#define PACKET          64              // full speed bulk packet
+#define FRAME_NS        1000000ull
+#define TIMEOUT         1000000000ull   // enumeration (ns)
+
+// full speed transaction, token, data and handshake packets (ns)
+#define BUS_NS(len)     (((len) + 13) * 2000ull / 3)
+
+enum stage { SETUP, DATA, STATUS };
+
+typedef struct urb {
+    struct urb *next;
+    uint32_t seqnum;
+    uint8_t ep;
+    bool in;                            // data direction
+    uint32_t flags;
+    uint32_t length, actual;            // transfer buffer, transferred
+    uint8_t setup[8];
+    enum stage stage;                   // control transfers
+    uint8_t *data;
+    void (*done)(struct urb *u, int status);    // server request, no RET_SUBMIT
+} URB;
+
+static struct {
+    int fd;
+    bool imported;
+} client[CLIENTS];
+static int listener = -1, imported = -1;
+static bool free_run, verbose;
+static volatile sig_atomic_t stop;
+
+static URB *queue[ENDPOINTS][2];        // pending URBs [ep][in], control on [0][0]
+static uint16_t maxp[ENDPOINTS][2];     // wMaxPacketSize of the endpoints
+static uint8_t device[18], config[255];
+static bool enumerated, reset, attached, progress;
+static uint64_t next_frame, wall0, virtual0;
+static uint64_t uart_free;              // end of the frame on the TX line
+
+static struct {
+    uint64_t start, wall;
+    unsigned long urbs, unlinks, packets, naks, stalls;
+    unsigned long bytes_out, bytes_in;
+    uint64_t bus_time, nak_time;
+} session;
+
+void SYS_InterruptHigh(void);           // system.c
+void UART_timeISR(void);                // bsp.c
+extern volatile uint8_t UART_txHead, UART_txTail;   // bsp.c
+void FIRMWARE_main(void);               // main.c, built with -Dmain=FIRMWARE_main
+void __real_USBDeviceTasks(void);
+
+static uint64_t wall(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+    return p + 4;
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8; p[1] = v;
+    return p + 2;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static void disconnect(int c)
+{
+    if (client[c].fd < 0) return;
+    close(client[c].fd);
+    client[c].fd = -1;
+    if (client[c].imported) {
+        client[c].imported = false;
+        imported = -1;
+    }
+}
+
+static bool send_all(int c, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    ssize_t n;
+
+    while (len) {
+        n = send(client[c].fd, p, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if ((n < 0) && (errno == EINTR)) continue;
+            disconnect(c);
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool recv_all(int c, void *data, size_t len)
+{
+    uint8_t *p = data;
+    ssize_t n;
+
+    while (len) {
+        n = recv(client[c].fd, p, len, MSG_WAITALL);
+        if (n <= 0) {
+            if ((n < 0) && (errno == EINTR)) continue;
+            disconnect(c);
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*----------------------------------------------------------------------------
+ URBs
+ ----------------------------------------------------------------------------*/
+
+static const char *status_name(int status)
+{
+    switch (-status) {
+        case 0:             return "ok";
+        case EPIPE:         return "stall";
+        case EOVERFLOW:     return "overflow";
+        case ECONNRESET:    return "unlinked";
+        default:            return "error";
+    }
+}
+
+static void complete(URB *u, int status)
+{
+    uint8_t h[HEADER_SIZE] = {0}, *p = h;
+    URB **q = &queue[u->ep][(u->ep == 0) ? 0 : u->in];
+
+    while (*q != u) q = &(*q)->next;
+    *q = u->next;
+    if (verbose && ((u->ep == 0) || status))
+        printf("%10.3f EP%u %-3s %5u/%-5u %s\n", SIM_time / 1e6, u->ep, u->in ? "IN" : "OUT",
+               u->actual, u->length, status_name(status));
+    if (u->done)
+        u->done(u, status);
+    else if (imported >= 0) {
+        p = put32(p, RET_SUBMIT);
+        p = put32(p, u->seqnum);
+        p = put32(p + 12, (uint32_t)status);
+        p = put32(p, u->actual);
+        if (send_all(imported, h, sizeof(h)) && u->in && u->actual)
+            send_all(imported, u->data, u->actual);
+    }
+    free(u->data);
+    free(u);
+}
+
+static void submit(URB *u)
+{
+    URB **q = &queue[u->ep][(u->ep == 0) ? 0 : u->in];
+
+    while (*q) q = &(*q)->next;
+    u->next = NULL;
+    *q = u;
+}
+
+static void flush(void)
+{
+    URB *u, *next;
+    int ep, in;
+
+    for (ep = 0; ep < ENDPOINTS; ep++)
+        for (in = 0; in < 2; in++)
+            for (u = queue[ep][in], queue[ep][in] = NULL; u; u = next) {
+                next = u->next;
+                free(u->data);
+                free(u);
+            }
+}
+
+/**
+ * One transaction of the URB at the head of an endpoint queue, the status
+ * stage of a control transfer after its data stage, returns the bus time
+ */
+static uint64_t transact(URB *u)
+{
+    uint8_t buf[PACKET], len = 0;
+    uint16_t size = maxp[u->ep][u->in] ? maxp[u->ep][u->in] : PACKET;
+    uint32_t length = u->length;
+    int r;
+
+    if (u->ep == 0) {
+        uint16_t wLength = u->setup[6] | u->setup[7] << 8;
+        size = device[7] ? device[7] : 8;
+        if (wLength < length) length = wLength;
+        if (u->stage == SETUP) {
+            r = SIM_usbSetup(u->setup);
+            if (r == SIM_USB_ACK) u->stage = length ? DATA : STATUS;
+            len = 8;
+            goto handshake;
+        }
+        if (u->stage == STATUS) {           // zero length packet, opposite direction
+            r = (u->in && length) ? SIM_usbOut(0, buf, 0) : SIM_usbIn(0, buf, &len);
+            if (r == SIM_USB_ACK) complete(u, 0);
+            goto handshake;
+        }
+    }
+    if (u->in) {
+        r = SIM_usbIn(u->ep, buf, &len);
+        if (r == SIM_USB_ACK) {
+            session.bytes_in += len;
+            if (u->actual + len > length) {
+                len = length - u->actual;
+                memcpy(&u->data[u->actual], buf, len);
+                u->actual += len;
+                complete(u, -EOVERFLOW);
+                goto handshake;
+            }
+            memcpy(&u->data[u->actual], buf, len);
+            u->actual += len;
+            if ((len < size) || (u->actual == length)) {
+                if (u->ep == 0) u->stage = STATUS;
+                else complete(u, 0);
+            }
+        }
+    }
+    else {
+        len = (length - u->actual < size) ? length - u->actual : size;
+        r = SIM_usbOut(u->ep, &u->data[u->actual], len);
+        if (r == SIM_USB_ACK) {
+            session.bytes_out += len;
+            u->actual += len;
+            // a short packet ends the transfer, a full one too unless a zero length packet follows
+            if ((len < size) || ((u->actual == length) && ((u->ep == 0) || !(u->flags & URB_ZERO_PACKET)))) {
+                if (u->ep == 0) u->stage = STATUS;
+                else complete(u, 0);
+            }
+        }
+    }
+handshake:
+    if ((r != SIM_USB_NAK) || !u->in || ((u->ep == 0) && (u->stage != DATA)))
+        progress = true;                    // not just an IN endpoint polled
+    if (r == SIM_USB_ACK) {
+        session.packets++;
+        session.bus_time += BUS_NS(len);
+        return BUS_NS(len);
+    }
+    if (r == SIM_USB_STALLED) {
+        session.stalls++;
+        complete(u, -EPIPE);
+    }
+    else {
+        session.naks++;
+        session.nak_time += BUS_NS(0);
+    }
+    return BUS_NS(0);
+}
+
+/*----------------------------------------------------------------------------
+ Enumeration by the server: address, descriptors of the device record
+ ----------------------------------------------------------------------------*/
+
+static void request(uint8_t type, uint8_t req, uint16_t value, uint16_t length, void (*done)(URB *, int))
+{
+    URB *u = calloc(1, sizeof(URB));
+
+    u->setup[0] = type;
+    u->setup[1] = req;
+    u->setup[2] = value;
+    u->setup[3] = value >> 8;
+    u->setup[6] = length;
+    u->setup[7] = length >> 8;
+    u->in = (type & 0x80) != 0;
+    u->length = length;
+    u->data = calloc(1, length ? length : 1);
+    u->done = done;
+    submit(u);
+}
+
+static void failed(const char *what, int status)
+{
+    fprintf(stderr, "enumeration: %s, %s\n", what, status_name(status));
+    exit(-1);
+}
+
+static void configuration(URB *u, int status)
+{
+    unsigned i;
+
+    if (status) failed("GET_DESCRIPTOR(CONFIGURATION)", status);
+    memcpy(config, u->data, u->actual);
+    for (i = 0; i + 6 < u->actual; i += config[i]) {    // endpoint descriptors
+        if (!config[i]) break;
+        if (config[i + 1] == 5)
+            maxp[config[i + 2] & 0x0f][config[i + 2] >> 7] = config[i + 4] | config[i + 5] << 8;
+    }
+    if (!enumerated)
+        printf("%04x:%04x, %u interface(s), exported as %s\n", device[8] | device[9] << 8,
+               device[10] | device[11] << 8, config[4], BUSID);
+    enumerated = true;
+}
+
+static void configuration_header(URB *u, int status)
+{
+    if (status) failed("GET_DESCRIPTOR(CONFIGURATION)", status);
+    request(0x80, 6, 0x0200, u->data[2] | u->data[3] << 8, configuration);
+}
+
+static void device_descriptor(URB *u, int status)
+{
+    if (status) failed("GET_DESCRIPTOR(DEVICE)", status);
+    memcpy(device, u->data, sizeof(device));
+    request(0x80, 6, 0x0200, 9, configuration_header);
+}
+
+static void address(URB *u, int status)
+{
+    if (status) failed("SET_ADDRESS", status);
+    if (!enumerated) request(0x80, 6, 0x0100, sizeof(device), device_descriptor);
+}
+
+/*----------------------------------------------------------------------------
+ USB/IP
+ ----------------------------------------------------------------------------*/
+
+static uint8_t *device_record(uint8_t *p)
+{
+    memset(p, 0, 256 + 32);
+    snprintf((char *)p, 256, "/sys/devices/platform/usbipd/usb%u/%s", BUSNUM, BUSID);
+    strcpy((char *)p + 256, BUSID);
+    p = put32(p + 256 + 32, BUSNUM);
+    p = put32(p, DEVNUM);
+    p = put32(p, SPEED_FULL);
+    p = put16(p, device[8] | device[9] << 8);       // idVendor
+    p = put16(p, device[10] | device[11] << 8);     // idProduct
+    p = put16(p, device[12] | device[13] << 8);     // bcdDevice
+    memcpy(p, &device[4], 3);                       // class, subclass, protocol
+    p[3] = config[5];                               // bConfigurationValue
+    p[4] = device[17];                              // bNumConfigurations
+    p[5] = config[4];                               // bNumInterfaces
+    return p + 6;
+}
+
+static void report(void)
+{
+    TARGET_STATS stats;
+
+    printf("session: %lu URBs, %lu unlinked, %lu stalls\n", session.urbs, session.unlinks, session.stalls);
+    printf("  data OUT / IN : %lu / %lu bytes\n", session.bytes_out, session.bytes_in);
+    printf("  bus           : %lu packets, %.3f ms\n", session.packets, session.bus_time / 1e6);
+    printf("  NAK           : %lu retries, %.3f ms\n", session.naks, session.nak_time / 1e6);
+    printf("  virtual time  : %.3f ms, wall %.3f ms\n", (SIM_time - session.start) / 1e6,
+           (wall() - session.wall) / 1e6);
+    TARGET_statsGet(&stats);
+    TARGET_report(stdout);
+    fflush(stdout);
+}
+
+static void operation(int c)
+{
+    uint8_t h[8], busid[32], reply[8 + 4 + 312 + 4 * 32], *p;
+    unsigned i;
+
+    if (!recv_all(c, h, sizeof(h))) return;
+    p = put16(put16(reply, USBIP_VERSION), 0);
+    p = put32(p, 0);
+    switch (h[2] << 8 | h[3]) {
+        case OP_REQ_DEVLIST:
+            put16(&reply[2], OP_REP_DEVLIST);
+            p = device_record(put32(p, 1));
+            for (i = 0; (i + 8 < sizeof(config)) && config[i]; i += config[i]) {
+                if ((config[i + 1] != 4) || config[i + 3]) continue;   // interfaces, alternate 0
+                memcpy(p, &config[i + 5], 3);
+                p[3] = 0;
+                p += 4;
+            }
+            send_all(c, reply, p - reply);
+            disconnect(c);
+            break;
+        case OP_REQ_IMPORT:
+            if (!recv_all(c, busid, sizeof(busid))) return;
+            put16(&reply[2], OP_REP_IMPORT);
+            if (strncmp((char *)busid, BUSID, sizeof(busid)) || (imported >= 0) || !enumerated) {
+                put32(&reply[4], 1);
+                send_all(c, reply, 8);
+                disconnect(c);
+                break;
+            }
+            p = device_record(p);
+            if (!send_all(c, reply, p - reply)) break;
+            client[c].imported = true;
+            imported = c;
+            attached = true;
+            memset(&session, 0, sizeof(session));
+            session.start = SIM_time;
+            session.wall = wall();
+            flush();
+            reset = true;                   // plugged in again
+            printf("%s imported\n", BUSID);
+            break;
+        default:
+            fprintf(stderr, "unknown operation %02x%02x\n", h[2], h[3]);
+            disconnect(c);
+    }
+}
+
+static void urb(int c)
+{
+    uint8_t h[HEADER_SIZE], r[HEADER_SIZE] = {0};
+    uint32_t seqnum, unlink, npackets;
+    URB *u, **q;
+    int ep, in;
+
+    if (!recv_all(c, h, sizeof(h))) return;
+    seqnum = get32(&h[4]);
+    switch (get32(&h[0])) {
+        case CMD_SUBMIT:
+            u = calloc(1, sizeof(URB));
+            u->seqnum = seqnum;
+            u->in = get32(&h[12]) != 0;
+            u->ep = get32(&h[16]) & (ENDPOINTS - 1);
+            u->flags = get32(&h[20]);
+            u->length = get32(&h[24]);
+            npackets = get32(&h[32]);
+            memcpy(u->setup, &h[40], 8);
+            u->data = calloc(1, u->length ? u->length : 1);
+            if (!u->in && u->length && !recv_all(c, u->data, u->length)) {
+                free(u->data);
+                free(u);
+                return;
+            }
+            session.urbs++;
+            submit(u);
+            if (npackets && (npackets != 0xffffffff))
+                complete(u, -EINVAL);       // no isochronous endpoints
+            break;
+        case CMD_UNLINK:
+            unlink = get32(&h[20]);
+            put32(put32(r, RET_UNLINK), seqnum);
+            for (ep = 0; ep < ENDPOINTS; ep++)
+                for (in = 0; in < 2; in++)
+                    for (q = &queue[ep][in]; *q; q = &(*q)->next) {
+                        if ((*q)->done || ((*q)->seqnum != unlink)) continue;
+                        u = *q;
+                        *q = u->next;
+                        free(u->data);
+                        free(u);
+                        session.unlinks++;
+                        put32(&r[20], (uint32_t)-ECONNRESET);
+                        goto unlinked;
+                    }
+unlinked:
+            send_all(c, r, sizeof(r));      // status 0: already completed
+            break;
+        default:
+            fprintf(stderr, "unknown command %08x\n", get32(&h[0]));
+            disconnect(c);
+    }
+}
+
+/**
+ * Accept the connections and handle the requests waiting, waits up to
+ * timeout ms for the first one
+ */
+static void serve(int timeout)
+{
+    struct pollfd fds[CLIENTS + 1];
+    int i, n = 0, c, one = 1;
+
+    for (i = 0; i < CLIENTS; i++)
+        if (client[i].fd >= 0) {
+            fds[n].fd = client[i].fd;
+            fds[n++].events = POLLIN;
+        }
+    fds[n].fd = listener;
+    fds[n].events = POLLIN;
+    if (poll(fds, n + 1, timeout) <= 0) return;
+
+    for (i = 0; i <= n; i++) {
+        if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+        if (fds[i].fd == listener) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd < 0) continue;
+            for (c = 0; (c < CLIENTS) && (client[c].fd >= 0); c++);
+            if (c == CLIENTS) {
+                close(fd);
+                continue;
+            }
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            client[c].fd = fd;
+            continue;
+        }
+        for (c = 0; (c < CLIENTS) && (client[c].fd != fds[i].fd); c++);
+        if (c == CLIENTS) continue;
+        if (client[c].imported) urb(c);
+        else operation(c);
+    }
+}
+
+static void frames(void)
+{
+    while (SIM_time >= next_frame) {
+        SIM_usbFrame();
+        next_frame += FRAME_NS;
+    }
+}
+
+/**
+ * EUSART transmitter: TXREG is loaded once the previous frame is out on the
+ * TX line, 10 bits (8N1) at the rate of the baud rate generator
+ */
+static void uart(void)
+{
+    uint8_t tail = UART_txTail;
+    unsigned brg = BAUDCONbits.BRG16 ? SPBRGH << 8 | SPBRG : SPBRG;
+    unsigned div = (BAUDCONbits.BRG16 && TXSTAbits.BRGH) ? 4 : (BAUDCONbits.BRG16 || TXSTAbits.BRGH) ? 16 : 64;
+    uint64_t bit = (uint64_t)div * (brg + 1) * 1000000000ull / _XTAL_FREQ;
+
+    TXSTAbits.TRMT = PIR1bits.TXIF = (SIM_time >= uart_free);
+    SYS_InterruptHigh();
+    if (UART_txTail != tail) {
+        TRACE_uart(TXREG, SIM_time, bit);
+        uart_free = SIM_time + 10 * bit;
+    }
+}
+
+/**
+ * The host side, once per pass of the firmware main loop: one transaction
+ * on each endpoint with URBs pending, the start of frame every ms, then the
+ * virtual clock is held back to the wall clock
+ */
+static void host(void)
+{
+    uint64_t ns = 0, now;
+    int64_t ahead;
+    int ep, in;
+
+    if (stop) {
+        if (imported >= 0) report();
+        TRACE_close();
+        exit(0);
+    }
+
+    uart();
+
+    if (reset && SIM_usbReset()) {
+        reset = false;
+        request(0x00, 5, DEVNUM, 0, address);   // SET_ADDRESS
+    }
+    if (!enumerated && (SIM_time > TIMEOUT)) {
+        fprintf(stderr, "enumeration: no answer from the device\n");
+        exit(-1);
+    }
+
+    frames();                               // the firmware delays run the clock too
+    progress = false;
+    for (ep = 0; ep < ENDPOINTS; ep++)
+        for (in = 0; in < 2; in++)
+            if (queue[ep][in]) ns += transact(queue[ep][in]);
+    if (!ns)                                // idle: up to the next frame
+        ns = next_frame - SIM_time;
+    if ((UART_txHead != UART_txTail) && (uart_free > SIM_time) && (uart_free - SIM_time < ns))
+        ns = uart_free - SIM_time;          // or the next byte on the TX line
+    SIM_delay(ns);
+    frames();
+
+    now = wall();
+    ahead = (int64_t)((SIM_time - virtual0) - (now - wall0));
+    if (free_run && progress && (ahead > 0)) {  // busy: the virtual clock keeps its lead
+        virtual0 = SIM_time;
+        wall0 = now;
+        ahead = 0;
+    }
+    serve((ahead > (int64_t)FRAME_NS) ? (int)(ahead / FRAME_NS) : 0);
+    if (attached && (imported < 0)) {       // detached, or the connection was lost
+        attached = false;
+        flush();
+        printf("%s detached\n", BUSID);
+        report();
+    }
+}
+
+void __wrap_USBDeviceTasks(void)
+{
+    host();
+    __real_USBDeviceTasks();
+}
+
+static void interrupted(int sig)
+{
+    stop = 1;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "%s [-f] [-v] [-t trace.vcd] [-a address] [-p port]\n"
+                    "  -f          free running virtual clock (default: follows the wall clock)\n"
+                    "  -v          list the control transfers and the failed URBs\n"
+                    "  -t file     record the ICSP pins and the UART TX line as a VCD file\n"
+                    "  -a address  listen address (default 127.0.0.1)\n"
+                    "  -p port     TCP port (default %u)\n", name, USBIP_PORT);
+    exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons(USBIP_PORT) };
+    const char *vcd = NULL;
+    int i, one = 1;
+
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f")) free_run = true;
+        else if (!strcmp(argv[i], "-v")) verbose = true;
+        else if (!strcmp(argv[i], "-t") && (i + 1 < argc)) vcd = argv[++i];
+        else if (!strcmp(argv[i], "-a") && (i + 1 < argc)) {
+            if (!inet_aton(argv[++i], &sa.sin_addr)) usage(argv[0]);
+        }
+        else if (!strcmp(argv[i], "-p") && (i + 1 < argc)) sa.sin_port = htons(atoi(argv[++i]));
+        else usage(argv[0]);
+    }
+
+    for (i = 0; i < CLIENTS; i++)
+        client[i].fd = -1;
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if ((listener < 0) || bind(listener, (struct sockaddr *)&sa, sizeof(sa)) || listen(listener, CLIENTS)) {
+        perror("usbipd");
+        return -1;
+    }
+    signal(SIGINT, interrupted);
+    signal(SIGTERM, interrupted);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    SIM_reset();
+    SIM_timer1ISR = UART_timeISR;           // Timer1 overflows within the delays too
+    if (!TARGET_init(SIM_LVP)) {
+        fprintf(stderr, "no target model for lvp-%s.c\n", SIM_LVP);
+        return -1;
+    }
+    if (vcd && !TRACE_open(vcd)) {
+        perror(vcd);
+        return -1;
+    }
+    printf("%s on %s:%u\n", SIM_CONF, inet_ntoa(sa.sin_addr), ntohs(sa.sin_port));
+    wall0 = wall();
+    next_frame = FRAME_NS;
+    reset = true;                           // attached: bus reset, then enumeration
+    FIRMWARE_main();                        // does not return
+    return 0;
+}
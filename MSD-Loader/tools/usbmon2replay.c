@@ -0,0 +1,185 @@
+/*******************************************************************************
+Copyright 2016 Microchip Technology Inc. (www.microchip.com)
+
+ usbmon capture to MSD replay trace converter
+
+ Extracts the CBWs and the OUT data of the bulk-only transport from a binary
+ usbmon capture of a Linux host, as written by tcpdump or Wireshark in pcap
+ format (tcpdump -i usbmon<bus> -s 0 -w copy.pcap), and writes them as a
+ trace for msdreplay (see msdreplay.c for the format). The host idle time
+ between a CSW and the next CBW is kept as DELAY items. The usbmon text
+ interface truncates the data to 32 bytes and cannot be used.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define LINKTYPE_USB_LINUX          189     // 48 byte usbmon header
+#define LINKTYPE_USB_LINUX_MMAPPED  220     // 64 byte usbmon header
+
+#define CBW_SIZE        31
+#define CSW_SIZE        13
+#define SECTOR_SIZE     512                 // DATA/ZERO items per sector
+
+static int swap;                            // capture of the other endianness
+
+static uint32_t u32(const uint8_t *p)
+{
+    uint32_t v = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+static uint16_t u16(const uint8_t *p)
+{
+    uint16_t v = p[0] | p[1] << 8;
+    return swap ? __builtin_bswap16(v) : v;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "%s [-d devnum] [-b busnum] <capture.pcap | -> > copy.trace\n"
+                    "  -d devnum  device address (default: the first device sending a CBW)\n"
+                    "  -b busnum  bus number\n", name);
+    exit(-1);
+}
+
+// OUT data, one item per sector, the missing (not captured) bytes are zeros
+static void data_out(const uint8_t *data, unsigned captured, unsigned length)
+{
+    unsigned i, n, j;
+
+    for (i = 0; i < length; i += n) {
+        n = (length - i < SECTOR_SIZE) ? length - i : SECTOR_SIZE;
+        for (j = 0; (j < n) && (i + j < captured) && !data[i + j]; j++);
+        if ((j == n) || (i >= captured)) {
+            printf("ZERO %u\n", n);
+            continue;
+        }
+        printf("DATA ");
+        for (j = 0; j < n; j++)
+            printf("%02x", (i + j < captured) ? data[i + j] : 0);
+        printf("\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint8_t header[24], record[16], *packet = NULL;
+    int devnum = -1, busnum = -1, i, nano;
+    unsigned header_size, size = 0, cbws = 0, truncated = 0;
+    uint32_t expected = 0;                  // OUT data of the current CBW
+    double csw_time = -1;
+    FILE *f;
+
+    for (i = 1; (i < argc - 1) && (argv[i][0] == '-') && argv[i][1]; i++) {
+        if (!strcmp(argv[i], "-d") && (i + 2 < argc)) devnum = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-b") && (i + 2 < argc)) busnum = atoi(argv[++i]);
+        else usage(argv[0]);
+    }
+    if (i + 1 != argc) usage(argv[0]);
+    f = strcmp(argv[i], "-") ? fopen(argv[i], "rb") : stdin;
+    if (!f) {
+        perror(argv[i]);
+        return -1;
+    }
+
+    if (fread(header, 1, sizeof(header), f) != sizeof(header)) {
+        fprintf(stderr, "%s: not a pcap file\n", argv[i]);
+        return -1;
+    }
+    switch (header[0] | header[1] << 8 | header[2] << 16 | (uint32_t)header[3] << 24) {
+        case 0xa1b2c3d4: swap = 0; nano = 0; break;
+        case 0xd4c3b2a1: swap = 1; nano = 0; break;
+        case 0xa1b23c4d: swap = 0; nano = 1; break;
+        case 0x4d3cb2a1: swap = 1; nano = 1; break;
+        default:
+            fprintf(stderr, "%s: not a pcap file (save pcapng captures as pcap)\n", argv[i]);
+            return -1;
+    }
+    switch (u32(&header[20])) {
+        case LINKTYPE_USB_LINUX:            header_size = 48; break;
+        case LINKTYPE_USB_LINUX_MMAPPED:    header_size = 64; break;
+        default:
+            fprintf(stderr, "%s: not a usbmon capture (link type %u)\n", argv[i], u32(&header[20]));
+            return -1;
+    }
+
+    printf("# %s, converted by usbmon2replay\n", argv[i]);
+    while (fread(record, 1, sizeof(record), f) == sizeof(record)) {
+        unsigned captured = u32(&record[8]);
+        double time = u32(&record[0]) + u32(&record[4]) / (nano ? 1e9 : 1e6);
+
+        if (captured > size) {
+            packet = realloc(packet, size = captured);
+            if (!packet) { perror("realloc"); return -1; }
+        }
+        if (fread(packet, 1, captured, f) != captured) break;
+        if (captured < header_size) continue;
+
+        // usbmon header: id, type, transfer type, endpoint, device, bus, ...
+        char type = packet[8];
+        uint8_t transfer = packet[9], ep = packet[10], dev = packet[11];
+        uint16_t bus = u16(&packet[12]);
+        uint32_t length = u32(&packet[32]);         // URB length
+        uint32_t data_length = u32(&packet[36]);    // captured
+        uint8_t *data = &packet[header_size];
+
+        if (transfer != 3) continue;                // bulk only
+        if ((busnum >= 0) && (bus != busnum)) continue;
+        if ((devnum >= 0) && (dev != devnum)) continue;
+        if (data_length > captured - header_size) data_length = captured - header_size;
+
+        if ((type == 'C') && (ep & 0x80) && (data_length == CSW_SIZE) && !memcmp(data, "USBS", 4)) {
+            csw_time = time;                        // command complete
+            continue;
+        }
+        if ((type != 'S') || (ep & 0x80)) continue; // OUT data is in the submissions
+
+        if ((length == CBW_SIZE) && (data_length == CBW_SIZE) && !memcmp(data, "USBC", 4)) {
+            const uint8_t *cb = &data[15];
+            if (expected)
+                fprintf(stderr, "CBW %u: %u bytes of OUT data missing\n", cbws, expected);
+            if (devnum < 0) {
+                devnum = dev;
+                fprintf(stderr, "device %u on bus %u\n", dev, bus);
+            }
+            if ((csw_time >= 0) && (time - csw_time >= 0.001))
+                printf("DELAY %.0f\n", (time - csw_time) * 1000);
+            csw_time = -1;
+            printf("CBW ");
+            for (i = 0; i < CBW_SIZE; i++)
+                printf("%02x", data[i]);
+            if ((cb[0] == 0x28) || (cb[0] == 0x2a))
+                printf("  # %s(10) %u x%u\n", (cb[0] == 0x28) ? "READ" : "WRITE",
+                       (uint32_t)cb[2] << 24 | cb[3] << 16 | cb[4] << 8 | cb[5], cb[7] << 8 | cb[8]);
+            else
+                printf("  # opcode %02x\n", cb[0]);
+            expected = (data[12] & 0x80) ? 0 : data[8] | data[9] << 8 | data[10] << 16 | (uint32_t)data[11] << 24;
+            cbws++;
+        }
+        else if (expected) {
+            if (length > expected) length = expected;
+            if (data_length < length) truncated++;
+            data_out(data, data_length, length);
+            expected -= length;
+        }
+    }
+    if (truncated)
+        fprintf(stderr, "%u OUT transfers truncated by the capture (use -s 0), zeros replayed\n", truncated);
+    fprintf(stderr, "%u CBWs\n", cbws);
+    return 0;
+}